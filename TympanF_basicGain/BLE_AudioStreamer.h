@@ -0,0 +1,84 @@
+/*
+*   BLE_AudioStreamer
+*
+*   Purpose: Stream what the Tympan hears to the phone, through the nRF52.  The audio (one channel) is cut down to
+*     16 kHz, compressed with IMA-ADPCM (see ImaAdpcm.h), and sent to the nRF52 as binary AUDIO frames:
+*
+*      [0x02] [4] [X] [0] [N_LSB] [N_MSB] [0x03] [N bytes of one compressed block] [0x04]
+*
+*     where X is the service_id of the nRF's audio stream service (9).  The nRF packs the blocks into notifications
+*     (see nRF52840_firmware/BLE_AudioStream.h).  That service is off by default, so turn it on (before BEGIN) with
+*     "SET ENABLE_SERVICE_ID9=TRUE".
+*
+*     Feed it with an AudioRecordQueue_F32 (whose sample rate must be 3x the stream's, such as 48 kHz) and call
+*     service() from loop().
+*
+*   MIT License.  use at your own risk.
+*/
+
+#ifndef _BLE_AudioStreamer_h
+#define _BLE_AudioStreamer_h
+
+#include <Tympan_Library.h>
+#include "ImaAdpcm.h"
+
+#define BLE_AUDIO_DECIMATE 3            //48 kHz -> 16 kHz
+#define BLE_AUDIO_BLOCK_NSAMPLES 256    //samples (at 16 kHz) per compressed block, 16 msec
+#define BLE_AUDIO_SERVICE_ID 9          //the nRF's audio stream service
+#define BLE_AUDIO_FRAME_CMD 4           //AUDIO, in the nRF's binary frames
+
+class BLE_AudioStreamer {
+  public:
+    BLE_AudioStreamer(AudioRecordQueue_F32 *_queue, const int _audio_block_samples) : queue(_queue), audio_block_samples(_audio_block_samples) {}
+
+    void begin(Print *_dest) { dest = _dest; n_samples = 0; n_decim = 0; decim_sum = 0.0f; codec.reset(); queue->begin(); is_streaming = true; }
+    void end(void) { queue->end(); queue->clear(); is_streaming = false; }
+    bool isStreaming(void) { return is_streaming; }
+    unsigned long getNFramesSent(void) { return n_frames_sent; }
+
+    //Call from loop().  Takes all of the audio that has arrived and sends each block as soon as it is full.
+    void service(void) {
+      if (!is_streaming || (dest == nullptr)) return;
+      while (queue->available() > 0) {
+        float32_t *audio = queue->readBuffer();
+        for (int i = 0; i < audio_block_samples; i++) addSample(audio[i]);
+        queue->freeBuffer();
+      }
+    }
+
+  private:
+    AudioRecordQueue_F32 *queue;
+    const int audio_block_samples;
+    Print *dest = nullptr;
+    ImaAdpcm codec;
+    bool is_streaming = false;
+    unsigned long n_frames_sent = 0;
+
+    int16_t block[BLE_AUDIO_BLOCK_NSAMPLES];
+    int n_samples = 0;
+    int n_decim = 0;  float decim_sum = 0.0f;
+
+    //average each set of BLE_AUDIO_DECIMATE samples (a simple low-pass filter) and keep one
+    void addSample(const float32_t val) {
+      decim_sum += val;
+      if (++n_decim < BLE_AUDIO_DECIMATE) return;
+      const float ave = constrain(decim_sum / (float)BLE_AUDIO_DECIMATE, -1.0f, 1.0f);
+      decim_sum = 0.0f;  n_decim = 0;
+
+      block[n_samples++] = (int16_t)(32767.0f * ave);
+      if (n_samples >= BLE_AUDIO_BLOCK_NSAMPLES) { sendBlock(); n_samples = 0; }
+    }
+
+    void sendBlock(void) {
+      uint8_t frame[7 + IMA_ADPCM_BLOCK_NBYTES(BLE_AUDIO_BLOCK_NSAMPLES) + 1];
+      const int nbytes = codec.encodeBlock(block, BLE_AUDIO_BLOCK_NSAMPLES, frame + 7);
+      frame[0] = 0x02;  frame[1] = BLE_AUDIO_FRAME_CMD;  frame[2] = BLE_AUDIO_SERVICE_ID;  frame[3] = 0;
+      frame[4] = (uint8_t)(0x00FF & nbytes);  frame[5] = (uint8_t)(0x00FF & (nbytes >> 8));  //little endian
+      frame[6] = 0x03;
+      frame[7 + nbytes] = 0x04;
+      dest->write(frame, 7 + nbytes + 1);
+      n_frames_sent++;
+    }
+};
+
+#endif
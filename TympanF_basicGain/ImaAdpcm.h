@@ -0,0 +1,122 @@
+/*
+*   ImaAdpcm
+*
+*   Purpose: IMA-ADPCM codec (4 bits per sample) for sending audio over BLE.  16-bit audio is squeezed to a
+*     quarter of its size, so 16 kHz mono becomes 64 kbit/sec.
+*
+*   This file only needs <stdint.h>.  It does not use the Tympan_Library or Arduino, so the same file builds on
+*   the Tympan and on a PC (for example, to decode the stream on the phone's side, or to check the codec with
+*   "make test" in the host folder).
+*
+*   Each block is encoded on its own, so that a lost block does not spoil the ones after it:
+*
+*      [PRED_LSB] [PRED_MSB] [INDEX] [0] [N/2 bytes of 4-bit codes]
+*
+*   PRED is the first sample (int16, little endian) and INDEX is the step index for the rest of the block.  The
+*   codes are for the other samples, two per byte, low nibble first.  So, a block of N samples is 4 + N/2 bytes.
+*   (With an even N, the last nibble is padding.)
+*
+*   MIT License.  use at your own risk.
+*/
+
+#ifndef _ImaAdpcm_h
+#define _ImaAdpcm_h
+
+#include <stdint.h>
+
+#define IMA_ADPCM_HEADER_NBYTES 4
+
+//how many bytes a block of n_samples will be
+#define IMA_ADPCM_BLOCK_NBYTES(n_samples) (IMA_ADPCM_HEADER_NBYTES + ((n_samples) / 2))
+
+class ImaAdpcm {
+  public:
+    //Encode n_samples (at least 1) into out[], which must have room for IMA_ADPCM_BLOCK_NBYTES(n_samples).  The
+    //step index carries over from the previous block, so that the start of each block is as good as the rest.
+    //Returns the number of bytes written.
+    int encodeBlock(const int16_t *in, const int n_samples, uint8_t *out) {
+      if (n_samples < 1) return 0;
+      int predictor = in[0];
+      out[0] = (uint8_t)(0x00FF & predictor);  out[1] = (uint8_t)(0x00FF & (predictor >> 8));
+      out[2] = (uint8_t)enc_index;  out[3] = 0;
+
+      int n_bytes = IMA_ADPCM_HEADER_NBYTES;
+      int index = enc_index;
+      for (int i = 1; i < n_samples; i++) {
+        const uint8_t code = encodeSample(in[i], predictor, index);
+        if ((i & 1) == 1) {
+          out[n_bytes] = code;                       //low nibble first
+        } else {
+          out[n_bytes++] |= (uint8_t)(code << 4);
+        }
+      }
+      if ((n_samples & 1) == 0) n_bytes++;           //the last byte only has a low nibble
+      enc_index = index;
+      return n_bytes;
+    }
+
+    //Decode one block (made by encodeBlock) into out[], which must have room for n_samples.  Returns the number of
+    //samples written, or -1 if the block is too short.
+    static int decodeBlock(const uint8_t *in, const int n_bytes, int16_t *out, const int n_samples) {
+      if ((n_samples < 1) || (n_bytes < IMA_ADPCM_BLOCK_NBYTES(n_samples))) return -1;
+      int predictor = (int16_t)((uint16_t)in[0] | ((uint16_t)in[1] << 8));
+      int index = clampIndex(in[2]);
+      out[0] = (int16_t)predictor;
+      for (int i = 1; i < n_samples; i++) {
+        const uint8_t byte = in[IMA_ADPCM_HEADER_NBYTES + (i - 1) / 2];
+        const uint8_t code = ((i & 1) == 1) ? (byte & 0x0F) : (byte >> 4);
+        out[i] = decodeSample(code, predictor, index);
+      }
+      return n_samples;
+    }
+
+    void reset(void) { enc_index = 0; }
+
+  private:
+    int enc_index = 0;
+
+    static int clampIndex(const int index) { return (index < 0) ? 0 : ((index > 88) ? 88 : index); }
+    static int clampSample(const int val) { return (val < -32768) ? -32768 : ((val > 32767) ? 32767 : val); }
+
+    //the decoder's step, shared by the encoder so that both track the same predictor
+    static int16_t decodeSample(const uint8_t code, int &predictor, int &index) {
+      const int step = stepTable(index);
+      int diff = step >> 3;
+      if (code & 4) diff += step;
+      if (code & 2) diff += (step >> 1);
+      if (code & 1) diff += (step >> 2);
+      predictor = clampSample((code & 8) ? (predictor - diff) : (predictor + diff));
+      index = clampIndex(index + indexTable(code));
+      return (int16_t)predictor;
+    }
+
+    static uint8_t encodeSample(const int16_t sample, int &predictor, int &index) {
+      const int step = stepTable(index);
+      int diff = (int)sample - predictor;
+      uint8_t code = 0;
+      if (diff < 0) { code = 8; diff = -diff; }
+      if (diff >= step)        { code |= 4; diff -= step; }
+      if (diff >= (step >> 1)) { code |= 2; diff -= (step >> 1); }
+      if (diff >= (step >> 2)) { code |= 1; }
+      decodeSample(code, predictor, index);  //track what the decoder will have
+      return code;
+    }
+
+    static int indexTable(const uint8_t code) {
+      static const int8_t table[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+      return table[code & 0x0F];
+    }
+
+    static int stepTable(const int index) {
+      static const int16_t table[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+      };
+      return table[index];
+    }
+};
+
+#endif
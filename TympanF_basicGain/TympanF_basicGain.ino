@@ -6,25 +6,38 @@
 *
 *   Blue potentiometer adjusts the digital gain applied to the audio signal.
 *
-*   Uses default sample rate of 44100 Hz with Block Size of 128
+*   Uses a sample rate of 48000 Hz with Block Size of 128
+*
+*   Send 'a' via the USB serial to start streaming the left input to the phone over BLE (compressed, at 16 kHz)
+*   and 'A' to stop.  See BLE_AudioStreamer.h.  The nRF's audio stream service must be enabled first.
 *
 *   MIT License.  use at your own risk.
 */
 
 //here are the libraries that we need
 #include <Tympan_Library.h>  //include the Tympan Library
+#include "BLE_AudioStreamer.h"
+
+//set the sample rate and block size (48 kHz, so that the BLE audio stream is an even 16 kHz)
+const float sample_rate_Hz = 48000.0f;
+const int audio_block_samples = 128;
+AudioSettings_F32 audio_settings(sample_rate_Hz, audio_block_samples);
 
 //create audio library objects for handling the audio
-Tympan                    myTympan(TympanRev::F);  //do TympanRev::D or TympanRev::E or TympanRev::F
-AudioInputI2S_F32         i2s_in;        //Digital audio *from* the Tympan AIC.
-AudioEffectGain_F32       gain1, gain2;  //Applies digital gain to audio data.
-AudioOutputI2S_F32        i2s_out;       //Digital audio *to* the Tympan AIC.  Always list last to minimize latency
+Tympan                    myTympan(TympanRev::F, audio_settings);  //do TympanRev::D or TympanRev::E or TympanRev::F
+AudioInputI2S_F32         i2s_in(audio_settings);        //Digital audio *from* the Tympan AIC.
+AudioEffectGain_F32       gain1(audio_settings), gain2(audio_settings);  //Applies digital gain to audio data.
+AudioRecordQueue_F32      ble_queue(audio_settings);     //Collects the audio to stream over BLE
+AudioOutputI2S_F32        i2s_out(audio_settings);       //Digital audio *to* the Tympan AIC.  Always list last to minimize latency
 
 //Make all of the audio connections
 AudioConnection_F32       patchCord1(i2s_in, 0, gain1, 0);    //connect the Left input
 AudioConnection_F32       patchCord2(i2s_in, 1, gain2, 0);    //connect the Right input
 AudioConnection_F32       patchCord11(gain1, 0, i2s_out, 0);  //connect the Left gain to the Left output
 AudioConnection_F32       patchCord12(gain2, 0, i2s_out, 1);  //connect the Right gain to the Right output
+AudioConnection_F32       patchCord21(i2s_in, 0, ble_queue, 0); //connect the Left input to the BLE audio stream
+
+BLE_AudioStreamer         ble_audio(&ble_queue, audio_block_samples);
 
 
 // define the setup() function, the function that is called once when the device is booting
@@ -33,11 +46,11 @@ float vol_knob_gain_dB = 0.0;      //will be overridden by volume knob
 void setup() {
 
   //begin the serial comms (for debugging)
-  Serial.begin(115200);  delay(500);
+  myTympan.beginBothSerial();  delay(500);  //USB and the serial link to the nRF52
   Serial.println("BasicGain: starting setup()...");
 
   //allocate the dynamic memory for audio processing blocks
-  AudioMemory_F32(10); 
+  AudioMemory_F32(20, audio_settings);  //extra, for the BLE audio queue
 
   //Enable the Tympan to start the audio flowing!
   myTympan.enable(); // activate the Tympan's audio module
@@ -67,12 +80,31 @@ void loop() {
   //let's blink the LEDs!
   myTympan.serviceLEDs(millis());   //defaults to a slow toggle, add parameter 'true' to blink fast (see Tympan.h and Tympan.cpp)
 
+  //respond to the USB serial
+  while (Serial.available()) respondToByte((char)Serial.read());
+
+  //send any audio that is ready to the nRF52
+  ble_audio.service();
 
 } //end loop();
 
 
 // ///////////////// Servicing routines
 
+//respondToByte: 'a' starts the BLE audio stream and 'A' stops it
+void respondToByte(char c) {
+  switch (c) {
+    case 'a':
+      Serial.println("BLE audio stream: starting (the nRF must have \"SET ENABLE_SERVICE_ID9=TRUE\")...");
+      ble_audio.begin(myTympan.BT_Serial);
+      break;
+    case 'A':
+      ble_audio.end();
+      Serial.print("BLE audio stream: stopped after "); Serial.print(ble_audio.getNFramesSent()); Serial.println(" frames");
+      break;
+  }
+}
+
 //servicePotentiometer: listens to the blue potentiometer and sends the new pot value
 //  to the audio processing algorithm as a control parameter
 void servicePotentiometer(unsigned long curTime_millis, unsigned long updatePeriod_millis) {
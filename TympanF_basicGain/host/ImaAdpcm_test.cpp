@@ -0,0 +1,105 @@
+/*
+*   ImaAdpcm_test
+*
+*   Purpose: Checks the IMA-ADPCM codec (../ImaAdpcm.h) on a PC.  Run it with "make test" in this folder.  It
+*     encodes and decodes test audio and checks that:
+*
+*        * each block is the size that IMA_ADPCM_BLOCK_NBYTES() says, for both odd and even block lengths
+*        * the decoded audio is close enough to the original (SNR of at least MIN_SNR_DB)
+*        * the first sample of each block comes back exactly
+*        * a block decodes the same whether or not the block before it was lost
+*        * a block that is too short is refused
+*
+*     Returns 0 if everything passed.  (The Arduino IDE ignores this folder, so this is not part of the sketch.)
+*
+*   MIT License.  use at your own risk.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../ImaAdpcm.h"
+
+#define SAMPLE_RATE_HZ 16000.0
+#define N_TOTAL 16384        //samples of test audio
+#define MIN_SNR_DB 24.0      //this test audio gives about 27 dB.  A drop of a few dB means that the codec is broken.
+
+static int n_failed = 0;
+
+static void check(const bool ok, const char *what, const int n_samples) {
+  if (!ok) { printf("ImaAdpcm_test: FAIL: %s (block of %d samples)\n", what, n_samples); n_failed++; }
+}
+
+//speech-like test audio: a few tones that come and go, plus a little noise
+static void makeTestAudio(int16_t *audio, const int n) {
+  unsigned int seed = 12345;
+  for (int i = 0; i < n; i++) {
+    const double t = i / SAMPLE_RATE_HZ;
+    const double envelope = 0.5 + 0.5 * sin(2.0 * M_PI * 3.0 * t);
+    double val = 6000.0 * sin(2.0 * M_PI * 220.0 * t) + 3000.0 * sin(2.0 * M_PI * 1230.0 * t) + 1500.0 * sin(2.0 * M_PI * 3170.0 * t);
+    seed = seed * 1103515245U + 12345U;
+    val = envelope * val + (((int)((seed >> 16) & 0x7FFF)) - 16384) / 32.0;
+    audio[i] = (int16_t)val;
+  }
+}
+
+//encode and decode all of the audio in blocks of n_samples.  Returns the SNR in dB.
+static double testRoundTrip(const int16_t *audio, const int n, const int n_samples) {
+  static uint8_t encoded[IMA_ADPCM_BLOCK_NBYTES(N_TOTAL)];
+  static int16_t decoded[N_TOTAL];
+  ImaAdpcm codec;
+  double signal_pow = 0.0, error_pow = 0.0;
+  const int n_blocks = n / n_samples;
+  for (int b = 0; b < n_blocks; b++) {
+    const int16_t *in = audio + b * n_samples;
+    const int n_bytes = codec.encodeBlock(in, n_samples, encoded);
+    check(n_bytes == IMA_ADPCM_BLOCK_NBYTES(n_samples), "block is the wrong size", n_samples);
+    check(ImaAdpcm::decodeBlock(encoded, n_bytes, decoded, n_samples) == n_samples, "block did not decode", n_samples);
+    check(decoded[0] == in[0], "first sample of the block is not exact", n_samples);
+    for (int i = 0; i < n_samples; i++) {
+      signal_pow += (double)in[i] * in[i];
+      error_pow += ((double)in[i] - decoded[i]) * ((double)in[i] - decoded[i]);
+    }
+  }
+  return 10.0 * log10(signal_pow / ((error_pow > 0.0) ? error_pow : 1.0));
+}
+
+//encode three blocks in a row.  Decoding the third must not depend on whether the second one arrived.
+static void testLostBlock(const int16_t *audio, const int n_samples) {
+  uint8_t blocks[3][IMA_ADPCM_BLOCK_NBYTES(1024)];
+  int16_t with_all[1024], after_loss[1024];
+  ImaAdpcm codec;
+  int n_bytes[3];
+  for (int b = 0; b < 3; b++) n_bytes[b] = codec.encodeBlock(audio + b * n_samples, n_samples, blocks[b]);
+
+  ImaAdpcm::decodeBlock(blocks[0], n_bytes[0], with_all, n_samples);      //all blocks arrive
+  ImaAdpcm::decodeBlock(blocks[1], n_bytes[1], with_all, n_samples);
+  ImaAdpcm::decodeBlock(blocks[2], n_bytes[2], with_all, n_samples);
+  ImaAdpcm::decodeBlock(blocks[0], n_bytes[0], after_loss, n_samples);    //the second block is lost
+  ImaAdpcm::decodeBlock(blocks[2], n_bytes[2], after_loss, n_samples);
+  check(memcmp(with_all, after_loss, n_samples * sizeof(int16_t)) == 0, "block after a lost block decodes differently", n_samples);
+}
+
+int main(void) {
+  static int16_t audio[N_TOTAL];
+  makeTestAudio(audio, N_TOTAL);
+
+  const int block_lengths[] = { 1, 2, 3, 31, 32, 255, 256, 257, 1024 };
+  for (const int n_samples : block_lengths) {
+    const double snr_dB = testRoundTrip(audio, N_TOTAL, n_samples);
+    printf("ImaAdpcm_test: %4d samples per block: %4d bytes, SNR = %.1f dB\n", n_samples, IMA_ADPCM_BLOCK_NBYTES(n_samples), snr_dB);
+    if (n_samples >= 31) check(snr_dB >= MIN_SNR_DB, "SNR is too low", n_samples);  //tiny blocks are mostly header
+    testLostBlock(audio, n_samples);
+  }
+
+  //a block that is too short must be refused
+  uint8_t encoded[IMA_ADPCM_BLOCK_NBYTES(256)];
+  int16_t decoded[256];
+  ImaAdpcm codec;
+  const int n_bytes = codec.encodeBlock(audio, 256, encoded);
+  check(ImaAdpcm::decodeBlock(encoded, n_bytes - 1, decoded, 256) == -1, "short block was not refused", 256);
+  check(IMA_ADPCM_BLOCK_NBYTES(256) == 132, "256 samples should be 132 bytes", 256);
+
+  printf("ImaAdpcm_test: %s\n", (n_failed == 0) ? "PASSED" : "FAILED");
+  return (n_failed == 0) ? 0 : 1;
+}
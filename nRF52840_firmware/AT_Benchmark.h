@@ -0,0 +1,197 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** (or on a PC, see host/Makefile) to time how fast we parse the AT-style messages
+// coming from the Tympan and how fast we format the BLEDATA messages going back to the Tympan.  It is only for
+// development.  Run it (via the USB serial menu, or "make bench" in host/) before and after any change to the parser
+// or to the framing so that you can see if it helped.
+//
+// The messages are fed to a separate instance of AT_Processor whose replies go nowhere, so nothing is sent to the
+// Tympan.  No BLE data is sent either, because the benchmark refuses to run while a phone is connected.
+//
+// Results are in ns per byte and in messages per second.  Each message is timed two ways: fed one character at a
+// time (like issueATCommand()) and fed in blocks (like serialEvent()).  Note that, if DEBUG_VIA_USB is true, the
+// timing includes all of the debugging text printed to USB by the code under test.
+//
+// Each message is also started at many places in the parser's circular buffer (every wrap_step bytes, see run()),
+// so that the messages that wrap around the end of the buffer are timed, too.  The slowest start is reported.  As a
+// regression check, the reply to each message must be the same length wherever it starts.  If not, it is reported
+// as a MISMATCH (and counted, see getNMismatches()).
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef AT_BENCHMARK_H
+#define AT_BENCHMARK_H
+
+#include "AT_Processor.h"
+
+extern bool bleConnected;
+extern size_t writeBleDataFrame(Print *dest, const int service_id, const int char_id, const uint8_t data[], const size_t len);
+
+//A Print destination that throws away everything written to it (it only counts the bytes)
+class AT_NullPrint : public Print {
+  public:
+    size_t write(uint8_t) { n_bytes++; return 1; }
+    size_t write(const uint8_t *, size_t size) { n_bytes += size; return size; }
+    unsigned long n_bytes = 0;
+};
+
+class AT_Benchmark {
+  public:
+    AT_Benchmark(Print *_report_ptr) : report_ptr(_report_ptr) {}
+    //Run all of the tests, starting each message every wrap_step bytes across the parser's buffer.  Returns 0 if OK,
+    //-1 if it could not run, or the number of mismatches (see above).
+    int run(const int wrap_step = AT_PROCESSOR_N_BUFFER/8);
+    int getNMismatches(void) { return n_mismatches; }
+
+  private:
+    Print *report_ptr;
+    AT_NullPrint null_sink;
+    AT_Processor parser{nullptr, nullptr, &null_sink};  //no BLE services and its replies go nowhere
+    uint8_t msg[AT_PROCESSOR_N_BUFFER];
+    constexpr static int block_nbytes = 64;         //same as the chunk size used in serialEvent()
+    constexpr static long target_nbytes = 50000L;   //each test feeds about this many bytes (at each start)
+    int wrap_step = AT_PROCESSOR_N_BUFFER;
+    int n_mismatches = 0;
+
+    int buildAsciiMessage(const char *header, const int n_payload);
+    int buildBinaryFrame(const int n_payload);
+    void timeMessage(const char *name, const int len_msg);
+    void timeMessageByMethod(const char *name, const char *method, const int len_msg, const bool by_block);
+    void timeBleDataFrame(const int n_payload);
+    void printResult(const char *name, const char *method, const int len_msg, const long n_reps, const unsigned long dt_micros);
+    void printWorst(const int len_msg, const long n_reps, const unsigned long dt_micros, const int start_ind);
+    static int nRepsFor(const int len_msg) { return (int)max(10L, target_nbytes / max(1, len_msg)); }
+};
+
+int AT_Benchmark::run(const int _wrap_step) {
+  if (bleConnected) {
+    report_ptr->println("AT_Benchmark: *** cannot run while BLE is connected (it would send data) ***");
+    return -1;
+  }
+  wrap_step = max(1, min(_wrap_step, AT_PROCESSOR_N_BUFFER));  n_mismatches = 0;
+  report_ptr->print("AT_Benchmark: starting (each message starts every "); report_ptr->print(wrap_step); report_ptr->println(" bytes across the buffer)...");
+  if (DEBUG_VIA_USB) report_ptr->println("AT_Benchmark: DEBUG_VIA_USB is true, so the timing includes the debugging printouts");
+
+  //ASCII messages that only get a reply
+  timeMessage("GET VERSION", buildAsciiMessage("GET VERSION", 0));
+  timeMessage("GET MTU", buildAsciiMessage("GET MTU", 0));
+
+  //ASCII messages carrying data
+  const int n_payloads = 4;
+  const int payload_nbytes[n_payloads] = {4, 20, 100, BLE_MAX_DATA_NBYTES};
+  char header[32];
+  for (int i=0; i < n_payloads; i++) {
+    snprintf(header, sizeof(header), "SEND");
+    timeMessage(header, buildAsciiMessage(header, payload_nbytes[i]));
+  }
+  for (int i=0; i < n_payloads; i++) {
+    snprintf(header, sizeof(header), "BLENOTIFY 2 0 %X", payload_nbytes[i]);
+    timeMessage(header, buildAsciiMessage(header, payload_nbytes[i]));
+  }
+
+  //binary frames carrying data
+  for (int i=0; i < n_payloads; i++) timeMessage("BINARY NOTIFY 2 0", buildBinaryFrame(payload_nbytes[i]));
+
+  //formatting of the data going back to the Tympan
+  for (int i=0; i < n_payloads; i++) timeBleDataFrame(payload_nbytes[i]);
+
+  report_ptr->print("AT_Benchmark: done.  Mismatches = "); report_ptr->println(n_mismatches);
+  return n_mismatches;
+}
+
+//fill msg[] with the header, a space, the payload (if any), and the EOC.  Returns the total length.
+int AT_Benchmark::buildAsciiMessage(const char *header, const int n_payload) {
+  int len = 0;
+  while ((header[len] != '\0') && (len < AT_PROCESSOR_N_BUFFER-2)) { msg[len] = (uint8_t)header[len]; len++; }
+  if (n_payload > 0) {
+    msg[len++] = ' ';
+    for (int i=0; (i < n_payload) && (len < AT_PROCESSOR_N_BUFFER-1); i++) msg[len++] = (uint8_t)('a' + (i % 26));
+  }
+  msg[len++] = (uint8_t)'\r';  //the EOC
+  return len;
+}
+
+//fill msg[] with a binary NOTIFY frame (see AT_Processor.h for the format).  Returns the total length.
+int AT_Benchmark::buildBinaryFrame(const int n_payload) {
+  int len = 0;
+  msg[len++] = DATASTREAM_START_CHAR;
+  msg[len++] = 2;  //command is NOTIFY
+  msg[len++] = 2;  //service id
+  msg[len++] = 0;  //characteristic id
+  msg[len++] = (uint8_t)(n_payload & 0xFF);
+  msg[len++] = (uint8_t)((n_payload >> 8) & 0xFF);
+  msg[len++] = DATASTREAM_SEPARATOR;
+  for (int i=0; i < n_payload; i++) msg[len++] = (uint8_t)i;
+  msg[len++] = DATASTREAM_END_CHAR;
+  return len;
+}
+
+//feed the message in msg[] to the parser many times, first one character at a time and then in blocks
+void AT_Benchmark::timeMessage(const char *name, const int len_msg) {
+  timeMessageByMethod(name, "per char", len_msg, false);
+  timeMessageByMethod(name, "block", len_msg, true);
+}
+
+//feed the message many times at each start in the parser's buffer.  Check that the reply doesn't depend on the start.
+void AT_Benchmark::timeMessageByMethod(const char *name, const char *method, const int len_msg, const bool by_block) {
+  const long n_reps = nRepsFor(len_msg);
+  unsigned long total_micros = 0, worst_micros = 0;
+  unsigned long reply_nbytes_at_zero = 0;
+  int worst_start = 0, n_starts = 0;
+  for (int start_ind = 0; start_ind < AT_PROCESSOR_N_BUFFER; start_ind += wrap_step) {
+    parser.setMessageStartForTesting(start_ind);
+    const unsigned long n_bytes_before = null_sink.n_bytes;
+    unsigned long start_micros = micros();
+    for (long Irep=0; Irep < n_reps; Irep++) {
+      if (by_block) {
+        for (int i=0; i < len_msg; i += block_nbytes) parser.processSerialBytes(msg + i, (len_msg - i < block_nbytes) ? (len_msg - i) : block_nbytes);
+      } else {
+        for (int i=0; i < len_msg; i++) parser.processSerialCharacter((char)msg[i]);
+      }
+    }
+    const unsigned long dt_micros = micros() - start_micros;
+    total_micros += dt_micros;  n_starts++;
+    if (dt_micros > worst_micros) { worst_micros = dt_micros; worst_start = start_ind; }
+
+    //the replies should not depend on where the message started
+    const unsigned long reply_nbytes = null_sink.n_bytes - n_bytes_before;
+    if (start_ind == 0) {
+      reply_nbytes_at_zero = reply_nbytes;
+    } else if (reply_nbytes != reply_nbytes_at_zero) {
+      n_mismatches++;
+      report_ptr->print("AT_Benchmark: MISMATCH: "); report_ptr->print(name); report_ptr->print(" ("); report_ptr->print(method);
+      report_ptr->print(") starting at "); report_ptr->print(start_ind); report_ptr->print(": reply bytes = "); report_ptr->print(reply_nbytes);
+      report_ptr->print(" vs "); report_ptr->println(reply_nbytes_at_zero);
+    }
+  }
+  parser.setMessageStartForTesting(0);  //back to normal
+  printResult(name, method, len_msg, n_reps * n_starts, total_micros);
+  if (n_starts > 1) printWorst(len_msg, n_reps, worst_micros, worst_start);
+}
+
+//format many BLEDATA messages (as if received from the phone) into the null destination
+void AT_Benchmark::timeBleDataFrame(const int n_payload) {
+  for (int i=0; i < n_payload; i++) msg[i] = (uint8_t)i;
+  const long n_reps = nRepsFor(n_payload);
+  unsigned long start_micros = micros();
+  for (long Irep=0; Irep < n_reps; Irep++) writeBleDataFrame(&null_sink, 7, 1, msg, n_payload);
+  printResult("BLEDATA 7 1", "frame", n_payload, n_reps, micros() - start_micros);
+}
+
+void AT_Benchmark::printWorst(const int len_msg, const long n_reps, const unsigned long dt_micros, const int start_ind) {
+  float dt_sec = max(1UL, dt_micros) * 1.0e-6f;
+  report_ptr->print("AT_Benchmark:     slowest start = "); report_ptr->print(start_ind); report_ptr->print(": ");
+  report_ptr->print(dt_sec * 1.0e9f / ((float)n_reps * len_msg), 1); report_ptr->println(" ns/byte");
+}
+
+void AT_Benchmark::printResult(const char *name, const char *method, const int len_msg, const long n_reps, const unsigned long dt_micros) {
+  float dt_sec = max(1UL, dt_micros) * 1.0e-6f;
+  report_ptr->print("AT_Benchmark: "); report_ptr->print(name);
+  report_ptr->print(" ("); report_ptr->print(len_msg); report_ptr->print(" bytes, "); report_ptr->print(method); report_ptr->print("): ");
+  report_ptr->print(dt_sec * 1.0e9f / ((float)n_reps * len_msg), 1); report_ptr->print(" ns/byte, ");
+  report_ptr->print((float)n_reps / dt_sec, 0); report_ptr->println(" msgs/sec");
+}
+
+#endif
@@ -0,0 +1,72 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to look up the keywords (the verbs and the parameter names) of the
+// AT-style commands coming in over the wired Serial1 link from the Tympan.
+//
+// Each table of keywords is loaded into a small hash table when the firmware starts.  As the keyword is read
+// out of the serial buffer, its hash is computed at the same time.  So, finding the keyword costs one pass over
+// its characters plus (usually) one string compare, no matter how many keywords are in the table.
+//
+// To add a new keyword, just add one entry to the relevant table in AT_Processor.h.  If a table gets too big for the
+// hash table, it won't compile (see n_slots).
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef AT_KEYWORDTABLE_H
+#define AT_KEYWORDTABLE_H
+
+#include <string.h>  //for strncmp()
+
+//One entry in a table of keywords.  T is the class that owns the handler methods (ie, AT_Processor)
+template <class T>
+struct AT_Keyword_t {
+  const char *keyword;      //the keyword itself, such as "SEND" or "ADVERT_SERVICE_ID".  Only 'A'-'Z' and '_' allowed
+  int (T::*handler)(void);  //method to call once the keyword has been found
+  char separator;           //character that must follow the keyword (such as ' ' or '='), or 0 if nothing is required
+};
+
+template <class T>
+class AT_KeywordTable {
+  public:
+    //Give it the table itself (not a pointer), so that its size is checked when compiling
+    template <int N>
+    AT_KeywordTable(const AT_Keyword_t<T> (&_entries)[N]) : entries(_entries), n_entries(N) {
+      static_assert(N < n_slots, "AT_KeywordTable: too many keywords.  Make n_slots bigger.");  //must always leave an empty slot, else find() could loop forever
+      for (int Islot=0; Islot < n_slots; ++Islot) slot_to_entry[Islot] = -1; //mark all slots as empty
+
+      //place each keyword into the slot given by its hash (or the next empty slot, if already taken)
+      for (int Ientry=0; Ientry < n_entries; ++Ientry) {
+        uint32_t hash = 0;
+        for (const char *c = entries[Ientry].keyword; *c != '\0'; ++c) hash = hashStep(hash, *c);
+        int slot = (int)(hash & slot_mask);
+        while (slot_to_entry[slot] >= 0) slot = (slot + 1) & slot_mask;
+        slot_to_entry[slot] = (int8_t)Ientry;
+      }
+    }
+
+    //Given the token and its hash (built up via hashStep()), return the matching entry.  Returns nullptr if not found.
+    const AT_Keyword_t<T>* find(const uint32_t hash, const char *token, const int len) const {
+      int slot = (int)(hash & slot_mask);
+      while (slot_to_entry[slot] >= 0) {
+        const AT_Keyword_t<T> *entry = &(entries[slot_to_entry[slot]]);
+        if ((strncmp(entry->keyword, token, len) == 0) && (entry->keyword[len] == '\0')) return entry;
+        slot = (slot + 1) & slot_mask;
+      }
+      return nullptr;
+    }
+
+    static uint32_t hashStep(const uint32_t hash, const char c) { return (hash * 31) + (uint8_t)c; }
+    static bool isKeywordChar(const char c) { return (((c >= 'A') && (c <= 'Z')) || (c == '_')); }
+    constexpr static int max_keyword_len = 24;  //longer than any keyword that we use
+
+  private:
+    constexpr static int n_slots = 32;  //must be a power of two and must be larger than the number of entries in any table (checked when compiling)
+    constexpr static uint32_t slot_mask = n_slots - 1;
+    const AT_Keyword_t<T> *entries;
+    const int n_entries;
+    int8_t slot_to_entry[n_slots];
+};
+
+#endif
@@ -12,13 +12,107 @@
 //The data bytes can have a carriage return character in the data payload.  It must also have a carriage return
 // at the end of the serial buffer, though, marking the end of the overall message
 //
-//Format: NOTIFY X Y ZZ dddd
-//Format: WRITE X Y ZZ dddd
+//Format: BLENOTIFY X Y ZZ dddd
+//Format: BLEWRITE X Y ZZ dddd
 //
 //  X is one character (0-9) that is the id of the BLE service to employ for the transmission
 //  Y is one character (0-9) that is the id of the BLE characteristic to employ for the transmission
-//  Z is one character (1-9)) that is the number of bytes of the data
-//  dddd are the bytes (1-9 bytes long) to be transmitted
+//  ZZ is one or more hexadecimal characters (1-F4) that is the number of bytes of the data.  A single character
+//     means the same as it always has (ie, "A" is 10 bytes).  More characters allow longer data ("F4" is 244 bytes).
+//  dddd are the bytes to be transmitted.  For a NOTIFY, this can be as long as the ATT MTU negotiated with the
+//     phone allows (MTU minus 3 bytes, up to BLE_MAX_DATA_NBYTES).  Use "GET MTU" to ask for the current MTU.
+//
+//Binary frames: Instead of the ASCII "BLEWRITE" or "BLENOTIFY" messages, the Tympan can send the same request as a
+//binary frame.  This avoids all of the text formatting and parsing.  The frame reuses the DATASTREAM characters that
+//we already use for sending BLE data back to the Tympan (see globalWriteBleDataToTympan()).  The frame must start
+//at the beginning of a message (ie, right after the EOC of the previous message) and does not end with an EOC.
+//
+//Format: [0x02] [CMD] [X] [Y] [N_LSB] [N_MSB] [0x03] [dddd] [0x04]
+//
+//  0x02 is DATASTREAM_START_CHAR
+//  CMD is one byte: 1 for WRITE, 2 for NOTIFY, or 4 for AUDIO (see BLECOMMAND)
+//  X is one byte that is the id of the BLE service to employ for the transmission
+//  Y is one byte that is the id of the BLE characteristic to employ for the transmission
+//  N_LSB, N_MSB is the number of data bytes as an unsigned 16-bit little endian value
+//  0x03 is DATASTREAM_SEPARATOR
+//  dddd are the N data bytes to be transmitted.  Any byte value is allowed.
+//  0x04 is DATASTREAM_END_CHAR
+//
+//The reply ("OK" or "FAIL") is the same as for the ASCII version of the message.  AUDIO frames carry one block of
+//compressed audio for the audio stream service (see BLE_AudioStream.h).  They get no reply, because they are a
+//stream.  Their failures are only counted (see "GET STATS").
+//
+//Tags: Any message (ASCII or binary) can be preceded by a short tag so that the Tympan does not have to wait for
+//each reply before sending the next message.  The reply to that message will start with the same tag, which lets
+//the Tympan match up replies with the messages that it has in flight.  Messages without a tag work as always.
+//
+//Format: #TTTT <message>
+//
+//  # is AT_TAG_START_CHAR
+//  TTTT is the tag.  It is 1 to AT_TAG_MAX_LEN characters, which can be anything other than a space or the EOC
+//  <message> is any message, such as "GET NAME\r" or a binary frame
+//
+//Example: "#7 GET NAME\r" gets the reply "#7 OK TympanF\r".  Messages that never reply (such as SEND) still don't.
+//Also, because the Tympan is matching replies by their tag, tagged SET NAME and SET MAC messages skip the pause
+//and the extra EOC characters that are otherwise sent after them to clear out the UART buffers.
+//A bad tag (empty or too long) gets a FAIL and the ASCII message after it is skipped up to its EOC.  A binary frame
+//after a bad tag is not skipped, though.  It is handled as usual (but without the tag).
+//
+//Batches: A whole set of configuration messages (SET, SVCSETUP, and BEGIN) can be sent as one batch, which gets
+//one reply.  The Tympan can send the whole batch without waiting.  Nothing is applied unless every message in the
+//batch is understood (ie, known verb, known parameter, and a value in the right format and range).  Each message is
+//checked by its own handler, which reads its value and stops before acting on it.  Then, they are applied in order.
+//A message can still fail while it is applied (such as a request that the SoftDevice refuses, or a characteristic
+//that an earlier message in the batch did not add).  Then, the rest are still applied and the reply says which failed.
+//
+//Format: BATCH START
+//        <message 1>
+//        ...
+//        <message N>
+//        BATCH END
+//
+//  Each line ends with the EOC, as usual.  "BATCH START" gets no reply (unless it fails), nor do the messages that
+//  follow it.  "BATCH ABORT" throws away the batch (reply is "OK").  BLEWRITE, BLENOTIFY, and binary frames are not
+//  part of any batch; they are always acted upon immediately.
+//
+//  The reply to "BATCH END" is "OK N" (where N is the number of messages applied) or it is one of these:
+//    "FAIL BATCH not applied: i:e i:e ..."            (some messages were not understood, so none were applied)
+//    "FAIL BATCH applied with errors: i:e i:e ..."    (all were applied, but some failed)
+//    "FAIL BATCH too long"                            (see AT_BATCH_N_BUFFER and AT_BATCH_MAX_N_MSGS)
+//  where each i:e is the index (starting at 1) of the message in the batch followed by its error code.
+//
+//Flow control: If the Tympan sends "SET FLOWCONTROL=ON", it must have credit before sending BLENOTIFY, SEND, or a
+//binary NOTIFY frame.  The nRF gives credits to the Tympan via unsolicited "CREDIT N" DATASTREAM messages as the
+//BLE notification buffers become free.  See BLE_FlowControl.h for the details.
+//
+//BLE data to the Tympan: The data that the phone writes to us is sent to the Tympan as "BLEDATA s c dddd" DATASTREAM
+//messages.  "SET BLEDATAFORMAT=BINARY" switches to a binary frame with no text ("=TEXT" switches back).  See
+//BLE_DataFrame.h for both formats.
+//
+//Link parameters: "SET PHY=", "SET MTU=", "SET CONNINTERVAL=", "SET LATENCY=", and "SET SUPTIMEOUT=" ask the phone for
+//the given BLE link parameters.  The matching GETs reply with the values in use.  The nRF tells the Tympan whenever
+//they change via unsolicited "LINK ..." DATASTREAM messages.  See BLE_LinkParams.h for the details.
+//
+//Throughput test: "THROUGHPUT TX X Y N SECS", "THROUGHPUT RX SECS", and "THROUGHPUT STOP" run a test of how fast
+//the phone can take (or send) BLE data.  "GET THROUGHPUT" replies with the results.  See BLE_ThroughputTest.h.
+//
+//Several phones: Up to BLE_MAX_CONNECTIONS phones can be connected at once.  "SET CONNTARGET=ALL" (the default) sends
+//BLENOTIFY, SEND, and binary NOTIFY frames to all of them, while "SET CONNTARGET=n" sends them to slot n only.
+//"GET CONNECTED" replies with "TRUE n" (n is how many are connected) or "FALSE 0".  "GET CONNECTIONS" replies with
+//each connection's MTU and counters.  See BLE_Connections.h.
+//
+//Saved configuration: "SAVE" stores the whole BLE configuration (MAC, NAME, SVCSETUP, ENABLE_SERVICE_IDx,
+//ADVERT_SERVICE_ID, and BEGIN) in the nRF's flash and replies with its hash.  It is applied at power-up (or by "LOAD",
+//before BEGIN).  "GET PROFILEHASH" replies with the saved hash, so the Tympan can skip configuring the nRF if it
+//matches.  "SAVE ERASE" removes it.  See BLE_Profile.h.
+//
+//Live status: "SET ADVSTATUS=battery mode level" puts those three bytes (plus the number of connected phones) into
+//the advertising data, so phones can read them by scanning, without connecting.  "SET ADVSTATUS=OFF" removes them.
+//Updates do not stop advertising.  See BLE_AdvPayload.h.
+//
+//Advertising profiles: "SET ADVPROFILE=BALANCED", "FAST", "LOWPOWER", or "CUSTOM fast slow timeout power burst
+//directed" chooses the advertising intervals, fast timeout, TX power, burst time, and directed time.  "ADVBURST"
+//advertises at 20 ms for the burst time (such as when the user opens the app).  See BLE_AdvProfiles.h.
 
 
 #ifndef AT_PROCESSOR_H
@@ -26,46 +120,106 @@
 
 #include <bluefruit.h>  //gives us the global "Bluefruit" class instance
 #include "LED_controller.h"
+#include "AT_KeywordTable.h"
+#include "BridgeStats.h"
 
 //externals that are needed here
 extern LED_controller led_control;
 extern bool bleBegun;
 extern bool bleConnected;
-extern char BLEmessage[];
 extern int service_preset_to_ble_advertise;
 extern void setMacAddress(char *);
 extern void startAdv(void);
 extern void stopAdv(void);
+extern int updateAdvertisingData(void);
+#include "BLE_AdvPayload.h"
+extern BLE_AdvPayload ble_adv_payload;
+#include "BLE_AdvProfiles.h"
+extern BLE_AdvProfiles ble_adv_profiles;
+extern int startAdvBurst(void);
+extern int setAdvertisingProfileById(const int id);
+extern int setAdvertisingProfileCustom(const BLE_AdvSettings_t &settings);
 extern void beginAllBleServices(int);
 extern const char versionString[];
+extern BridgeStats bridge_stats;
+extern int getMaxBleDataNBytes(void);
 extern int sendBleDataByServiceAndChar(int command, int service_id, int char_id, int nbytes, const uint8_t *databytes);
+extern int sendAudioFrameByService(int service_id, int nbytes, const uint8_t *databytes);
 extern int setAdvertisingServiceToPresetById(int);
 extern bool enablePresetServiceById(int preset_id, bool enable);
+extern bool isPresetServiceIdValid(int preset_id);
 extern err_t setServiceUUID(const int ble_service_id, const char *uuid_chars, const int len_uuid_chars);
 extern err_t setServiceName(const int ble_service_id, const String name);
 extern err_t addCharacteristic(const int ble_service_id, const char *uuid_chars, const int len_uuid_chars);
 extern err_t setCharacteristicName(const int ble_service_id, const int ble_char_id, const String &name);
 extern err_t setCharacteristicProps(const int ble_service_id, const int ble_char_id, const uint8_t char_props);
 extern err_t setCharacteristicNBytes(const int ble_service_id, const int ble_char_id, const int n_bytes);
+extern err_t setCharacteristicLatestValueWins(const int ble_service_id, const int ble_char_id, const bool latest_value_wins);
+extern void setDeviceName(const char *name);
+extern int saveBleProfile(uint32_t *hash);
+extern int loadBleProfile(bool *flag_begin);
+extern int getSavedBleProfileHash(uint32_t *hash);
+extern int eraseBleProfile(void);
+
+//special characters for framing binary data on the serial link (in both directions)
+#define DATASTREAM_START_CHAR (0x02)
+#define DATASTREAM_SEPARATOR  (0x03)
+#define DATASTREAM_END_CHAR   (0x04)
+
+#include "BLE_DataFrame.h"    //needs the DATASTREAM characters
+extern BLE_DataFrame ble_data_frame;
+#include "BLE_FlowControl.h"  //needs the DATASTREAM characters
+extern BLE_FlowControl flow_control;
+#include "BLE_LinkParams.h"
+extern BLE_LinkParams ble_link_params;
+#include "BLE_ThroughputTest.h"
+extern BLE_ThroughputTest ble_throughput_test;
+#include "BLE_Connections.h"
+extern BLE_Connections ble_connections;
+extern BLE_TxQueue ble_tx_queue;
+
+//optional tag that can precede any message (see above)
+#define AT_TAG_START_CHAR '#'
+#define AT_TAG_MAX_LEN 4
+
+//longest reply that we send (including any tag and the EOC).  Longer replies are truncated.
+#define AT_REPLY_MAX_LEN 288  //long enough for GET STATS
+
+//storage for a batch of configuration messages (see above)
+#define AT_BATCH_N_BUFFER 2048
+#define AT_BATCH_MAX_N_MSGS 64
 
 //running on the nRF52, this interprets commands coming from the hardware serial and send replies out to the BLE
-#define AT_PROCESSOR_N_BUFFER 512
+#define AT_PROCESSOR_N_BUFFER 512  //must be a power of two
+#define AT_PROCESSOR_BUFFER_MASK (AT_PROCESSOR_N_BUFFER-1)  //wrap an index into serial_buff via "& AT_PROCESSOR_BUFFER_MASK"
+static_assert((AT_PROCESSOR_N_BUFFER & AT_PROCESSOR_BUFFER_MASK) == 0, "AT_PROCESSOR_N_BUFFER must be a power of two");
 class AT_Processor {
   public:
-    AT_Processor(BLEUart_Tympan *_bleuart1, HardwareSerial *_ser_ptr) : ble_ptr1(_bleuart1) , serial_ptr(_ser_ptr) {}
-    AT_Processor(BLEUart_Tympan *_bleuart1, BLEUart *_bleuart2, HardwareSerial *_ser_ptr) : ble_ptr1(_bleuart1), ble_ptr2(_bleuart2), serial_ptr(_ser_ptr) {}
+    AT_Processor(BLEUart_Tympan *_bleuart1, Print *_ser_ptr) : ble_ptr1(_bleuart1) , serial_ptr(_ser_ptr) {}
+    AT_Processor(BLEUart_Tympan *_bleuart1, BLEUart *_bleuart2, Print *_ser_ptr) : ble_ptr1(_bleuart1), ble_ptr2(_bleuart2), serial_ptr(_ser_ptr) {}
     
     virtual char getFirstCharInBuffer(void);
     virtual void addToSerialBuffer(char c);
     virtual int processSerialCharacter(char c);  //here's the main entry point to the AT message parsing
+    virtual int processSerialBytes(const uint8_t *bytes, int n_bytes);  //same, but for a whole block of received bytes
     virtual int processSerialCharacterAsBleMessage(char c);
+    virtual int processSerialCharacterAsBinaryFrame(char c);
     virtual int lengthSerialMessage(void);
     virtual int processSerialMessage(void);
+    unsigned long getSerialOverflowCount(void) { return serial_overflow_count; }
+    int getSerialPeakLength(void) { return serial_peak_length; }
+    void resetSerialStats(void) { serial_overflow_count = 0; serial_peak_length = 0; }
+    bool isMessageTagged(void) { return (reply_tag[0] != '\0'); }
+
+    //For testing the parser where messages wrap around the end of serial_buff (see AT_Benchmark.h).  Each new ASCII
+    //message starts at start_ind instead of at zero.  (The data bytes of BLENOTIFY and of binary frames still start at
+    //zero, because they are sent straight out of serial_buff.)  Call between messages.  Use zero for normal operation.
+    void setMessageStartForTesting(const int start_ind) { message_start_ind = start_ind & AT_PROCESSOR_BUFFER_MASK; }
 
   protected:
     BLEUart_Tympan *ble_ptr1 = NULL;
     BLEUart *ble_ptr2 = NULL;
-    HardwareSerial *serial_ptr = &Serial1;
+    Print *serial_ptr = &Serial1;  //where replies are sent.  Normally the serial link to the Tympan
     char EOC = '\r'; //all commands (including "SEND") from the Tympan must end in this character
     enum RXMODE {RXMODE_LOOK_FOR_ANY = 0, 
                 RXMODE_LOOK_FOR_CR_ONLY, 
@@ -73,30 +227,158 @@ class AT_Processor {
                 RXMODE_LOOK_FOR_SERVICE, 
                 RXMODE_LOOK_FOR_CHARACTERISTIC, 
                 RXMODE_LOOK_FOR_NBYTES,
-                RXMODE_LOOK_FOR_DATABYTES};
+                RXMODE_LOOK_FOR_DATABYTES,
+                RXMODE_LOOK_FOR_TAG,
+                RXMODE_SKIP_TO_EOC,
+                RXMODE_BINARY_HEADER,
+                RXMODE_BINARY_DATABYTES,
+                RXMODE_BINARY_END};
     int rx_mode = RXMODE_LOOK_FOR_ANY;
-    enum BLECOMMAND {BLECOMMAND_NONE=0, BLECOMMAND_WRITE, BLECOMMAND_NOTIFY};
+    enum BLECOMMAND {BLECOMMAND_NONE=0, BLECOMMAND_WRITE, BLECOMMAND_NOTIFY, BLECOMMAND_AUDIO=4};  //3 is BLEDATA, going the other way (see BLE_DataFrame.h)
     int ble_command = BLECOMMAND_NONE;
     int ble_service_id= 0;
     int ble_char_id = 0;
     int ble_nbytes = 0;
     //int ble_databyte_counter = 0;
-    const int max_ble_nbytes = 32;
-    uint8_t ble_databytes[32];
-
-    //circular buffer for reading from Serial
+    const int max_ble_nbytes = BLE_MAX_DATA_NBYTES;  //the data bytes are sent straight out of serial_buff, so they must fit in it
+    int sendBleDataAndReply(const uint8_t *databytes, const int nbytes);
+    int sendAudioFrame(const uint8_t *databytes, const int nbytes);
+
+    //state for receiving a binary frame
+    static constexpr int binary_header_nbytes = 6;  //CMD, X, Y, N_LSB, N_MSB, and the DATASTREAM_SEPARATOR
+    uint8_t binary_header[binary_header_nbytes];
+    int binary_counter = 0;
+
+    //state for the optional tag that precedes a message.  The tag is echoed at the start of the reply.
+    char reply_tag[AT_TAG_MAX_LEN+1] = {0};  //null-terminated.  Empty if the current message has no tag
+    int reply_tag_len = 0;
+    bool flag_tag_is_for_next_message = false;  //the tag was just received, so keep it for the message that follows
+
+    //state for a batch of configuration messages.  The messages are stored back-to-back (without their EOC)
+    char batch_buff[AT_BATCH_N_BUFFER];
+    int batch_msg_end[AT_BATCH_MAX_N_MSGS];  //index into batch_buff just past the end of each message
+    int batch_n_msgs = 0;
+    bool flag_batch_started = false;   //true while the messages of a batch are being received
+    bool flag_batch_too_long = false;  //true if the batch did not fit in batch_buff
+    bool flag_mute_replies = false;    //true while the messages of a batch are being applied.  Their replies aren't sent
+    bool flag_muted_reply_failed = false;  //true if a FAIL reply was muted
+    bool flag_check_only = false;      //true while the messages of a batch are being checked.  Their handlers don't act
+    bool isOnlyChecking(void) { if (flag_check_only) serial_read_ind = serial_write_ind; return flag_check_only; }  //call once the value has been read.  If true, return without acting
+    int addSerialMessageToBatch(void);
+    void loadBatchMessageIntoSerialBuff(const int Imsg);
+    int checkBatchMessageInSerialBuff(void);
+    int applyBatchMessageInSerialBuff(const AT_Keyword_t<AT_Processor> *verb);  //verb has already been read
+    int endBatch(void);
+
+    //circular buffer for reading from Serial.  It holds at most AT_PROCESSOR_N_BUFFER-1 bytes (so that full and empty
+    //are different).  If a message is longer than that, the extra bytes are dropped and counted as overflow.
     char serial_buff[AT_PROCESSOR_N_BUFFER];
     int serial_read_ind = 0;
     int serial_write_ind = 0;
+    unsigned long serial_overflow_count = 0;  //how many received bytes have been dropped because serial_buff was full
+    int serial_peak_length = 0;  //the most bytes that have been waiting in serial_buff at one time
+    int addBytesToSerialBuffer(const uint8_t *bytes, int n_bytes);
+    int processSerialBytesUntilEOC(const uint8_t *bytes, int n_bytes);
+    void rewindSerialBuffIfEmpty(void) { if (serial_read_ind == serial_write_ind) { serial_read_ind = 0; serial_write_ind = 0; } }
+    int message_start_ind = 0;  //where each new ASCII message starts in serial_buff.  Only changed for testing.
+    void startMessageInSerialBuffIfEmpty(void) { if (serial_read_ind == serial_write_ind) { serial_read_ind = message_start_ind; serial_write_ind = message_start_ind; } }
+    int getContiguousMessageInSerialBuff(const char **ptr);
+
+    //tables of keywords (verbs and parameter names) and the handler that gets called for each
+    typedef AT_Keyword_t<AT_Processor> Keyword_t;
+    typedef AT_KeywordTable<AT_Processor> KeywordTable;
+    static const Keyword_t verb_keywords[];     static KeywordTable verb_table;
+    static const Keyword_t set_keywords[];      static KeywordTable set_table;
+    static const Keyword_t get_keywords[];      static KeywordTable get_table;
+    static const Keyword_t svcsetup_keywords[]; static KeywordTable svcsetup_table;
+    static const Keyword_t batch_keywords[];    static KeywordTable batch_table;
+    static const Keyword_t throughput_keywords[]; static KeywordTable throughput_table;
+    const Keyword_t* findKeywordInSerialBuff(const KeywordTable &table);
 
     //methods corresponding to the detailed actions that can be taken
     bool compareStringInSerialBuff(const char* test_str, int n);
     bool skipSpaceIfNextInBuffer(void);
+    bool isEndOfMessageInSerialBuff(void);
 
+    //handlers for each verb
+    int processSendMessageInSerialBuff(void);
     int processSvcSetupMessageInSerialBuff(void);  
     int processBeginMessageInSerialBuff(void);
     int processSetMessageInSerialBuff(void);  
     int processGetMessageInSerialBuff(void);
+    int processVersionMessageInSerialBuff(void);
+    int processBatchMessageInSerialBuff(void);
+    int processThroughputMessageInSerialBuff(void);
+    int processSaveMessageInSerialBuff(void);
+    int processLoadMessageInSerialBuff(void);
+    int processAdvBurstMessageInSerialBuff(void);
+
+    //handlers for each BATCH parameter
+    int processBatchStart(void);
+    int processBatchEnd(void);
+    int processBatchAbort(void);
+
+    //handlers for each SET parameter
+    int processSetBegin(void);
+    int processSetBaudrate(void);
+    int processSetMac(void);
+    int processSetName(void);
+    int processSetRfState(void);
+    int processSetAdvertising(void);
+    int processSetAdvServiceId(void);
+    int processSetEnableServiceId(void);
+    int processSetLedMode(void);
+    int processSetStats(void);
+    int processSetFlowControl(void);
+    int processSetBleDataFormat(void);
+    int processSetPhy(void);
+    int processSetMtu(void);
+    int processSetConnInterval(void);
+    int processSetLatency(void);
+    int processSetSupTimeout(void);
+    int processSetConnTarget(void);
+    int processSetAdvStatus(void);
+    int processSetAdvProfile(void);
+
+    //handlers for each GET parameter
+    int processGetBaudrate(void);
+    int processGetName(void);
+    int processGetRfState(void);
+    int processGetAdvertising(void);
+    int processGetAdvServiceId(void);
+    int processGetLedMode(void);
+    int processGetConnected(void);
+    int processGetVersion(void);
+    int processGetMtu(void);
+    int processGetStats(void);
+    int processGetFlowControl(void);
+    int processGetCredits(void);
+    int processGetBleDataFormat(void);
+    int processGetPhy(void);
+    int processGetConnInterval(void);
+    int processGetLatency(void);
+    int processGetSupTimeout(void);
+    int processGetThroughput(void);
+    int processGetConnections(void);
+    int processGetConnTarget(void);
+    int processGetProfileHash(void);
+    int processGetAdvStatus(void);
+    int processGetAdvProfile(void);
+
+    //handlers for each THROUGHPUT parameter
+    int processThroughputTx(void);
+    int processThroughputRx(void);
+    int processThroughputStop(void);
+
+    //handlers for each SVCSETUP parameter
+    int processSvcSetupServiceUuid(void);
+    int processSvcSetupServiceName(void);
+    int processSvcSetupAddChar(void);
+    int processSvcSetupCharName(void);
+    int processSvcSetupCharProps(void);
+    int processSvcSetupCharNBytes(void);
+    int processSvcSetupCharLatest(void);
+
     int setBeginFromSerialBuff(void);
     int setMacAddressFromSerialBuff(void);
     int setBleNameFromSerialBuff(void);
@@ -104,15 +386,21 @@ class AT_Processor {
     int setAdvServiceIdFromSerialBuff(void);
     int setLedModeFromSerialBuff(void);
     int bleSendFromSerialBuff(void);
+    void countSendToConnection(const int slot, const size_t n_sent);
     void debugPrintMsgFromSerialBuff(void);
     void debugPrintMsgFromSerialBuff(int, int);
+    void sendSerialReply(const char *status_str, const char *reply_str, const int err_code);
     void sendSerialOkMessage(void);
     void sendSerialOkMessage(const char* reply_str);
     void sendSerialFailMessage(const char* reply_str);
+    void sendSerialFailMessage(const char* reply_str, const int err_code);  //appends ", err = " and the error code
 
     int getUUIDCharsFromBuffer(const int len_uuid_chars, char *uuid_chars); //output is via uuid_chars
     int getStringFromBuffer(String &out_string); //output is via out_string
     int getValueFromBuffer(int *out_value);  //output is via out_value
+    int getDecimalFromBuffer(int *out_value);  //like getValueFromBuffer() but stops at a space.  Output is via out_value
+    int setLinkParamFromSerialBuff(const char *name, int (BLE_LinkParams::*setter)(const int), bool (*is_valid)(const int));
+    int replyWithLinkParam(const char *name, const int value);
     int getCharPropsFromBuffer(const int n_chars_comprising_char_props, uint8_t *char_props); //output is via char_props
 
     const int VERB_NOT_KNOWN = 1;
@@ -139,15 +427,69 @@ class AT_Processor {
 };
 
 void AT_Processor::addToSerialBuffer(char c) {
-  serial_buff[serial_write_ind] = c; serial_write_ind++; if (serial_write_ind >= AT_PROCESSOR_N_BUFFER) serial_write_ind = 0;
+  int next_write_ind = (serial_write_ind + 1) & AT_PROCESSOR_BUFFER_MASK;
+  if (next_write_ind == serial_read_ind) { serial_overflow_count++; return; }  //buffer is full.  drop the character rather than overwrite unread data
+  serial_buff[serial_write_ind] = c; serial_write_ind = next_write_ind;
+  if (lengthSerialMessage() > serial_peak_length) serial_peak_length = lengthSerialMessage();
+}
+
+//add a block of bytes to the circular buffer (as up to two memcpy's).  Returns the number of bytes added.
+int AT_Processor::addBytesToSerialBuffer(const uint8_t *bytes, int n_bytes) {
+  int n_free = AT_PROCESSOR_BUFFER_MASK - lengthSerialMessage();
+  if (n_bytes > n_free) { serial_overflow_count += (n_bytes - n_free); n_bytes = n_free; }  //drop what doesn't fit
+  int n_first = min(n_bytes, AT_PROCESSOR_N_BUFFER - serial_write_ind);  //up to the end of the buffer
+  memcpy(&serial_buff[serial_write_ind], bytes, n_first);
+  memcpy(&serial_buff[0], bytes + n_first, n_bytes - n_first);  //whatever wraps around to the start of the buffer
+  serial_write_ind = (serial_write_ind + n_bytes) & AT_PROCESSOR_BUFFER_MASK;
+  if (lengthSerialMessage() > serial_peak_length) serial_peak_length = lengthSerialMessage();
+  return n_bytes;
 }
 
 char AT_Processor::getFirstCharInBuffer(void) {
   char c = serial_buff[serial_read_ind];
-  serial_read_ind = (serial_read_ind + 1) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
+  serial_read_ind = (serial_read_ind + 1) & AT_PROCESSOR_BUFFER_MASK; //increment the reader index for the serial buffer
   return c;
 }
 
+//Here's the main entry point for a block of received bytes.  While the parser is waiting for the EOC (or is counting
+//data bytes), the bytes are added to the buffer in bulk.  Only the first few characters of each message (where the
+//parser is looking for keywords) go one-by-one through processSerialCharacter().
+int AT_Processor::processSerialBytes(const uint8_t *bytes, int n_bytes) {
+  int ind = 0;
+  while (ind < n_bytes) {
+    if ((rx_mode == RXMODE_LOOK_FOR_CR_ONLY) || ((rx_mode == RXMODE_LOOK_FOR_DATABYTES) && (lengthSerialMessage() >= ble_nbytes))) {
+      //only looking for the EOC now
+      ind += processSerialBytesUntilEOC(bytes + ind, n_bytes - ind);
+    } else if (rx_mode == RXMODE_LOOK_FOR_DATABYTES) {
+      //still counting data bytes (which may include the EOC character)
+      int n_needed = ble_nbytes - lengthSerialMessage();
+      int n_added = min(n_needed, n_bytes - ind);
+      addBytesToSerialBuffer(bytes + ind, n_added);
+      ind += n_added;
+    } else if (rx_mode == RXMODE_BINARY_DATABYTES) {
+      //still counting data bytes of a binary frame
+      int n_added = min(ble_nbytes - binary_counter, n_bytes - ind);
+      if (binary_counter < max_ble_nbytes) addBytesToSerialBuffer(bytes + ind, min(n_added, max_ble_nbytes - binary_counter));
+      binary_counter += n_added;
+      ind += n_added;
+      if (binary_counter >= ble_nbytes) rx_mode = RXMODE_BINARY_END;
+    } else {
+      processSerialCharacter((char)bytes[ind++]);
+    }
+  }
+  return 0;
+}
+
+//Add bytes to the buffer up to the EOC.  If the EOC is found, it is processed, too.  Returns how many bytes were used.
+int AT_Processor::processSerialBytesUntilEOC(const uint8_t *bytes, int n_bytes) {
+  const uint8_t *eoc_ptr = (const uint8_t *)memchr(bytes, EOC, n_bytes);
+  int n_before_eoc = (eoc_ptr == nullptr) ? n_bytes : (int)(eoc_ptr - bytes);
+  addBytesToSerialBuffer(bytes, n_before_eoc);
+  if (eoc_ptr == nullptr) return n_before_eoc;
+  processSerialCharacter(EOC);  //interpret the message
+  return n_before_eoc + 1;
+}
+
 //here's the main entry point to the AT message parsing
 int AT_Processor::processSerialCharacter(char c) {
   int test_n_char=0;
@@ -155,10 +497,21 @@ int AT_Processor::processSerialCharacter(char c) {
 
   if (rx_mode == RXMODE_LOOK_FOR_ANY) {
     //this branch will, at most, go only 3 characters.  If one is EOC, interpret it as required
+    if (lengthSerialMessage() == 0) {
+      //this is the first character of a new message.  Is it a tag?
+      if (c == AT_TAG_START_CHAR) { rx_mode = RXMODE_LOOK_FOR_TAG; reply_tag_len = 0; return 0; }
+      if (!flag_tag_is_for_next_message) reply_tag[0] = '\0';  //the previous message's tag is not for this message
+      flag_tag_is_for_next_message = false;
+    }
     if (c == EOC) {  //look for the end-of-command character
       processSerialMessage();//the EOC character is NOT added to the serial_buff.  Just go ahead and interpret the serial_buff
       rx_mode = RXMODE_LOOK_FOR_ANY;
+    } else if ((c == DATASTREAM_START_CHAR) && (lengthSerialMessage() == 0)) {
+      //this is the start of a binary frame, not an ASCII message
+      rx_mode = RXMODE_BINARY_HEADER;
+      binary_counter = 0;
     } else {
+      startMessageInSerialBuffIfEmpty(); //start each new message at the beginning of the buffer so that it is contiguous
       addToSerialBuffer(c); //add the character to the buffer
       //look for the "BLE" of "BLEWRITE" or "BLENOTIFY" keywords, which indicate byte-counting operations are needed
       if (lengthSerialMessage() == 3) {
@@ -177,12 +530,130 @@ int AT_Processor::processSerialCharacter(char c) {
     } else {
       addToSerialBuffer(c); //add the character to the buffer
     }
+  } else if (rx_mode == RXMODE_LOOK_FOR_TAG) {
+    if (c == ' ') {
+      //tag is complete.  Keep it for the message that follows
+      reply_tag[reply_tag_len] = '\0';
+      flag_tag_is_for_next_message = true;
+      rx_mode = RXMODE_LOOK_FOR_ANY;
+      if (reply_tag_len == 0) { sendSerialFailMessage("TAG is empty"); bridge_stats.countFailure(FORMAT_PROBLEM); rx_mode = RXMODE_SKIP_TO_EOC; return FORMAT_PROBLEM; }
+    } else if ((c == EOC) || (c == DATASTREAM_START_CHAR)) {
+      reply_tag[reply_tag_len] = '\0';
+      sendSerialFailMessage("TAG has no message");
+      bridge_stats.countFailure(FORMAT_PROBLEM);
+      rx_mode = RXMODE_LOOK_FOR_ANY;
+      if (c == DATASTREAM_START_CHAR) processSerialCharacter(c);  //a binary frame is starting, so start it as usual
+      return FORMAT_PROBLEM;
+    } else if (reply_tag_len >= AT_TAG_MAX_LEN) {
+      reply_tag[reply_tag_len] = '\0';
+      sendSerialFailMessage("TAG is too long");
+      bridge_stats.countFailure(FORMAT_PROBLEM);
+      rx_mode = RXMODE_SKIP_TO_EOC;  //ignore the message that follows the tag
+      return FORMAT_PROBLEM;
+    } else {
+      reply_tag[reply_tag_len++] = c;
+    }
+  } else if (rx_mode == RXMODE_SKIP_TO_EOC) {
+    //skip the ASCII message after a bad tag.  ASCII never has a DATASTREAM_START_CHAR, so that is a binary frame
+    //starting: go back to the start-of-message state and start the frame as usual (don't skip into its data).
+    if (c == EOC) {
+      rx_mode = RXMODE_LOOK_FOR_ANY;
+    } else if (c == DATASTREAM_START_CHAR) {
+      rx_mode = RXMODE_LOOK_FOR_ANY;
+      return processSerialCharacter(c);
+    }
+  } else if (rx_mode >= RXMODE_BINARY_HEADER) {
+    return processSerialCharacterAsBinaryFrame(c);
   } else {
     return processSerialCharacterAsBleMessage(c);
   } 
   return 0;
 }
 
+//The DATASTREAM_START_CHAR has already been received.  Here, receive the rest of the binary frame.
+int AT_Processor::processSerialCharacterAsBinaryFrame(char c) {
+  if (rx_mode == RXMODE_BINARY_HEADER) {
+    binary_header[binary_counter++] = (uint8_t)c;
+    if (binary_counter >= binary_header_nbytes) {
+      //header is complete.  interpret it.
+      ble_command = binary_header[0];
+      ble_service_id = binary_header[1];
+      ble_char_id = binary_header[2];
+      ble_nbytes = ((int)binary_header[3]) | (((int)binary_header[4]) << 8);  //little endian
+      if ((binary_header[5] != DATASTREAM_SEPARATOR) || (ble_nbytes == 0)) {
+        //not valid.  switch back to default mode
+        sendSerialFailMessage("BINARY frame format problem");
+        bridge_stats.countFailure(FORMAT_PROBLEM);
+        rx_mode = RXMODE_LOOK_FOR_ANY;
+        return FORMAT_PROBLEM;
+      }
+      binary_counter = 0;
+      serial_read_ind = serial_write_ind;  //clear any remaining message
+      rewindSerialBuffIfEmpty();  //so that the data bytes will be contiguous in serial_buff
+      rx_mode = RXMODE_BINARY_DATABYTES;
+    }
+  } else if (rx_mode == RXMODE_BINARY_DATABYTES) {
+    //data bytes go into the serial buffer (any bytes beyond max_ble_nbytes are counted, but dropped)
+    if (binary_counter < max_ble_nbytes) addToSerialBuffer(c);
+    binary_counter++;
+    if (binary_counter >= ble_nbytes) rx_mode = RXMODE_BINARY_END;
+  } else if (rx_mode == RXMODE_BINARY_END) {
+    rx_mode = RXMODE_LOOK_FOR_ANY;  //no matter what, the frame is done
+    int err_code = 0;
+    if (c != DATASTREAM_END_CHAR) { sendSerialFailMessage("BINARY frame format problem"); err_code = FORMAT_PROBLEM; }
+    else if ((ble_command != BLECOMMAND_WRITE) && (ble_command != BLECOMMAND_NOTIFY) && (ble_command != BLECOMMAND_AUDIO)) { sendSerialFailMessage("BINARY frame command not known"); err_code = VERB_NOT_KNOWN; }
+    else if (ble_nbytes > max_ble_nbytes) { sendSerialFailMessage("BINARY frame has too many data bytes"); err_code = DATA_WRONG_SIZE; }
+    if (err_code != 0) { bridge_stats.uart_rx_msgs++; bridge_stats.countFailure(err_code); serial_read_ind = serial_write_ind; return err_code; }  //remove the data bytes
+    if (ble_command == BLECOMMAND_AUDIO) {
+      sendAudioFrame((const uint8_t *)&serial_buff[serial_read_ind], ble_nbytes);
+    } else {
+      sendBleDataAndReply((const uint8_t *)&serial_buff[serial_read_ind], ble_nbytes);  //no copy needed.  the data bytes are contiguous
+    }
+    serial_read_ind = serial_write_ind;  //remove the data bytes
+  }
+  return 0;
+}
+
+//give one block of compressed audio to the audio stream service (see BLE_AudioStream.h).  There is no reply.
+int AT_Processor::sendAudioFrame(const uint8_t *databytes, const int nbytes) {
+  bridge_stats.uart_rx_msgs++;
+  int ret_val = sendAudioFrameByService(ble_service_id, nbytes, databytes);
+  if (ret_val == 0) return 0;
+  int err_code = OPERATION_FAILED;                     //-2: the TX queue was full
+  if (ret_val == -1) err_code = PARAMETER_NOT_KNOWN;   //not an audio stream service
+  if (ret_val == -3) err_code = NO_BLE_CONNECTION;
+  bridge_stats.countFailure(err_code);
+  return err_code;
+}
+
+//send the given data bytes using the current ble_command, ble_service_id, and ble_char_id.  Reply to the Tympan.
+int AT_Processor::sendBleDataAndReply(const uint8_t *databytes, const int nbytes) {
+  bridge_stats.uart_rx_msgs++;
+  if ((ble_command == BLECOMMAND_NOTIFY) && (nbytes > getMaxBleDataNBytes())) {
+    sendSerialFailMessage("SEND BLE DATA is longer than the MTU allows");
+    bridge_stats.countFailure(DATA_WRONG_SIZE);
+    return DATA_WRONG_SIZE;
+  }
+  if ((ble_command == BLECOMMAND_NOTIFY) && !flow_control.spendCredits(1)) {
+    sendSerialFailMessage("SEND BLE DATA has no flow control credit");
+    bridge_stats.countFailure(OPERATION_FAILED);
+    return OPERATION_FAILED;
+  }
+  int ret_val = sendBleDataByServiceAndChar(ble_command, ble_service_id, ble_char_id, nbytes, databytes);
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else if (ret_val == -2) {
+    sendSerialFailMessage("SEND BLE DATA queue is full");
+    bridge_stats.countFailure(OPERATION_FAILED);
+  } else { 
+    char reply[40];
+    snprintf(reply, sizeof(reply), "SEND BLE DATA failed to %d, %d", ble_service_id, ble_char_id);
+    sendSerialFailMessage(reply);
+    bridge_stats.countFailure(OPERATION_FAILED);
+  }
+  return ret_val;
+}
+
 
 
 int AT_Processor::processSerialCharacterAsBleMessage(char c) {
@@ -257,36 +728,32 @@ int AT_Processor::processSerialCharacterAsBleMessage(char c) {
     if (c == EOC) {  //look for the end-of-command character
       processSerialMessage();//the EOC character is NOT added to the serial_buff.  Just go ahead and interpret the serial_buff
       rx_mode = RXMODE_LOOK_FOR_ANY;
+    } else if (c != ' ') {
+      addToSerialBuffer(c); //add the character to the buffer.  It is one of the digits of the number of bytes
     } else {
-      addToSerialBuffer(c); //add the character to the buffer
-      if (c == ' ') {
-        //interpret the first character as the id
-        //ble_nbytes = (int)(getFirstCharInBuffer() - '0');
-        ble_nbytes = interpret0toF(getFirstCharInBuffer());
-        if ((ble_nbytes > 0) && (ble_nbytes < 128)) {
-          //valid!
-          rx_mode = RXMODE_LOOK_FOR_DATABYTES;
-          serial_read_ind = serial_write_ind;  //clear any remaining message
-        } else { 
-          //not valid.  switch back to default mode
-          rx_mode = RXMODE_LOOK_FOR_CR_ONLY;
-        }
+      //interpret all of the characters (up to this space) as a hexadecimal number of bytes
+      int n_digits = lengthSerialMessage();
+      ble_nbytes = 0;
+      for (int Idigit = 0; Idigit < n_digits; Idigit++) {
+        int digit = interpret0toF(getFirstCharInBuffer());
+        if ((digit < 0) || (Idigit >= 4)) { ble_nbytes = -1; break; }  //not valid
+        ble_nbytes = (ble_nbytes << 4) + digit;
+      }
+      if ((ble_nbytes > 0) && (ble_nbytes <= max_ble_nbytes)) {
+        //valid!
+        rx_mode = RXMODE_LOOK_FOR_DATABYTES;
+        serial_read_ind = serial_write_ind;  //clear any remaining message
+        rewindSerialBuffIfEmpty();  //so that the data bytes will be contiguous in serial_buff
+      } else { 
+        //not valid.  switch back to default mode
+        rx_mode = RXMODE_LOOK_FOR_CR_ONLY;
       }
     }
   } else if (rx_mode == RXMODE_LOOK_FOR_DATABYTES) {
     if ((lengthSerialMessage() >= ble_nbytes) && (c == EOC)) {
       //message complete!
-      int foo_nbytes = min(max_ble_nbytes,ble_nbytes);
-      for (int Ibyte = 0; Ibyte < foo_nbytes; Ibyte++) ble_databytes[Ibyte] = (uint8_t)getFirstCharInBuffer();
-      int ret_val = sendBleDataByServiceAndChar(ble_command, ble_service_id, ble_char_id, foo_nbytes, ble_databytes);
-      if (ret_val == 0) {
-        sendSerialOkMessage();
-        rx_mode = RXMODE_LOOK_FOR_ANY;
-      } else { 
-        String foo_str = "SEND BLE DATA failed to " + String(ble_service_id) + ", " + String(ble_char_id);
-        sendSerialFailMessage(foo_str.c_str());
-        rx_mode = RXMODE_LOOK_FOR_ANY;
-      }
+      //no copy needed.  The buffer was rewound when the data bytes started, so they are contiguous in serial_buff
+      sendBleDataAndReply((const uint8_t *)&serial_buff[serial_read_ind], ble_nbytes);
       serial_read_ind = serial_write_ind;  //clear any remaining message
       rx_mode = RXMODE_LOOK_FOR_ANY;
     } else {
@@ -300,97 +767,162 @@ int AT_Processor::processSerialCharacterAsBleMessage(char c) {
 }
 
 int AT_Processor::lengthSerialMessage(void) {
-  int len = 0;
-  if (serial_read_ind > serial_write_ind) {
-    len = ((AT_PROCESSOR_N_BUFFER-1) - serial_read_ind) + serial_write_ind;
-  } else {
-    len = serial_write_ind - serial_read_ind;
-  }
-  return len;
+  return (serial_write_ind - serial_read_ind) & AT_PROCESSOR_BUFFER_MASK;
 }
 
 bool AT_Processor::compareStringInSerialBuff(const char* test_str, int n) {
   int ind = serial_read_ind;  //where to start in the read buffer
   for (int i=0; i < n; i++) {
     if (serial_buff[ind] != test_str[i]) return false;
-    ind++;  //increment the read buffer
-    if (ind >= AT_PROCESSOR_N_BUFFER) ind = 0;  //wrap around the read buffer index, if necessary
+    ind = (ind + 1) & AT_PROCESSOR_BUFFER_MASK;  //increment the read buffer and wrap, if necessary
   }
   return true;
 }
 
-int AT_Processor::processSerialMessage(void) {
-  int ret_val = VERB_NOT_KNOWN;
-  int len = lengthSerialMessage();     // how long is the message that was received
-  int test_n_char = 0;
+// ////////////////////////////////// Keyword tables
+//
+// To add a new verb (or a new parameter for SET, GET, or SVCSETUP), add one entry to the relevant table below
+// and write its handler.  The handler is called with the serial buffer pointing just past the keyword (and
+// past its separator, if one is required).
+
+const AT_Processor::Keyword_t AT_Processor::verb_keywords[] = {
+  {"SEND",      &AT_Processor::processSendMessageInSerialBuff,     ' '},  //"SEND "
+  {"SET",       &AT_Processor::processSetMessageInSerialBuff,      ' '},  //"SET "
+  {"GET",       &AT_Processor::processGetMessageInSerialBuff,      ' '},  //"GET "
+  {"BEGIN",     &AT_Processor::processBeginMessageInSerialBuff,      0},  //"BEGIN"
+  {"VERSION",   &AT_Processor::processVersionMessageInSerialBuff,    0},  //"VERSION"
+  {"SVCSETUP",  &AT_Processor::processSvcSetupMessageInSerialBuff,   0},  //"SVCSETUP"
+  {"BATCH",     &AT_Processor::processBatchMessageInSerialBuff,    ' '},  //"BATCH "
+  {"THROUGHPUT",&AT_Processor::processThroughputMessageInSerialBuff,' '},  //"THROUGHPUT "
+  {"SAVE",      &AT_Processor::processSaveMessageInSerialBuff,       0},  //"SAVE"
+  {"LOAD",      &AT_Processor::processLoadMessageInSerialBuff,       0},  //"LOAD"
+  {"ADVBURST",  &AT_Processor::processAdvBurstMessageInSerialBuff,   0}   //"ADVBURST"
+};
+AT_Processor::KeywordTable AT_Processor::verb_table(AT_Processor::verb_keywords);
+
+const AT_Processor::Keyword_t AT_Processor::set_keywords[] = {
+  {"BEGIN",             &AT_Processor::processSetBegin,           '='},
+  {"BAUDRATE",          &AT_Processor::processSetBaudrate,        '='},
+  {"MAC",               &AT_Processor::processSetMac,             '='},
+  {"NAME",              &AT_Processor::processSetName,            '='},
+  {"RFSTATE",           &AT_Processor::processSetRfState,         '='},
+  {"ADVERTISING",       &AT_Processor::processSetAdvertising,     '='},
+  {"ADVERT_SERVICE_ID", &AT_Processor::processSetAdvServiceId,    '='},
+  {"ENABLE_SERVICE_ID", &AT_Processor::processSetEnableServiceId,   0},  //full keyword would be "ENABLE_SERVICE_IDx=" where x is any number
+  {"LEDMODE",           &AT_Processor::processSetLedMode,         '='},
+  {"STATS",             &AT_Processor::processSetStats,           '='},
+  {"FLOWCONTROL",       &AT_Processor::processSetFlowControl,     '='},
+  {"BLEDATAFORMAT",     &AT_Processor::processSetBleDataFormat,   '='},
+  {"PHY",               &AT_Processor::processSetPhy,             '='},
+  {"MTU",               &AT_Processor::processSetMtu,             '='},
+  {"CONNINTERVAL",      &AT_Processor::processSetConnInterval,    '='},
+  {"LATENCY",           &AT_Processor::processSetLatency,         '='},
+  {"SUPTIMEOUT",        &AT_Processor::processSetSupTimeout,      '='},
+  {"CONNTARGET",        &AT_Processor::processSetConnTarget,      '='},
+  {"ADVSTATUS",         &AT_Processor::processSetAdvStatus,       '='},
+  {"ADVPROFILE",        &AT_Processor::processSetAdvProfile,      '='}
+};
+AT_Processor::KeywordTable AT_Processor::set_table(AT_Processor::set_keywords);
+
+const AT_Processor::Keyword_t AT_Processor::get_keywords[] = {
+  {"BAUDRATE",          &AT_Processor::processGetBaudrate,     0},
+  {"NAME",              &AT_Processor::processGetName,         0},
+  {"RFSTATE",           &AT_Processor::processGetRfState,      0},
+  {"ADVERTISING",       &AT_Processor::processGetAdvertising,  0},
+  {"ADVERT_SERVICE_ID", &AT_Processor::processGetAdvServiceId, 0},
+  {"LEDMODE",           &AT_Processor::processGetLedMode,      0},
+  {"CONNECTED",         &AT_Processor::processGetConnected,    0},
+  {"VERSION",           &AT_Processor::processGetVersion,      0},
+  {"MTU",               &AT_Processor::processGetMtu,          0},
+  {"STATS",             &AT_Processor::processGetStats,        0},
+  {"FLOWCONTROL",       &AT_Processor::processGetFlowControl,  0},
+  {"CREDITS",           &AT_Processor::processGetCredits,      0},
+  {"BLEDATAFORMAT",     &AT_Processor::processGetBleDataFormat, 0},
+  {"PHY",               &AT_Processor::processGetPhy,          0},
+  {"CONNINTERVAL",      &AT_Processor::processGetConnInterval, 0},
+  {"LATENCY",           &AT_Processor::processGetLatency,      0},
+  {"SUPTIMEOUT",        &AT_Processor::processGetSupTimeout,   0},
+  {"THROUGHPUT",        &AT_Processor::processGetThroughput,   0},
+  {"CONNECTIONS",       &AT_Processor::processGetConnections,  0},
+  {"CONNTARGET",        &AT_Processor::processGetConnTarget,   0},
+  {"PROFILEHASH",       &AT_Processor::processGetProfileHash,  0},
+  {"ADVSTATUS",         &AT_Processor::processGetAdvStatus,    0},
+  {"ADVPROFILE",        &AT_Processor::processGetAdvProfile,   0}
+};
+AT_Processor::KeywordTable AT_Processor::get_table(AT_Processor::get_keywords);
+
+const AT_Processor::Keyword_t AT_Processor::svcsetup_keywords[] = {
+  {"SERVICEUUID", &AT_Processor::processSvcSetupServiceUuid, '='},
+  {"SERVICENAME", &AT_Processor::processSvcSetupServiceName, '='},
+  {"ADDCHAR",     &AT_Processor::processSvcSetupAddChar,     '='},
+  {"CHARNAME",    &AT_Processor::processSvcSetupCharName,    '='},
+  {"CHARPROPS",   &AT_Processor::processSvcSetupCharProps,   '='},
+  {"CHARNBYTES",  &AT_Processor::processSvcSetupCharNBytes,  '='},
+  {"CHARLATEST",  &AT_Processor::processSvcSetupCharLatest,  '='}
+};
+AT_Processor::KeywordTable AT_Processor::svcsetup_table(AT_Processor::svcsetup_keywords);
 
-  //Serial.println("AT_Processor::processSerialMessage: starting...");
+const AT_Processor::Keyword_t AT_Processor::batch_keywords[] = {
+  {"START", &AT_Processor::processBatchStart, 0},
+  {"END",   &AT_Processor::processBatchEnd,   0},
+  {"ABORT", &AT_Processor::processBatchAbort, 0}
+};
+AT_Processor::KeywordTable AT_Processor::batch_table(AT_Processor::batch_keywords);
 
-  //test for the verb "SEND"
-  test_n_char = 4+1;   //how long is "SEND "
-  if (len >= test_n_char) {  //is the current message long enough for this test?
-    if (compareStringInSerialBuff("SEND ",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SEND "); debugPrintMsgFromSerialBuff(); Serial.println();}
-      bleSendFromSerialBuff(); //must not have any carriage return characters in the payload (other than the trailing carriage return that concludes every message)
-      ret_val = 0; 
-    }
-  }
+const AT_Processor::Keyword_t AT_Processor::throughput_keywords[] = {
+  {"TX",    &AT_Processor::processThroughputTx,   ' '},
+  {"RX",    &AT_Processor::processThroughputRx,   ' '},
+  {"STOP",  &AT_Processor::processThroughputStop,   0}
+};
+AT_Processor::KeywordTable AT_Processor::throughput_table(AT_Processor::throughput_keywords);
 
-  //test for the verb "SET"
-  test_n_char = 3+1; //how long is "SET "
-  if (len >= test_n_char) {
-    if (compareStringInSerialBuff("SET ",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind+test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SET "); debugPrintMsgFromSerialBuff(); Serial.println(); }
-      processSetMessageInSerialBuff();
-      ret_val = 0;
-    }
+//Read the keyword at the front of the serial buffer and look it up in the given table.  If found (including any
+//required separator), the keyword is removed from the serial buffer.  If not found, the serial buffer is left untouched.
+const AT_Processor::Keyword_t* AT_Processor::findKeywordInSerialBuff(const KeywordTable &table) {
+  char token[KeywordTable::max_keyword_len];
+  uint32_t hash = 0;
+  int len = 0;
+  int ind = serial_read_ind;
+
+  //read the keyword and compute its hash in the same pass
+  while ((ind != serial_write_ind) && KeywordTable::isKeywordChar(serial_buff[ind])) {
+    if (len >= KeywordTable::max_keyword_len) return nullptr;  //too long to be any of our keywords
+    token[len++] = serial_buff[ind];
+    hash = KeywordTable::hashStep(hash, serial_buff[ind]);
+    ind = (ind + 1) & AT_PROCESSOR_BUFFER_MASK;  //wrap around the read buffer index, if necessary
   }
+  if (len == 0) return nullptr;
 
-  //test for the verb "GET"
-  test_n_char = 3+1; //how long is "GET "
-  if (len >= test_n_char) {
-    if (compareStringInSerialBuff("GET ",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: GET "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
-      ret_val = processGetMessageInSerialBuff();
-    }
-  } 
+  //look up the keyword
+  const Keyword_t *entry = table.find(hash, token, len);
+  if (entry == nullptr) return nullptr;
 
-  //test for the verb "BEGIN"
-  test_n_char = 5; //how long is "BEGIN"
-  if (len >= test_n_char) {
-    if (compareStringInSerialBuff("BEGIN",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: BEGIN "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
-      ret_val = processBeginMessageInSerialBuff();
-    }
-  } 
+  //check for the required separator
+  if (entry->separator != 0) {
+    if ((ind == serial_write_ind) || (serial_buff[ind] != entry->separator)) return nullptr;
+    ind = (ind + 1) & AT_PROCESSOR_BUFFER_MASK;  //wrap around the read buffer index, if necessary
+  }
 
+  serial_read_ind = ind;  //remove the keyword from the serial buffer
+  return entry;
+}
 
-  //test for the verb "VERSION"
-  test_n_char = 7; //how long is "VERSION"
-  if (len >= test_n_char) {
-    if (compareStringInSerialBuff("VERSION",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      sendSerialOkMessage(versionString);
-      ret_val = 0;
-    }
-  } 
+int AT_Processor::processSerialMessage(void) {
+  int ret_val = VERB_NOT_KNOWN;
 
-  //test for the verb "SVCSETUP"
-  test_n_char = 8; //how long is "SVCSETUP"
-  if (len >= test_n_char) {
-    if (compareStringInSerialBuff("SVCSETUP",test_n_char)) {  //does the current message start this way
-      serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-      if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SVCSETUP "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
-      ret_val = processSvcSetupMessageInSerialBuff();
-    }
-  } 
+  //Serial.println("AT_Processor::processSerialMessage: starting...");
 
-  // serach for another command
-  //   anything?
+  //find the verb and call its handler
+  const int start_ind = serial_read_ind;
+  const Keyword_t *verb = findKeywordInSerialBuff(verb_table);
+  if (flag_batch_started && ((verb == nullptr) || (verb->handler != &AT_Processor::processBatchMessageInSerialBuff))) {
+    //a batch is being received, so don't act on this message yet.  Just store it.
+    serial_read_ind = start_ind;
+    return addSerialMessageToBatch();
+  }
+  if (verb != nullptr) ret_val = (this->*(verb->handler))();
+  bridge_stats.uart_rx_msgs++;
+  bridge_stats.countFailure(ret_val);
 
   // give error message if message isn't known
   if (ret_val != 0) {
@@ -408,21 +940,293 @@ int AT_Processor::processSerialMessage(void) {
   return ret_val;
 }
 
+int AT_Processor::processBatchMessageInSerialBuff(void) {
+  int ret_val = PARAMETER_NOT_KNOWN;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: BATCH "); debugPrintMsgFromSerialBuff(); Serial.println(); }
+
+  //find the parameter and call its handler
+  const Keyword_t *param = findKeywordInSerialBuff(batch_table);
+  if (param != nullptr) ret_val = (this->*(param->handler))();
+  if (ret_val == PARAMETER_NOT_KNOWN) sendSerialFailMessage("BATCH parameter not known");
+  bridge_stats.countFailure(ret_val);  //count it here because we don't return it
+
+  serial_read_ind = serial_write_ind;  //remove the message
+  return 0;  //the BATCH verb itself was understood, even if the parameter was not
+}
+
+int AT_Processor::processBatchStart(void) {
+  if (flag_batch_started) {
+    //the previous batch never ended.  Throw it away and start again.
+    sendSerialFailMessage("BATCH previous batch discarded");
+  }
+  flag_batch_started = true;
+  flag_batch_too_long = false;
+  batch_n_msgs = 0;
+  return 0;  //no reply.  The whole batch gets its reply at the end.
+}
+
+int AT_Processor::processBatchAbort(void) {
+  flag_batch_started = false;
+  batch_n_msgs = 0;
+  sendSerialOkMessage();
+  return 0;
+}
+
+int AT_Processor::processBatchEnd(void) {
+  if (!flag_batch_started) { sendSerialFailMessage("BATCH was not started"); return FORMAT_PROBLEM; }
+  flag_batch_started = false;
+  serial_read_ind = serial_write_ind;  //remove the "BATCH END" message.  The serial buffer is now used for the batch
+  int ret_val = endBatch();
+  batch_n_msgs = 0;
+  return ret_val;
+}
+
+//copy the message in the serial buffer onto the end of the batch
+int AT_Processor::addSerialMessageToBatch(void) {
+  const int len = lengthSerialMessage();
+  if (len == 0) return 0;  //ignore empty messages
+  const int start_ind = (batch_n_msgs > 0) ? batch_msg_end[batch_n_msgs-1] : 0;
+  if ((batch_n_msgs >= AT_BATCH_MAX_N_MSGS) || (start_ind + len > AT_BATCH_N_BUFFER)) {
+    flag_batch_too_long = true;
+  } else {
+    for (int i=0; i < len; i++) batch_buff[start_ind + i] = getFirstCharInBuffer();
+    batch_msg_end[batch_n_msgs++] = start_ind + len;
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return 0;
+}
+
+//put one message of the batch into the (otherwise empty) serial buffer, just as if it had been received
+void AT_Processor::loadBatchMessageIntoSerialBuff(const int Imsg) {
+  const int start_ind = (Imsg > 0) ? batch_msg_end[Imsg-1] : 0;
+  serial_read_ind = 0; serial_write_ind = 0;
+  addBytesToSerialBuffer((const uint8_t *)&batch_buff[start_ind], batch_msg_end[Imsg] - start_ind);
+}
+
+//Check that the message in the serial buffer is a configuration message that we understand, including its value.
+//Its handler reads the value but does not act on it (see flag_check_only).  Returns zero if it is OK.  Otherwise,
+//returns the error code.
+int AT_Processor::checkBatchMessageInSerialBuff(void) {
+  const Keyword_t *verb = findKeywordInSerialBuff(verb_table);
+  if (verb == nullptr) return VERB_NOT_KNOWN;
+  if ((verb->handler != &AT_Processor::processSetMessageInSerialBuff) && (verb->handler != &AT_Processor::processSvcSetupMessageInSerialBuff) &&
+      (verb->handler != &AT_Processor::processBeginMessageInSerialBuff)) {
+    return VERB_NOT_KNOWN;  //only configuration messages are allowed in a batch
+  }
+  flag_check_only = true;
+  const int ret_val = applyBatchMessageInSerialBuff(verb);
+  flag_check_only = false;
+  return ret_val;
+}
+
+//Act on the message in the serial buffer (with its reply muted).  The verb has already been read from the buffer.
+//Returns zero if it worked.  Otherwise, returns the error code.
+int AT_Processor::applyBatchMessageInSerialBuff(const Keyword_t *verb) {
+  int ret_val = 0;
+  flag_muted_reply_failed = false;
+  if (verb->handler == &AT_Processor::processSetMessageInSerialBuff) {
+    const Keyword_t *param = findKeywordInSerialBuff(set_table);  //call the parameter's handler directly to get its error code
+    ret_val = (param != nullptr) ? (this->*(param->handler))() : PARAMETER_NOT_KNOWN;
+  } else {
+    ret_val = (this->*(verb->handler))();
+  }
+  if ((ret_val == 0) && flag_muted_reply_failed) ret_val = OPERATION_FAILED;  //the handler sent a FAIL but returned no error code
+  return ret_val;
+}
+
+//check every message in the batch and, if they're all OK, apply them.  Then send one reply for the whole batch.
+int AT_Processor::endBatch(void) {
+  if (flag_batch_too_long) { sendSerialFailMessage("BATCH too long"); return DATA_WRONG_SIZE; }
+
+  char reply[128];
+  const int max_reply_len = sizeof(reply) - 8;  //leave room for one more "i:e" entry
+  int len_reply = 0, n_errors = 0;
+
+  //check every message before applying any of them.  Their replies are muted here, too.
+  flag_mute_replies = true;
+  for (int Imsg=0; Imsg < batch_n_msgs; Imsg++) {
+    loadBatchMessageIntoSerialBuff(Imsg);
+    int err_code = checkBatchMessageInSerialBuff();
+    if (err_code != 0) {
+      n_errors++;
+      if (len_reply == 0) len_reply = snprintf(reply, sizeof(reply), "BATCH not applied:");
+      if (len_reply < max_reply_len) len_reply += snprintf(reply + len_reply, sizeof(reply) - len_reply, " %d:%d", Imsg+1, err_code);
+    }
+  }
+  flag_mute_replies = false;
+  serial_read_ind = serial_write_ind = 0;
+  if (n_errors > 0) { sendSerialFailMessage(reply); return FORMAT_PROBLEM; }
+
+  //apply every message, in order
+  flag_mute_replies = true;
+  for (int Imsg=0; Imsg < batch_n_msgs; Imsg++) {
+    loadBatchMessageIntoSerialBuff(Imsg);
+    const Keyword_t *verb = findKeywordInSerialBuff(verb_table);  //known, because it was checked
+    int err_code = (verb != nullptr) ? applyBatchMessageInSerialBuff(verb) : VERB_NOT_KNOWN;
+    if (err_code != 0) {
+      n_errors++;
+      if (len_reply == 0) len_reply = snprintf(reply, sizeof(reply), "BATCH applied with errors:");
+      if (len_reply < max_reply_len) len_reply += snprintf(reply + len_reply, sizeof(reply) - len_reply, " %d:%d", Imsg+1, err_code);
+    }
+  }
+  flag_mute_replies = false;
+  serial_read_ind = serial_write_ind = 0;
+  if (n_errors > 0) { sendSerialFailMessage(reply); return OPERATION_FAILED; }
+
+  snprintf(reply, sizeof(reply), "%d", batch_n_msgs);
+  sendSerialOkMessage(reply);
+  return 0;
+}
+
+int AT_Processor::processThroughputMessageInSerialBuff(void) {
+  int ret_val = PARAMETER_NOT_KNOWN;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: THROUGHPUT "); debugPrintMsgFromSerialBuff(); Serial.println(); }
+
+  //find the parameter and call its handler
+  const Keyword_t *param = findKeywordInSerialBuff(throughput_table);
+  if (param != nullptr) ret_val = (this->*(param->handler))();
+  if (ret_val == PARAMETER_NOT_KNOWN) sendSerialFailMessage("THROUGHPUT parameter not known");
+  bridge_stats.countFailure(ret_val);  //count it here because we don't return it
+
+  serial_read_ind = serial_write_ind;  //remove the message
+  return 0;  //the THROUGHPUT verb itself was understood, even if the parameter was not
+}
+
+//"THROUGHPUT TX X Y N SECS".  See BLE_ThroughputTest.h.
+int AT_Processor::processThroughputTx(void) {
+  int service_id = -1, char_id = -1, nbytes, secs;
+  if (!isEndOfMessageInSerialBuff()) service_id = interpret0toF(getFirstCharInBuffer());
+  if (skipSpaceIfNextInBuffer() && !isEndOfMessageInSerialBuff()) char_id = interpret0toF(getFirstCharInBuffer());
+  if ((service_id < 0) || (char_id < 0) || !skipSpaceIfNextInBuffer() || (getDecimalFromBuffer(&nbytes) != 0) ||
+      !skipSpaceIfNextInBuffer() || (getDecimalFromBuffer(&secs) != 0)) {
+    sendSerialFailMessage("THROUGHPUT TX format problem");
+    return FORMAT_PROBLEM;
+  }
+  int err_code = ble_throughput_test.startTx(service_id, char_id, nbytes, secs);
+  if (err_code == -2) { sendSerialFailMessage("THROUGHPUT TX needs a BLE connection"); return NO_BLE_CONNECTION; }
+  if (err_code != 0) { sendSerialFailMessage("THROUGHPUT TX service not known"); return OPERATION_FAILED; }
+  sendSerialOkMessage();
+  return 0;
+}
+
+//"THROUGHPUT RX SECS".  See BLE_ThroughputTest.h.
+int AT_Processor::processThroughputRx(void) {
+  int secs;
+  if (getDecimalFromBuffer(&secs) != 0) { sendSerialFailMessage("THROUGHPUT RX format problem"); return FORMAT_PROBLEM; }
+  if (ble_throughput_test.startRx(secs) != 0) { sendSerialFailMessage("THROUGHPUT RX needs a BLE connection"); return NO_BLE_CONNECTION; }
+  sendSerialOkMessage();
+  return 0;
+}
+
+int AT_Processor::processThroughputStop(void) {
+  ble_throughput_test.stop();
+  sendSerialOkMessage();
+  return 0;
+}
+
+//"SAVE" or "SAVE ERASE".  See BLE_Profile.h.
+int AT_Processor::processSaveMessageInSerialBuff(void) {
+  int ret_val = 0;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SAVE "); debugPrintMsgFromSerialBuff(); Serial.println(); }
+  if (skipSpaceIfNextInBuffer() && (lengthSerialMessage() >= 5) && compareStringInSerialBuff("ERASE", 5)) {
+    if (eraseBleProfile() == 0) {
+      sendSerialOkMessage();
+    } else {
+      ret_val = OPERATION_FAILED;
+      sendSerialFailMessage("SAVE ERASE failed");
+    }
+  } else if (!isEndOfMessageInSerialBuff()) {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("SAVE format problem");
+  } else {
+    uint32_t hash = 0;
+    if (saveBleProfile(&hash) == 0) {
+      char reply[12];
+      snprintf(reply, sizeof(reply), "%08lX", (unsigned long)hash);
+      sendSerialOkMessage(reply);
+    } else {
+      ret_val = OPERATION_FAILED;
+      sendSerialFailMessage("SAVE failed");
+    }
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//"ADVBURST".  Advertise at the fastest interval for the advertising profile's burst time.  See BLE_AdvProfiles.h.
+int AT_Processor::processAdvBurstMessageInSerialBuff(void) {
+  int ret_val = 0;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: ADVBURST "); debugPrintMsgFromSerialBuff(); Serial.println(); }
+  int err_code = startAdvBurst();
+  if (err_code == 0) {
+    sendSerialOkMessage();
+  } else if (err_code == -1) {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("ADVBURST: ble has not begun");
+  } else if (err_code == -2) {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("ADVBURST: the advertising profile has no burst");
+  } else {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("ADVBURST: no room for another connection");
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//"LOAD".  Applies the saved profile (and begins, if it was saved after BEGIN).  See BLE_Profile.h.
+int AT_Processor::processLoadMessageInSerialBuff(void) {
+  int ret_val = 0;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: LOAD "); debugPrintMsgFromSerialBuff(); Serial.println(); }
+  bool flag_begin = false;
+  int err_code = loadBleProfile(&flag_begin);
+  if (err_code == 0) {
+    if (flag_begin) beginAllBleServices(1);
+    sendSerialOkMessage();
+  } else if (err_code == -1) {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("LOAD: no profile has been saved");
+  } else if (err_code == -3) {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("LOAD: Cannot load after ble has been begun");
+  } else {
+    ret_val = DATA_WRONG_FORMAT;
+    sendSerialFailMessage("LOAD: saved profile is not valid");
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processSendMessageInSerialBuff(void) {
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SEND "); debugPrintMsgFromSerialBuff(); Serial.println();}
+  bleSendFromSerialBuff(); //must not have any carriage return characters in the payload (other than the trailing carriage return that concludes every message)
+  return 0;
+}
+
+int AT_Processor::processVersionMessageInSerialBuff(void) {
+  sendSerialOkMessage(versionString);
+  return 0;
+}
+
 //returns true if the next character was a space
 bool AT_Processor::skipSpaceIfNextInBuffer(void) {
   if (serial_read_ind != serial_write_ind) {
     if (serial_buff[serial_read_ind] == ' ') {
-      serial_read_ind = (serial_read_ind+1) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer and wrap as needed
+      serial_read_ind = (serial_read_ind+1) & AT_PROCESSOR_BUFFER_MASK; //increment the reader index for the serial buffer and wrap as needed
       return true;
     }
   }
   return false;
 }
 
+//returns true if there is nothing left in the message (other than, perhaps, the EOC character)
+bool AT_Processor::isEndOfMessageInSerialBuff(void) {
+  return ((serial_read_ind == serial_write_ind) || (serial_buff[serial_read_ind] == EOC));
+}
+
 int AT_Processor::processSvcSetupMessageInSerialBuff(void) {
-  int test_n_char;
-  char current_char = 'a';
   int ret_val = FORMAT_PROBLEM;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SVCSETUP "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
 
   //skip any leading space
   skipSpaceIfNextInBuffer();
@@ -444,290 +1248,450 @@ int AT_Processor::processSvcSetupMessageInSerialBuff(void) {
   if (skipSpaceIfNextInBuffer() == false) { sendSerialFailMessage("SVCSETUP format problem");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return
   if (serial_read_ind == serial_write_ind) { sendSerialFailMessage("SVCSETUP format problem");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return
   
-  //look for parameter kewords: SERVICEUUID, SERVICENAME, ADDCHAR, CHARPROPS, CHARNAME, CHARNBYTES
-  char uuid_chars[2*16]; const int len_uuid_chars = 2*16; //we might need this
-
-  //look for parameter value of SERVICEUUID
-  test_n_char = 11+1; //length of "SERVICEUUID="
-  if (compareStringInSerialBuff("SERVICEUUID=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    int err_code = getUUIDCharsFromBuffer(len_uuid_chars, uuid_chars);
-    if (err_code != 0) {
-      String foo = "SVCSETUP failed to interpret Service UUID, err = ";
-      foo += String(err_code);
-      sendSerialFailMessage(foo.c_str());
-      serial_read_ind = serial_write_ind;  
-      return FORMAT_PROBLEM;
+  //look for parameter kewords: SERVICEUUID, SERVICENAME, ADDCHAR, CHARPROPS, CHARNAME, CHARNBYTES, CHARLATEST
+  const Keyword_t *param = findKeywordInSerialBuff(svcsetup_table);
+  if (param != nullptr) return (this->*(param->handler))();
+
+  //send a FAIL message if none has been sent yet
+  ret_val = FORMAT_PROBLEM;
+  sendSerialFailMessage("SVCSETUP format problem");
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processSvcSetupServiceUuid(void) {
+  char uuid_chars[2*16]; const int len_uuid_chars = 2*16;
+  int err_code = getUUIDCharsFromBuffer(len_uuid_chars, uuid_chars);
+  if (err_code != 0) {
+    sendSerialFailMessage("SVCSETUP failed to interpret Service UUID", err_code);
+    serial_read_ind = serial_write_ind;  
+    return FORMAT_PROBLEM;
+  }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = setServiceUUID(ble_service_id, uuid_chars, len_uuid_chars);
+  if (err_code != 0) { 
+    sendSerialFailMessage("SVCSETUP failed to set Service UUID", err_code);  
+    serial_read_ind = serial_write_ind;   return OPERATION_FAILED; 
     }  //remove the message and return}
-    err_code = setServiceUUID(ble_service_id, uuid_chars, len_uuid_chars);
-    if (err_code != 0) { 
-      sendSerialFailMessage(("SVCSETUP failed to set Service UUID, err = " + String(err_code)).c_str());  
-      serial_read_ind = serial_write_ind;   return OPERATION_FAILED; 
-      }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+  sendSerialOkMessage(); return 0;
+}
 
-  //look for parameter value of SERVICENAME
-  test_n_char = 11+1; //length of "SERVICENAME="
-  if (compareStringInSerialBuff("SERVICENAME=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    String given_name;
-    int err_code = getStringFromBuffer(given_name);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Service Name");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    err_code = setServiceName(ble_service_id, given_name);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Service Name");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+int AT_Processor::processSvcSetupServiceName(void) {
+  String given_name;
+  int err_code = getStringFromBuffer(given_name);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Service Name");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = setServiceName(ble_service_id, given_name);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Service Name");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  sendSerialOkMessage(); return 0;
+}
 
-  //look for parameter value of ADDCHAR
-  test_n_char = 7+1; //length of "ADDCHAR="
-  if (compareStringInSerialBuff("ADDCHAR=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    int err_code = getUUIDCharsFromBuffer(len_uuid_chars, uuid_chars);
-    if (err_code != 0) { sendSerialFailMessage(("SVCSETUP failed to interpret Characteristic UUID, err = " + String(err_code)).c_str());  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    err_code = addCharacteristic(ble_service_id, uuid_chars, len_uuid_chars);
-    if (err_code != 0) { sendSerialFailMessage(("SVCSETUP failed to add Characteristic via UUID, err = " + String(err_code)).c_str());  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+int AT_Processor::processSvcSetupAddChar(void) {
+  char uuid_chars[2*16]; const int len_uuid_chars = 2*16;
+  int err_code = getUUIDCharsFromBuffer(len_uuid_chars, uuid_chars);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Characteristic UUID", err_code);  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = addCharacteristic(ble_service_id, uuid_chars, len_uuid_chars);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to add Characteristic via UUID", err_code);  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  sendSerialOkMessage(); return 0;
+}
 
-  //look for parameter value of CHARNAME
-  test_n_char = 8+1; //length of "CHARNAME="
-  if (compareStringInSerialBuff("CHARNAME=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    String given_name;
-    int err_code = getStringFromBuffer(given_name);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Characterisic Name");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    err_code = setCharacteristicName(ble_service_id, ble_char_id, given_name);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Characterisic Name");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+int AT_Processor::processSvcSetupCharName(void) {
+  String given_name;
+  int err_code = getStringFromBuffer(given_name);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Characterisic Name");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = setCharacteristicName(ble_service_id, ble_char_id, given_name);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Characterisic Name");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  sendSerialOkMessage(); return 0;
+}
 
-  //look for parameter value of CHARPROPS
-  test_n_char = 9+1; //length of "CHARPROPS="
-  if (compareStringInSerialBuff("CHARPROPS=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    uint8_t char_props; const int n_chars_comprising_char_props = 8;
-    int err_code = getCharPropsFromBuffer(n_chars_comprising_char_props, &char_props);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Char Props");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    err_code = setCharacteristicProps(ble_service_id, ble_char_id, char_props);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Char Props");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+int AT_Processor::processSvcSetupCharProps(void) {
+  uint8_t char_props; const int n_chars_comprising_char_props = 8;
+  int err_code = getCharPropsFromBuffer(n_chars_comprising_char_props, &char_props);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret Char Props");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = setCharacteristicProps(ble_service_id, ble_char_id, char_props);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set Char Props");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  sendSerialOkMessage(); return 0;
+}
 
-  //look for parameter value of CHARNBYTES
-  test_n_char = 10+1; //length of "CHARNBYTES="
-  if (compareStringInSerialBuff("CHARNBYTES=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the value
-    int nbytes;
-    int err_code = getValueFromBuffer(&nbytes); 
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret char_nbytes");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    if ((nbytes < 1) || (nbytes > 255)) { sendSerialFailMessage("SVCSETUP nbytes must be between 1 and 255");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
-    err_code = setCharacteristicNBytes(ble_service_id, ble_char_id, (uint8_t)nbytes);
-    if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set char_nbytes");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
-    sendSerialOkMessage(); return 0;
-  }
+int AT_Processor::processSvcSetupCharNBytes(void) {
+  int nbytes;
+  int err_code = getValueFromBuffer(&nbytes); 
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to interpret char_nbytes");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if ((nbytes < 1) || (nbytes > BLE_MAX_DATA_NBYTES)) { sendSerialFailMessage("SVCSETUP nbytes must be between 1 and 244");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  err_code = setCharacteristicNBytes(ble_service_id, ble_char_id, nbytes);
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set char_nbytes");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  sendSerialOkMessage(); return 0;
+}
 
-  //send a FAIL message if none has been sent yet
-  ret_val = FORMAT_PROBLEM;
-  sendSerialFailMessage("SVCSETUP format problem");
-  serial_read_ind = serial_write_ind;  //remove the message
-  return ret_val;
+//"CHARLATEST=TRUE" makes a new notification replace an unsent one for this characteristic (see BLE_TxQueue.h)
+int AT_Processor::processSvcSetupCharLatest(void) {
+  char next_char = isEndOfMessageInSerialBuff() ? '\0' : getFirstCharInBuffer();
+  if ((next_char != 'T') && (next_char != 'F')) { sendSerialFailMessage("SVCSETUP CHARLATEST must be TRUE or FALSE");  serial_read_ind = serial_write_ind;  return FORMAT_PROBLEM; }  //remove the message and return}
+  if (isOnlyChecking()) return 0;  //the value is OK, but don't act on it
+  int err_code = setCharacteristicLatestValueWins(ble_service_id, ble_char_id, (next_char == 'T'));
+  if (err_code != 0) { sendSerialFailMessage("SVCSETUP failed to set char_latest");  serial_read_ind = serial_write_ind;  return OPERATION_FAILED; }  //remove the message and return}
+  serial_read_ind = serial_write_ind;  //remove the rest of the message
+  sendSerialOkMessage(); return 0;
 }
 
 int AT_Processor::processSetMessageInSerialBuff(void) {
-  int test_n_char;
   int ret_val = PARAMETER_NOT_KNOWN;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: SET "); debugPrintMsgFromSerialBuff(); Serial.println(); }
 
-   //look for parameter value of "BEGIN=""
-  test_n_char = 5+1; //length of "BEGIN="
-  if (compareStringInSerialBuff("BEGIN=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    
-    ret_val = setBeginFromSerialBuff();
-    if (ret_val == 0) {
-      sendSerialOkMessage();
-    } else {
-      sendSerialFailMessage("SET BEGIN failed");
+  //find the parameter and call its handler
+  const Keyword_t *param = findKeywordInSerialBuff(set_table);
+  if (param != nullptr) ret_val = (this->*(param->handler))();
+
+  // give error message if message isn't known
+  if (ret_val != 0) {
+    if (DEBUG_VIA_USB) {
+      Serial.print("AT_Processor: *** WARNING ***: SET msg not understood: ");
+      debugPrintMsgFromSerialBuff();
     }
-    serial_read_ind = serial_write_ind;  //remove the message
-  }
-  
-  //look for parameter value of BAUDRATE
-  test_n_char = 8+1; //length of "BAUDRATE="
-  if (compareStringInSerialBuff("BAUDRATE=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //replace this placeholder with useful code
-    ret_val = NOT_IMPLEMENTED_YET;
-    sendSerialFailMessage("SET BAUDRATE not implemented yet");
-    serial_read_ind = serial_write_ind;  //remove the message
   }
 
-  //look for parameter value of MAC
-  test_n_char = 3+1; //length of "MAC="
-  if (compareStringInSerialBuff("MAC=",test_n_char)) {
-    //Serial.println("AT_Processor: processSetMessageInSerialBuff: interpreting MAC");
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    if (bleBegun == true) {
-      if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: Cannot set MAC after begun");
-      sendSerialFailMessage("SET MAC: Cannot set MAC after ble has been begun");
-    } else {
-      if (DEBUG_VIA_USB) {
-        Serial.print("AT_Processor: processSetMessageInSerialBuff: setting MAC to ");
-        debugPrintMsgFromSerialBuff();
-        Serial.println();
-      }
-      
-      ret_val = setMacAddressFromSerialBuff();
-      if (ret_val == 0) {
-        sendSerialOkMessage();
-        //if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: SUCCESS!");
-      } else if (ret_val == DATA_WRONG_SIZE) {
-        sendSerialFailMessage("SET MAC: Given MAC address is wrong size");
-        if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: Given MAC address is wrong size");
-      } else if (ret_val == DATA_WRONG_FORMAT) {
-        sendSerialFailMessage("SET MAC: Given MAC address was wrong format");
-        if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: Given MAC address is wrong format");
-      } else {
-        sendSerialFailMessage("SET MAC: (Failure reason unknown)");
-        if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: (unknown reason)");
-      }
-      delay(5);
-      for (int i=0; i<24; i++) if (serial_ptr) serial_ptr->print(EOC);    //clear out the UART buffers
-    }
-    serial_read_ind = serial_write_ind;  //remove the message
+  //send a FAIL message if none has been sent yet
+  if (ret_val == PARAMETER_NOT_KNOWN) sendSerialFailMessage("SET parameter not known");
+  bridge_stats.countFailure(ret_val);  //count it here because we don't return it
+
+  serial_read_ind = serial_write_ind;  //remove the message
+  return 0;  //the SET verb itself was understood, even if the parameter was not
+}
+
+int AT_Processor::processSetBegin(void) {
+  int ret_val = setBeginFromSerialBuff();
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else {
+    sendSerialFailMessage("SET BEGIN failed");
   }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processSetBaudrate(void) {
+  //replace this placeholder with useful code
+  sendSerialFailMessage("SET BAUDRATE not implemented yet");
+  serial_read_ind = serial_write_ind;  //remove the message
+  return NOT_IMPLEMENTED_YET;
+}
 
-  //look for parameter value of NAME
-  test_n_char = 4+1; //length of "NAME="
-  if (compareStringInSerialBuff("NAME=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
+int AT_Processor::processSetMac(void) {
+  int ret_val = PARAMETER_NOT_KNOWN;
+  //Serial.println("AT_Processor: processSetMessageInSerialBuff: interpreting MAC");
+  if (bleBegun == true) {
+    if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: Cannot set MAC after begun");
+    sendSerialFailMessage("SET MAC: Cannot set MAC after ble has been begun");
+  } else {
     if (DEBUG_VIA_USB) {
-      Serial.print("AT_Processor: processSetMessageInSerialBuff: setting NAME to ");
+      Serial.print("AT_Processor: processSetMessageInSerialBuff: setting MAC to ");
       debugPrintMsgFromSerialBuff();
       Serial.println();
     }
     
-    ret_val = setBleNameFromSerialBuff();
-    sendSerialOkMessage();
+    ret_val = setMacAddressFromSerialBuff();
+    if (ret_val == 0) {
+      sendSerialOkMessage();
+      //if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: SUCCESS!");
+    } else if (ret_val == DATA_WRONG_SIZE) {
+      sendSerialFailMessage("SET MAC: Given MAC address is wrong size");
+      if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: Given MAC address is wrong size");
+    } else if (ret_val == DATA_WRONG_FORMAT) {
+      sendSerialFailMessage("SET MAC: Given MAC address was wrong format");
+      if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: Given MAC address is wrong format");
+    } else {
+      sendSerialFailMessage("SET MAC: (Failure reason unknown)");
+      if (DEBUG_VIA_USB) Serial.println("AT_Processor: processSetMessageInSerialBuff: SET MAC: FAILED: (unknown reason)");
+    }
+    if (!isMessageTagged() && !flag_mute_replies) {
+      delay(5);
+      for (int i=0; i<24; i++) if (serial_ptr) serial_ptr->print(EOC);    //clear out the UART buffers
+    }
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processSetName(void) {
+  if (DEBUG_VIA_USB) {
+    Serial.print("AT_Processor: processSetMessageInSerialBuff: setting NAME to ");
+    debugPrintMsgFromSerialBuff();
+    Serial.println();
+  }
+  
+  int ret_val = setBleNameFromSerialBuff();
+  sendSerialOkMessage();
+  if (!isMessageTagged() && !flag_mute_replies) {
     delay(5);
     //clear out the UART buffers
     for (int i=0; i<24; i++) {
       if (serial_ptr) serial_ptr->print(EOC);
     }
-
-    serial_read_ind = serial_write_ind;  //remove the message
   }
 
-  //look for parameter value of RFSTATE
-  test_n_char = 7+1; //length of "RFSTATE="
-  if (compareStringInSerialBuff("RFSTATE=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-
-    //replace this placeholder with useful code
-    ret_val = NOT_IMPLEMENTED_YET;
-    sendSerialFailMessage("SET RFSTATE not implemented yet");
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-    serial_read_ind = serial_write_ind;  //remove the message
-  }
+int AT_Processor::processSetRfState(void) {
+  //replace this placeholder with useful code
+  sendSerialFailMessage("SET RFSTATE not implemented yet");
+  serial_read_ind = serial_write_ind;  //remove the message
+  return NOT_IMPLEMENTED_YET;
+}
 
-  //look for parameter value of ADVERTISING
-  test_n_char = 11+1; //length of "ADVERTISING="
-  if (compareStringInSerialBuff("ADVERTISING=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    ret_val = setAdvertisingFromSerialBuff();
-    if (ret_val == 0) {
-      sendSerialOkMessage();
-    } else {
-      sendSerialFailMessage("SET ADVERTISING failed");
-    }
-    serial_read_ind = serial_write_ind;  //remove the message
+int AT_Processor::processSetAdvertising(void) {
+  int ret_val = setAdvertisingFromSerialBuff();
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else {
+    sendSerialFailMessage("SET ADVERTISING failed");
   }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  //look for parameter value of ADV_SERVICE_ID 
-  test_n_char = 17+1; //length of "ADVERT_SERVICE_ID="
-  if (compareStringInSerialBuff("ADVERT_SERVICE_ID=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    ret_val = setAdvServiceIdFromSerialBuff();
-    //Serial.println("AT_Processor: setAdvServiceIdFromSerialBuff returned " + String(ret_val));
-    if (ret_val == 0) {
-      sendSerialOkMessage();
-    } else {
-      ret_val = OPERATION_FAILED;
-      sendSerialFailMessage("SET ADVERT_SERVICE_ID failed");
-    }
-    serial_read_ind = serial_write_ind;  //remove the message
+int AT_Processor::processSetAdvServiceId(void) {
+  int ret_val = setAdvServiceIdFromSerialBuff();
+  //Serial.println("AT_Processor: setAdvServiceIdFromSerialBuff returned " + String(ret_val));
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("SET ADVERT_SERVICE_ID failed");
   }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  //look to preset service given the ENABLE_SERVICE_ID
-  test_n_char = 17; //length of "ENABLE_SERVICE_ID"
-  if (compareStringInSerialBuff("ENABLE_SERVICE_ID",test_n_char)) { //full keyword would be "ENABLE_SERVICE_IDx=" where x is any number
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    //get the service number
-    char next_char = getFirstCharInBuffer();
-    if (next_char >= '0') {
-      //int service_id = (int)(next_char-'0');
-      int service_id = interpret0toF(next_char);
+//full keyword is "ENABLE_SERVICE_IDx=" where x is any number
+int AT_Processor::processSetEnableServiceId(void) {
+  int ret_val = OPERATION_FAILED;
+  //get the service number
+  char next_char = getFirstCharInBuffer();
+  if (next_char >= '0') {
+    //int service_id = (int)(next_char-'0');
+    int service_id = interpret0toF(next_char);
+    //look for the equal sign
+    next_char = getFirstCharInBuffer();
+    if (next_char == '=') {
       //look for the equal sign
       next_char = getFirstCharInBuffer();
-      if (next_char == '=') {
-        //look for the equal sign
-        next_char = getFirstCharInBuffer();
-        if (next_char == 'T') { //for TRUE
-          bool is_enabled =  enablePresetServiceById(service_id, true);
-          if (is_enabled == true) ret_val = 0;
-        } else if (next_char == 'F') { //for FALSE
-          bool is_enabled =  enablePresetServiceById(service_id, false);
-          if (is_enabled == false) ret_val = 0;
-        }
+      if (((next_char == 'T') || (next_char == 'F')) && isOnlyChecking()) {
+        if (isPresetServiceIdValid(service_id)) ret_val = 0;
+      } else if (next_char == 'T') { //for TRUE
+        bool is_enabled =  enablePresetServiceById(service_id, true);
+        if (is_enabled == true) ret_val = 0;
+      } else if (next_char == 'F') { //for FALSE
+        bool is_enabled =  enablePresetServiceById(service_id, false);
+        if (is_enabled == false) ret_val = 0;
       }
     }
-    if (ret_val == 0) {
-      sendSerialOkMessage();
-    } else {
-      ret_val=OPERATION_FAILED;
-      sendSerialFailMessage("SET ENABLE_SERVICE_ID failed");
-    }
-    serial_read_ind = serial_write_ind;  //remove the message
-  } 
+  }
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else {
+    ret_val=OPERATION_FAILED;
+    sendSerialFailMessage("SET ENABLE_SERVICE_ID failed");
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  //look for parameter value of LEDMODE
-  test_n_char = 7+1; //length of "LEDMODE="
-  if (compareStringInSerialBuff("LEDMODE=",test_n_char)) {
-    serial_read_ind = (serial_read_ind + test_n_char) % AT_PROCESSOR_N_BUFFER; //increment the reader index for the serial buffer
-    ret_val = setLedModeFromSerialBuff();
-    if (ret_val == 0) {
-      sendSerialOkMessage();
-    } else {
-      sendSerialFailMessage("SET LEDMODE failed");
-    }
-    serial_read_ind = serial_write_ind;  //remove the message
+//"SET STATS=RESET" zeros all of the counters reported by GET STATS
+int AT_Processor::processSetStats(void) {
+  int ret_val = FORMAT_PROBLEM;
+  if ((lengthSerialMessage() >= 5) && compareStringInSerialBuff("RESET", 5)) {
+    if (!isOnlyChecking()) { bridge_stats.reset(); resetSerialStats(); }
+    sendSerialOkMessage();
+    ret_val = 0;
+  } else {
+    sendSerialFailMessage("SET STATS only accepts RESET");
   }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  // serach for another command
-  //   anything?
+//"SET FLOWCONTROL=ON" or "=OFF".  Turning it on (again) zeros the Tympan's credits.  Then, the first CREDIT message
+//gives it all of the free buffers.  See BLE_FlowControl.h.
+int AT_Processor::processSetFlowControl(void) {
+  int ret_val = FORMAT_PROBLEM;
+  if ((lengthSerialMessage() >= 3) && compareStringInSerialBuff("OFF", 3)) {
+    if (!isOnlyChecking()) flow_control.enable(false);
+    sendSerialOkMessage();
+    ret_val = 0;
+  } else if ((lengthSerialMessage() >= 2) && compareStringInSerialBuff("ON", 2)) {
+    if (!isOnlyChecking()) flow_control.enable(true);
+    sendSerialOkMessage();
+    ret_val = 0;
+  } else {
+    sendSerialFailMessage("SET FLOWCONTROL only accepts ON or OFF");
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  // give error message if message isn't known
-  if (ret_val != 0) {
-    if (DEBUG_VIA_USB) {
-      Serial.print("AT_Processor: *** WARNING ***: SET msg not understood: ");
-      debugPrintMsgFromSerialBuff();
+//"SET BLEDATAFORMAT=TEXT" or "=BINARY".  Sets how the data from the phone is framed for the Tympan.  See BLE_DataFrame.h.
+int AT_Processor::processSetBleDataFormat(void) {
+  int ret_val = FORMAT_PROBLEM;
+  if ((lengthSerialMessage() >= 4) && compareStringInSerialBuff("TEXT", 4)) {
+    if (!isOnlyChecking()) ble_data_frame.setFormat(BLE_DataFrame::FORMAT_TEXT);
+    sendSerialOkMessage();
+    ret_val = 0;
+  } else if ((lengthSerialMessage() >= 6) && compareStringInSerialBuff("BINARY", 6)) {
+    if (!isOnlyChecking()) ble_data_frame.setFormat(BLE_DataFrame::FORMAT_BINARY);
+    sendSerialOkMessage();
+    ret_val = 0;
+  } else {
+    sendSerialFailMessage("SET BLEDATAFORMAT only accepts TEXT or BINARY");
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//"SET PHY=1M", "=2M", "=CODED", or "=AUTO".  See BLE_LinkParams.h.
+int AT_Processor::processSetPhy(void) {
+  int ret_val = FORMAT_PROBLEM;
+  int phy = -1;
+  if ((lengthSerialMessage() >= 2) && compareStringInSerialBuff("1M", 2)) { phy = BLE_GAP_PHY_1MBPS; }
+  else if ((lengthSerialMessage() >= 2) && compareStringInSerialBuff("2M", 2)) { phy = BLE_GAP_PHY_2MBPS; }
+  else if ((lengthSerialMessage() >= 5) && compareStringInSerialBuff("CODED", 5)) { phy = BLE_GAP_PHY_CODED; }
+  else if ((lengthSerialMessage() >= 4) && compareStringInSerialBuff("AUTO", 4)) { phy = BLE_GAP_PHY_AUTO; }
+
+  if (phy < 0) {
+    sendSerialFailMessage("SET PHY only accepts 1M, 2M, CODED, or AUTO");
+  } else if (isOnlyChecking()) {
+    ret_val = 0;
+  } else if (ble_link_params.setPhy(phy) != 0) {
+    ret_val = OPERATION_FAILED;
+    sendSerialFailMessage("SET PHY request failed");
+  } else {
+    ret_val = 0;
+    sendSerialOkMessage();
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processSetMtu(void)          { return setLinkParamFromSerialBuff("MTU", &BLE_LinkParams::setMtu, &BLE_LinkParams::isValidMtu); }
+int AT_Processor::processSetConnInterval(void) { return setLinkParamFromSerialBuff("CONNINTERVAL", &BLE_LinkParams::setConnInterval, &BLE_LinkParams::isValidConnInterval); }
+int AT_Processor::processSetLatency(void)      { return setLinkParamFromSerialBuff("LATENCY", &BLE_LinkParams::setLatency, &BLE_LinkParams::isValidLatency); }
+int AT_Processor::processSetSupTimeout(void)   { return setLinkParamFromSerialBuff("SUPTIMEOUT", &BLE_LinkParams::setSupTimeout, &BLE_LinkParams::isValidSupTimeout); }
+
+//"SET CONNTARGET=ALL" or "=n", where n is a connection slot.  See BLE_Connections.h.
+int AT_Processor::processSetConnTarget(void) {
+  int ret_val = 0, slot;
+  if ((lengthSerialMessage() >= 3) && compareStringInSerialBuff("ALL", 3)) {
+    if (!isOnlyChecking()) ble_connections.setTarget(BLE_CONN_TARGET_ALL);
+  } else if (getValueFromBuffer(&slot) != 0) {
+    ret_val = FORMAT_PROBLEM;
+  } else if (isOnlyChecking()) {
+    if ((slot < BLE_CONN_TARGET_ALL) || (slot >= BLE_MAX_CONNECTIONS)) ret_val = DATA_WRONG_SIZE;
+  } else if (ble_connections.setTarget(slot) != 0) {
+    ret_val = DATA_WRONG_SIZE;
+  }
+  if (ret_val == 0) { sendSerialOkMessage(); } else { sendSerialFailMessage("SET CONNTARGET only accepts ALL or a connection slot"); }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//"SET ADVSTATUS=battery mode level" or "SET ADVSTATUS=OFF".  See BLE_AdvPayload.h.
+int AT_Processor::processSetAdvStatus(void) {
+  int ret_val = 0, battery, mode, level;
+  if ((lengthSerialMessage() >= 3) && compareStringInSerialBuff("OFF", 3)) {
+    if (!isOnlyChecking()) ble_adv_payload.clearStatus();
+  } else if ((getDecimalFromBuffer(&battery) != 0) || !skipSpaceIfNextInBuffer() || (getDecimalFromBuffer(&mode) != 0) ||
+             !skipSpaceIfNextInBuffer() || (getDecimalFromBuffer(&level) != 0)) {
+    ret_val = FORMAT_PROBLEM;
+  } else if ((battery > 255) || (mode > 255) || (level > 255)) {
+    ret_val = DATA_WRONG_SIZE;
+  } else if (!isOnlyChecking()) {
+    ble_adv_payload.setStatus(battery, mode, level);
+  }
+  if ((ret_val == 0) && bleBegun && !flag_check_only && (updateAdvertisingData() != 0)) ret_val = OPERATION_FAILED;
+  if (ret_val == 0) { sendSerialOkMessage(); } else { sendSerialFailMessage("SET ADVSTATUS only accepts OFF or three values (0-255)"); }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//"SET ADVPROFILE=BALANCED" (or another preset) or "SET ADVPROFILE=CUSTOM fast slow timeout power burst directed".
+//See BLE_AdvProfiles.h.
+int AT_Processor::processSetAdvProfile(void) {
+  int ret_val = FORMAT_PROBLEM;
+  for (int id=0; id < BLE_AdvProfiles::getNPresets(); id++) {
+    const char *name = BLE_AdvProfiles::getPresetName(id);
+    const int len = strlen(name);
+    if ((lengthSerialMessage() >= len) && compareStringInSerialBuff(name, len)) {
+      for (int i=0; i<len; i++) getFirstCharInBuffer();  //skip past it
+      if (isEndOfMessageInSerialBuff()) ret_val = isOnlyChecking() ? 0 : ((setAdvertisingProfileById(id) == 0) ? 0 : OPERATION_FAILED);
+      break;
     }
   }
+  if ((ret_val == FORMAT_PROBLEM) && (lengthSerialMessage() >= 7) && compareStringInSerialBuff("CUSTOM ", 7)) {
+    for (int i=0; i<7; i++) getFirstCharInBuffer();  //skip past it
+    int vals[6];
+    bool is_negative = false;
+    ret_val = 0;
+    for (int i=0; (i < 6) && (ret_val == 0); i++) {
+      if ((i > 0) && !skipSpaceIfNextInBuffer()) ret_val = FORMAT_PROBLEM;
+      if ((i == 3) && (lengthSerialMessage() > 0) && (serial_buff[serial_read_ind] == '-')) { getFirstCharInBuffer(); is_negative = true; }  //only the TX power can be negative
+      if ((ret_val == 0) && (getDecimalFromBuffer(&vals[i]) != 0)) ret_val = FORMAT_PROBLEM;
+    }
+    if ((ret_val == 0) && !isEndOfMessageInSerialBuff()) ret_val = FORMAT_PROBLEM;
+    if (ret_val == 0) {
+      BLE_AdvSettings_t settings;
+      settings.fast_interval = (uint16_t)min(vals[0], 0xFFFF);
+      settings.slow_interval = (uint16_t)min(vals[1], 0xFFFF);
+      settings.fast_timeout = (uint16_t)min(vals[2], 0xFFFF);
+      settings.tx_power = (int8_t)(is_negative ? -min(vals[3], 127) : min(vals[3], 127));
+      settings.burst_secs = (uint8_t)min(vals[4], 255);
+      settings.directed_secs = (uint8_t)min(vals[5], 255);
+      if (isOnlyChecking()) { if (!BLE_AdvProfiles::isValid(settings)) ret_val = DATA_WRONG_SIZE; }
+      else if (setAdvertisingProfileCustom(settings) != 0) ret_val = DATA_WRONG_SIZE;
+    }
+  }
+  if (ret_val == 0) { sendSerialOkMessage(); } else { sendSerialFailMessage("SET ADVPROFILE only accepts BALANCED, FAST, LOWPOWER, or CUSTOM with six values"); }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
-  //send a FAIL message if none has been sent yet
-  if (ret_val == PARAMETER_NOT_KNOWN) sendSerialFailMessage("SET parameter not known");
+//for the numeric link parameters: read the value and give it to ble_link_params (see BLE_LinkParams.h)
+int AT_Processor::setLinkParamFromSerialBuff(const char *name, int (BLE_LinkParams::*setter)(const int), bool (*is_valid)(const int)) {
+  char reply[48];
+  int value, ret_val = 0;
+  if (getValueFromBuffer(&value) != 0) {
+    ret_val = FORMAT_PROBLEM;
+    snprintf(reply, sizeof(reply), "SET %s had formatting problem", name);
+  } else if (!is_valid(value)) {
+    ret_val = DATA_WRONG_SIZE;
+    snprintf(reply, sizeof(reply), "SET %s value is out of range", name);
+  } else if (!isOnlyChecking()) {
+    int err_code = (ble_link_params.*setter)(value);
+    if (err_code == -1) { ret_val = DATA_WRONG_SIZE; snprintf(reply, sizeof(reply), "SET %s value is out of range", name); }
+    else if (err_code != 0) { ret_val = OPERATION_FAILED; snprintf(reply, sizeof(reply), "SET %s request failed", name); }
+  }
+  if (ret_val == 0) { sendSerialOkMessage(); } else { sendSerialFailMessage(reply); }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
 
+int AT_Processor::processSetLedMode(void) {
+  int ret_val = setLedModeFromSerialBuff();
+  if (ret_val == 0) {
+    sendSerialOkMessage();
+  } else {
+    sendSerialFailMessage("SET LEDMODE failed");
+  }
   serial_read_ind = serial_write_ind;  //remove the message
   return ret_val;
 }
 
 int AT_Processor::processBeginMessageInSerialBuff(void) {
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: BEGIN "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
   int ret_val = setBeginFromSerialBuff();
   if (ret_val == 0) {
     sendSerialOkMessage();
@@ -739,140 +1703,14 @@ int AT_Processor::processBeginMessageInSerialBuff(void) {
 }
 
 int AT_Processor::processGetMessageInSerialBuff(void) {
-  int test_n_char;
   int ret_val = PARAMETER_NOT_KNOWN;
+  if (DEBUG_VIA_USB) { Serial.print("AT_Processor: recvd: GET "); debugPrintMsgFromSerialBuff(); Serial.println(); } 
   
   //Serial.print("AT_Processor::processGetMessageInSerialBuff: interpreting ");  debugPrintMsgFromSerialBuff(); Serial.println();
-  //Serial.println("AT_Processor::processGetMessageInSerialBuff: compareStringInSerialBuff('NAME',test_n_char) = " + String(compareStringInSerialBuff("NAME",test_n_char)));
-
-  test_n_char = 8; //length of "BAUDRATE"
-  if (compareStringInSerialBuff("BAUDRATE",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = NOT_IMPLEMENTED_YET;
-      sendSerialFailMessage("GET BAUDRATE not implemented yet");
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET BAUDRATE had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  }
 
-  test_n_char = 4; //length of "NAME"
-  if (compareStringInSerialBuff("NAME",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-        //get the current BLE name 
-        static const uint16_t n_len = 64;
-        char name[n_len];
-        uint32_t act_len = Bluefruit.getName(name, n_len);
-        name[act_len]='\0';  //the BLE module does not appear to null terminate, so let's do it ourselves
-        if ((act_len > 0) || (act_len < n_len)) {
-          ret_val = 0;  //it's good!
-          sendSerialOkMessage(name); //send via the BLE link
-        } else {
-          ret_val = 3;
-          sendSerialFailMessage("GET NAME Could not get NAME from nRF module");
-        }
-    } else {
-      ret_val = 2;
-      sendSerialFailMessage("GET NAME had formatting problem");
-      //serial_read_ind = serial_write_ind;  //remove the message ... INCORRECT LOCAITON FOR THIS!  (v0.4.0 and earlier)
-    }
-    serial_read_ind = serial_write_ind;  //remove the message ... CORRECTED LOCATION (v.0.4.1 and later)
-  } 
-
-  test_n_char = 7; //length of "RFSTATE"
-  if (compareStringInSerialBuff("RFSTATE",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = NOT_IMPLEMENTED_YET;
-      sendSerialFailMessage("GET RFSTATE not implemented yet");
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET RFSTATE had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  }  
-
-  test_n_char = 11; //length of "ADVERTISING"
-  if (compareStringInSerialBuff("ADVERTISING",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = 0;
-      sendSerialOkMessage((Bluefruit.Advertising.isRunning()) ? "TRUE" : "FALSE");
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET ADVERTISING had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  } 
-
-  test_n_char = 17; //length of "ADVERT_SERVICE_ID"
-  if (compareStringInSerialBuff("ADVERT_SERVICE_ID",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = 0;
-      char reply[1]={(char)(service_preset_to_ble_advertise + (int)'0')};  //convert to character than to c-string
-      sendSerialOkMessage(reply);
-      if (DEBUG_VIA_USB) Serial.println("GET ADVERT_SERVICE_ID returned " + String(service_preset_to_ble_advertise));
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET ADVERT_SERVICE_ID had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  } 
-
-  test_n_char = 7; //length of "LEDMODE"
-  if (compareStringInSerialBuff("LEDMODE",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = 0;
-      if (led_control.ledToFade==0) {
-        sendSerialOkMessage("0");
-      } else {
-        sendSerialOkMessage("1");
-      }
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET LEDMODE had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  }  
-
-  test_n_char = 9; //length of "CONNECTED"
-  if (compareStringInSerialBuff("CONNECTED",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = 0;
-      sendSerialOkMessage((Bluefruit.connected()) ? "TRUE" : "FALSE");
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET CONNECTED had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  }  
-
-  test_n_char = 7; //length of "VERSION"
-  if (compareStringInSerialBuff("VERSION",test_n_char)) {
-    int foo_ind = serial_read_ind+test_n_char;
-    while (foo_ind >= AT_PROCESSOR_N_BUFFER) foo_ind -= AT_PROCESSOR_N_BUFFER;
-    if ((foo_ind==serial_write_ind) || (serial_buff[foo_ind] == EOC)) {
-      ret_val = 0;
-      sendSerialOkMessage(versionString);
-    } else {
-      ret_val = FORMAT_PROBLEM;
-      sendSerialFailMessage("GET VERSION had formatting problem");
-    }     
-    serial_read_ind = serial_write_ind;  //remove the message
-  }  
+  //find the parameter and call its handler
+  const Keyword_t *param = findKeywordInSerialBuff(get_table);
+  if (param != nullptr) ret_val = (this->*(param->handler))();
 
   // serach for another command
   //   anything?
@@ -890,12 +1728,352 @@ int AT_Processor::processGetMessageInSerialBuff(void) {
   return ret_val;
 }
 
+int AT_Processor::processGetBaudrate(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = NOT_IMPLEMENTED_YET;
+    sendSerialFailMessage("GET BAUDRATE not implemented yet");
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET BAUDRATE had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetName(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+      //get the current BLE name 
+      static const uint16_t n_len = 64;
+      char name[n_len];
+      uint32_t act_len = Bluefruit.getName(name, n_len);
+      name[act_len]='\0';  //the BLE module does not appear to null terminate, so let's do it ourselves
+      if ((act_len > 0) || (act_len < n_len)) {
+        ret_val = 0;  //it's good!
+        sendSerialOkMessage(name); //send via the BLE link
+      } else {
+        ret_val = 3;
+        sendSerialFailMessage("GET NAME Could not get NAME from nRF module");
+      }
+  } else {
+    ret_val = 2;
+    sendSerialFailMessage("GET NAME had formatting problem");
+    //serial_read_ind = serial_write_ind;  //remove the message ... INCORRECT LOCAITON FOR THIS!  (v0.4.0 and earlier)
+  }
+  serial_read_ind = serial_write_ind;  //remove the message ... CORRECTED LOCATION (v.0.4.1 and later)
+  return ret_val;
+}
+
+int AT_Processor::processGetRfState(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = NOT_IMPLEMENTED_YET;
+    sendSerialFailMessage("GET RFSTATE not implemented yet");
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET RFSTATE had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetAdvertising(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    sendSerialOkMessage((Bluefruit.Advertising.isRunning()) ? "TRUE" : "FALSE");
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET ADVERTISING had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetAdvServiceId(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[2]={(char)(service_preset_to_ble_advertise + (int)'0'), '\0'};  //convert to character than to c-string
+    sendSerialOkMessage(reply);
+    if (DEBUG_VIA_USB) { Serial.print("GET ADVERT_SERVICE_ID returned "); Serial.println(service_preset_to_ble_advertise); }
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET ADVERT_SERVICE_ID had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetLedMode(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    if (led_control.ledToFade==0) {
+      sendSerialOkMessage("0");
+    } else {
+      sendSerialOkMessage("1");
+    }
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET LEDMODE had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetConnected(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[16];
+    const int n_connected = ble_connections.getNConnected();
+    snprintf(reply, sizeof(reply), "%s %d", (n_connected > 0) ? "TRUE" : "FALSE", n_connected);  //"TRUE" (or "FALSE") first, as before
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET CONNECTED had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//Reply with all of the counters in bridge_stats (plus our own serial buffer counters).  The format is:
+//  "UART_RX=b,m BLE_TX=b,m,f,c BLE_RX=b,m,d UART_TX=b OVERFLOW=n PEAK=n FAIL=e1,e2,e3,e4,e5,e6,e7,other"
+//where b is bytes, m is messages, f is failed BLE sends, c is notifications that replaced an unsent value in the
+//TX queue, d is BLE writes (or connection events) dropped because the event queue was full, and e1-e7 are the
+//number of failures by error code
+int AT_Processor::processGetStats(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    const BridgeStats &st = bridge_stats;
+    char reply[AT_REPLY_MAX_LEN - 16];  //leave room for any tag
+    int len = snprintf(reply, sizeof(reply), "UART_RX=%lu,%lu BLE_TX=%lu,%lu,%lu,%lu BLE_RX=%lu,%lu,%lu UART_TX=%lu OVERFLOW=%lu PEAK=%d FAIL=",
+      (unsigned long)st.uart_rx_bytes, (unsigned long)st.uart_rx_msgs,
+      (unsigned long)st.ble_tx_bytes, (unsigned long)st.ble_tx_msgs, (unsigned long)st.ble_tx_failed, (unsigned long)st.ble_tx_coalesced,
+      (unsigned long)st.ble_rx_bytes, (unsigned long)st.ble_rx_msgs, (unsigned long)st.ble_rx_dropped, (unsigned long)st.uart_tx_bytes,
+      serial_overflow_count, serial_peak_length);
+    for (int code = 1; code <= BRIDGE_STATS_MAX_ERR_CODE+1; code++) {
+      if (len >= (int)sizeof(reply)) break;
+      const int ind = (code <= BRIDGE_STATS_MAX_ERR_CODE) ? code : 0;  //the "other" error codes go last
+      len += snprintf(reply + len, sizeof(reply) - len, (code == 1) ? "%lu" : ",%lu", (unsigned long)st.fail_by_code[ind]);
+    }
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET STATS had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetBleDataFormat(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    sendSerialOkMessage((ble_data_frame.getFormat() == BLE_DataFrame::FORMAT_BINARY) ? "BINARY" : "TEXT");
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET BLEDATAFORMAT had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetPhy(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    sendSerialOkMessage(BLE_LinkParams::phyName(ble_link_params.getPhy()));
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET PHY had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetConnInterval(void) { return replyWithLinkParam("CONNINTERVAL", ble_link_params.getConnInterval()); }
+int AT_Processor::processGetLatency(void)      { return replyWithLinkParam("LATENCY", ble_link_params.getLatency()); }
+int AT_Processor::processGetSupTimeout(void)   { return replyWithLinkParam("SUPTIMEOUT", ble_link_params.getSupTimeout()); }
+
+int AT_Processor::replyWithLinkParam(const char *name, const int value) {
+  int ret_val;
+  char reply[48];
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    snprintf(reply, sizeof(reply), "%d", value);
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    snprintf(reply, sizeof(reply), "GET %s had formatting problem", name);
+    sendSerialFailMessage(reply);
+  }
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetThroughput(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[AT_REPLY_MAX_LEN - 16];  //leave room for any tag
+    ble_throughput_test.getResults(reply, sizeof(reply));
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET THROUGHPUT had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetConnections(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[AT_REPLY_MAX_LEN - 16];  //leave room for any tag
+    ble_connections.getReport(reply, sizeof(reply));
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET CONNECTIONS had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetProfileHash(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    uint32_t hash = 0;
+    char reply[12] = "NONE";
+    if (getSavedBleProfileHash(&hash) == 0) snprintf(reply, sizeof(reply), "%08lX", (unsigned long)hash);
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET PROFILEHASH had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetAdvStatus(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[16] = "OFF";
+    uint8_t battery, mode, level;
+    ble_adv_payload.getStatus(&battery, &mode, &level);
+    if (ble_adv_payload.hasStatus()) snprintf(reply, sizeof(reply), "%d %d %d", battery, mode, level);
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET ADVSTATUS had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetAdvProfile(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[48];
+    const BLE_AdvSettings_t &s = ble_adv_profiles.getSettings();
+    snprintf(reply, sizeof(reply), "%s %d %d %d %d %d %d", ble_adv_profiles.getName(), s.fast_interval, s.slow_interval,
+      s.fast_timeout, s.tx_power, s.burst_secs, s.directed_secs);
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET ADVPROFILE had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetConnTarget(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[8] = "ALL";
+    if (ble_connections.getTarget() != BLE_CONN_TARGET_ALL) snprintf(reply, sizeof(reply), "%d", ble_connections.getTarget());
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET CONNTARGET had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetFlowControl(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    sendSerialOkMessage((flow_control.isEnabled()) ? "ON" : "OFF");
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET FLOWCONTROL had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//reply with how many flow control credits the Tympan should be holding right now
+int AT_Processor::processGetCredits(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[12];
+    snprintf(reply, sizeof(reply), "%d", flow_control.getCreditsHeld());
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET CREDITS had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+//reply with the ATT MTU of the current connection (or the largest that we allow, if not connected)
+int AT_Processor::processGetMtu(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    char reply[12];
+    snprintf(reply, sizeof(reply), "%d", getMaxBleDataNBytes()+3);
+    sendSerialOkMessage(reply);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET MTU had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
+int AT_Processor::processGetVersion(void) {
+  int ret_val;
+  if (isEndOfMessageInSerialBuff()) {
+    ret_val = 0;
+    sendSerialOkMessage(versionString);
+  } else {
+    ret_val = FORMAT_PROBLEM;
+    sendSerialFailMessage("GET VERSION had formatting problem");
+  }     
+  serial_read_ind = serial_write_ind;  //remove the message
+  return ret_val;
+}
+
 //returns OPERATION_FAILED if failed
 int AT_Processor::setBeginFromSerialBuff(void) {
   int ret_val = OPERATION_FAILED;
   int read_ind = serial_read_ind;
   char new_val = '1';  
-  if (lengthSerialMessage() > 0) if (serial_buff[serial_read_ind] == ' ') serial_read_ind++;  //skip over a single space, if it exists
+  skipSpaceIfNextInBuffer();  //skip over a single space, if it exists
   if (lengthSerialMessage() > 0) new_val = serial_buff[serial_read_ind]; //cheating, assumes only 1 character
   if (new_val == '0') { //for FALSE
     //do not start
@@ -904,7 +2082,7 @@ int AT_Processor::setBeginFromSerialBuff(void) {
     //any other character, assume we want to start
     //int start_code = (int) (new_val - '0');  //cheating, assumes only 1 character
     int start_code = interpret0toF(new_val); //cheating, assumes only 1 character
-    beginAllBleServices(start_code);
+    if (!isOnlyChecking()) beginAllBleServices(start_code);
     ret_val = 0;
   }
   serial_read_ind = serial_write_ind;  //remove any remaining message
@@ -932,7 +2110,7 @@ int AT_Processor::setMacAddressFromSerialBuff(void) {
       bool done = false;
       int targ_ind = 0;
       while (!done) {
-        char c = serial_buff[serial_read_ind++];  //get character and increment index to the next character
+        char c = getFirstCharInBuffer();  //get character and increment index to the next character
         //if ((c >= '0') && (c <= '9') || ((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f'))) {
         if (isNumOrAtoF(c)) {
           //good
@@ -944,7 +2122,8 @@ int AT_Processor::setMacAddressFromSerialBuff(void) {
         }
         if (targ_ind >= mac_len) done = true; 
       }
-      setMacAddress(new_mac);
+      new_mac[mac_len] = '\0';
+      if ((ret_val == 0) && !isOnlyChecking()) setMacAddress(new_mac);  //only a good MAC address
     }
   }
   serial_read_ind = serial_write_ind;  //remove any remaining message
@@ -963,8 +2142,7 @@ int AT_Processor::setBleNameFromSerialBuff(void) {
     bool done = false;
     int targ_ind = 0;
     while (!done) {
-      new_name[targ_ind++] = serial_buff[serial_read_ind++];
-      while (serial_read_ind >= AT_PROCESSOR_N_BUFFER) serial_read_ind -= AT_PROCESSOR_N_BUFFER;
+      new_name[targ_ind++] = getFirstCharInBuffer();  //auto-increments serial_read_ind (including wrapping)
       if (targ_ind >= max_len_name) done = true;
       if (serial_buff[serial_read_ind] == EOC) done = true;
       if (serial_read_ind == serial_write_ind) done = true;
@@ -974,18 +2152,15 @@ int AT_Processor::setBleNameFromSerialBuff(void) {
     if (targ_ind < max_len_name) {
       for (int i=targ_ind; i < max_len_name+1; i++ ) new_name[i] = '\0';  //add the null termination
     }
-    if (DEBUG_VIA_USB) Serial.println("AT_Processor: setBleNameFromSerialBuff: new_name = " + String(new_name));
+    if (DEBUG_VIA_USB) { Serial.print("AT_Processor: setBleNameFromSerialBuff: new_name = "); Serial.println(new_name); }
 
-    //prepare to set the new name...stop any advertising
-    Bluefruit.Advertising.stop();
-    Bluefruit.Advertising.clearData();
-    Bluefruit.ScanResponse.clearData(); // add this
+    if (isOnlyChecking()) return 0;
 
-    //send the new name to the module
-    Bluefruit.setName(new_name);
+    //send the new name to the module (and keep it for BEGIN and SAVE)
+    setDeviceName(new_name);
 
-    //restart advertising
-    startAdv();
+    //advertise the new name.  If we're advertising, it is swapped in without stopping (see BLE_AdvPayload.h)
+    if (bleBegun) updateAdvertisingData();
 
     return 0;  //return OK
   }
@@ -995,16 +2170,15 @@ int AT_Processor::setBleNameFromSerialBuff(void) {
 
 int AT_Processor::setAdvertisingFromSerialBuff(void) {
   int ret_val = OPERATION_FAILED;
-  if ((lengthSerialMessage() > 0) && (serial_buff[serial_read_ind]==' ')) serial_read_ind++; //remove leading whitespace
+  skipSpaceIfNextInBuffer(); //remove leading whitespace
   int read_ind = serial_read_ind;
   if (lengthSerialMessage() >= 2) {
-    int next_read_ind = read_ind+1;
-    while (next_read_ind >= AT_PROCESSOR_N_BUFFER) next_read_ind -= AT_PROCESSOR_N_BUFFER;
+    int next_read_ind = (read_ind+1) & AT_PROCESSOR_BUFFER_MASK;
     if ((serial_buff[read_ind]=='O') && (serial_buff[next_read_ind]=='N')) {  //look for ON
-      startAdv();
+      if (!isOnlyChecking()) startAdv();
       ret_val = 0;
     } else if ((serial_buff[read_ind]=='O') && (serial_buff[next_read_ind]=='F')) {  //look for OFF
-      stopAdv();
+      if (!isOnlyChecking()) stopAdv();
       ret_val = 0;
     }
   }
@@ -1013,11 +2187,12 @@ int AT_Processor::setAdvertisingFromSerialBuff(void) {
 
 int AT_Processor::setAdvServiceIdFromSerialBuff(void) {
   int ret_val = OPERATION_FAILED;
-  if ((lengthSerialMessage() > 0) && (serial_buff[serial_read_ind]==' ')) serial_read_ind++; //remove leading whitespace
+  skipSpaceIfNextInBuffer(); //remove leading whitespace
   if (lengthSerialMessage() >= 1) {
     //only use the first character as the number...this is a kludge!
     //int targ_service_id = (int)(serial_buff[serial_read_ind]-'0');
     int targ_service_id = interpret0toF(serial_buff[serial_read_ind]);
+    if (isOnlyChecking()) return isPresetServiceIdValid(targ_service_id) ? 0 : OPERATION_FAILED;
     int returned_service_id = setAdvertisingServiceToPresetById(targ_service_id);
     if (returned_service_id==targ_service_id) ret_val = 0;  //it worked!
   }
@@ -1027,14 +2202,13 @@ int AT_Processor::setAdvServiceIdFromSerialBuff(void) {
 int AT_Processor::setLedModeFromSerialBuff(void) {
   int ret_val = OPERATION_FAILED;
   int read_ind = serial_read_ind;
-  if ((lengthSerialMessage() > 0) && (serial_buff[read_ind]==' ')) read_ind++; //remove leading whitespace
-  while (read_ind >= AT_PROCESSOR_N_BUFFER) read_ind -= AT_PROCESSOR_N_BUFFER;
+  if ((lengthSerialMessage() > 0) && (serial_buff[read_ind]==' ')) read_ind = (read_ind+1) & AT_PROCESSOR_BUFFER_MASK; //remove leading whitespace
   if (lengthSerialMessage() >= 1) {
     if (serial_buff[read_ind]=='0') {
-      led_control.disableLEDs();
+      if (!isOnlyChecking()) led_control.disableLEDs();
       ret_val = 0;
     } else if (serial_buff[read_ind]=='1') {
-      led_control.setLedColor(led_control.red);
+      if (!isOnlyChecking()) led_control.setLedColor(led_control.red);
       ret_val = 0;
     }
   }
@@ -1044,40 +2218,82 @@ int AT_Processor::setLedModeFromSerialBuff(void) {
 //Send is for text-like data payloads to be sent via UART.  Cannot have a carriage return in the data payload.
 //Must still have a carriage return at the end of the serial buffer, though, marking the end of the overall message
 int AT_Processor::bleSendFromSerialBuff(void) {
-  //copy the message from the circular buffer to the straight buffer
-  size_t counter = 0;
-  while (serial_read_ind != serial_write_ind) {
-    BLEmessage[counter] = serial_buff[serial_read_ind];
-    counter++;
-    serial_read_ind++;  
-    if (serial_read_ind >= AT_PROCESSOR_N_BUFFER) serial_read_ind = 0;
+  //with flow control on, the whole message must be paid for up front (see BLE_FlowControl.h)
+  if (bleConnected && !flow_control.spendCredits(BLE_FlowControl::creditsForSend(lengthSerialMessage()))) {
+    sendSerialFailMessage("SEND has no flow control credit");
+    bridge_stats.countFailure(OPERATION_FAILED);
+    serial_read_ind = serial_write_ind;  //remove the message
+    return OPERATION_FAILED;
   }
 
-  //if BLE is connected, fire off the message
-  if (bleConnected) {
-    if (ble_ptr1) ble_ptr1->write(0, (const uint8_t *)BLEmessage, counter ); //characteristic ID 0
-    if (ble_ptr2) ble_ptr2->write((const uint8_t *)BLEmessage, counter );
-    return counter;
+  //send the message straight out of the circular buffer.  If it wraps around the end of the buffer, it takes two writes.
+  //Each targeted phone gets its own writes (see "SET CONNTARGET").
+  const uint8_t conn_mask = ble_connections.getTargetMask();
+  size_t counter = 0;
+  const char *span;
+  int span_len;
+  while ((span_len = getContiguousMessageInSerialBuff(&span)) > 0) {
+    //if BLE is connected, fire off this part of the message
+    for (int slot=0; slot < BLE_MAX_CONNECTIONS; slot++) {
+      if (!(conn_mask & (1 << slot))) continue;
+      const uint16_t conn_handle = ble_connections.getHandle(slot);
+      size_t n_sent;
+      if (ble_ptr1) { n_sent = ble_ptr1->notifyConnection(conn_handle, 0, (const uint8_t *)span, span_len); countSendToConnection(slot, n_sent); } //characteristic ID 0
+      if (ble_ptr2) { n_sent = ble_ptr2->write(conn_handle, (const uint8_t *)span, span_len);             countSendToConnection(slot, n_sent); }
+    }
+    counter += span_len;
+    serial_read_ind = (serial_read_ind + span_len) & AT_PROCESSOR_BUFFER_MASK; //increment the reader index for the serial buffer and wrap as needed
   }
+
+  if (conn_mask != 0) return counter;
   return NO_BLE_CONNECTION;
 }
 
+void AT_Processor::countSendToConnection(const int slot, const size_t n_sent) {
+  bridge_stats.countBleSend(n_sent);  ble_connections.countTx(slot, n_sent);
+  if (n_sent) ble_tx_queue.addPacketsInFlight(slot, BLE_FlowControl::creditsForSend(n_sent));
+}
+
+//Get a pointer to the next unread character in serial_buff.  Returns how many unread characters follow contiguously
+//(ie, before hitting the end of the circular buffer).  If the message wraps, the rest of it starts at serial_buff[0].
+int AT_Processor::getContiguousMessageInSerialBuff(const char **ptr) {
+  *ptr = &serial_buff[serial_read_ind];
+  if (serial_write_ind >= serial_read_ind) return serial_write_ind - serial_read_ind;
+  return AT_PROCESSOR_N_BUFFER - serial_read_ind;
+}
+
+//Build the whole reply ("[#tag ]OK reply_str" or "[#tag ]FAIL reply_str", then the EOC and a newline) in one buffer
+//on the stack and send it with a single write.  No String objects, so nothing is allocated on the heap.
+void AT_Processor::sendSerialReply(const char *status_str, const char *reply_str, const int err_code) {
+  char reply[AT_REPLY_MAX_LEN];
+  const int max_len = AT_REPLY_MAX_LEN - 3;  //leave room for the EOC and the newline
+  int len = 0;
+  if (isMessageTagged()) {
+    reply[len++] = AT_TAG_START_CHAR;
+    for (const char *c = reply_tag; *c != '\0'; ++c) reply[len++] = *c;
+    reply[len++] = ' ';
+  }
+  while ((*status_str != '\0') && (len < max_len)) reply[len++] = *status_str++;
+  while ((*reply_str != '\0') && (len < max_len)) reply[len++] = *reply_str++;
+  if ((err_code != 0) && (len < max_len)) len += snprintf(&reply[len], max_len - len, ", err = %d", err_code);  //snprintf includes the null
+  if (len > max_len) len = max_len;  //in case snprintf was truncated
+  reply[len++] = EOC;
+  reply[len++] = '\r'; reply[len++] = '\n';  //same as println()
+  serial_ptr->write((const uint8_t *)reply, len);
+  if (DEBUG_VIA_USB) { Serial.print("AT Reply: "); Serial.write((const uint8_t *)reply, len - 3); Serial.println(); }
+}
 void AT_Processor::sendSerialOkMessage(const char* reply_str) {
-  serial_ptr->print("OK ");
-  serial_ptr->print(reply_str);
-  serial_ptr->println(EOC);
-  if (DEBUG_VIA_USB) Serial.println("AT Reply: OK " + String(reply_str));
+  if (flag_mute_replies) return;
+  sendSerialReply("OK ", reply_str, 0);
 }
 void AT_Processor::sendSerialOkMessage(void) {
-  serial_ptr->print("OK ");
-  serial_ptr->println(EOC);
-  if (DEBUG_VIA_USB) Serial.println("AT Reply: OK");
+  if (flag_mute_replies) return;
+  sendSerialReply("OK ", "", 0);
 }
-void AT_Processor::sendSerialFailMessage(const char* reply_str) {
-  serial_ptr->print("FAIL ");
-  serial_ptr->print(reply_str);
-  serial_ptr->println(EOC);
-   if (DEBUG_VIA_USB) Serial.println("AT Reply: FAIL " + String(reply_str));
+void AT_Processor::sendSerialFailMessage(const char* reply_str) { sendSerialFailMessage(reply_str, 0); }
+void AT_Processor::sendSerialFailMessage(const char* reply_str, const int err_code) {
+  if (flag_mute_replies) { flag_muted_reply_failed = true; if (DEBUG_VIA_USB) { Serial.print("AT Reply (muted): FAIL "); Serial.println(reply_str); } return; }
+  sendSerialReply("FAIL ", reply_str, err_code);
 }
 
 void AT_Processor::debugPrintMsgFromSerialBuff(void) {
@@ -1087,8 +2303,7 @@ void AT_Processor::debugPrintMsgFromSerialBuff(void) {
 void AT_Processor::debugPrintMsgFromSerialBuff(int start_ind, int end_ind) {
   while (start_ind != end_ind) {
     if (DEBUG_VIA_USB) Serial.print(serial_buff[start_ind]);
-    start_ind++; 
-    if (start_ind >= AT_PROCESSOR_N_BUFFER) start_ind = 0;
+    start_ind = (start_ind + 1) & AT_PROCESSOR_BUFFER_MASK;
   }  
 }
 
@@ -1139,6 +2354,17 @@ int AT_Processor::getValueFromBuffer(int *out_value) {
   return 0;  //no error
 }
 
+int AT_Processor::getDecimalFromBuffer(int *out_value) {
+  int tmp_value = 0, n_digits = 0;
+  while ((lengthSerialMessage() > 0) && (serial_buff[serial_read_ind] >= '0') && (serial_buff[serial_read_ind] <= '9')) {
+    tmp_value = 10*tmp_value + (getFirstCharInBuffer() - '0');  //auto-increments serial_read_ind
+    n_digits++;
+  }
+  if (n_digits == 0) return 1;  //return error.  no number here
+  *out_value = tmp_value;
+  return 0;  //no error
+}
+
 //assume char props is being sent as binary with all eight characters present ("00110110")
 int AT_Processor::getCharPropsFromBuffer(const int n_chars_comprising_char_props, uint8_t *char_props) {
   if (lengthSerialMessage() < n_chars_comprising_char_props) return 1; //error.  Serial message too small
@@ -30,7 +30,11 @@ class BLEUart_Adafruit : public virtual BLEUart, public virtual BLE_Service_Pres
     //additional methods required by BLE_Service_Preset
     size_t write( const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(data, len); } return 0; }
     size_t notify(const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(data, len); } return 0; }
+    size_t notifyConnection(const uint16_t conn_handle, const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(conn_handle, data, len); } return 0; }
+    bool isSubscribed(const uint16_t conn_handle, const int char_id) override { return BLEUart::notifyEnabled(conn_handle); }  //always _txd
     BLEService* getServiceToAdvertise(void) override { return this; }
+    int getNCharacteristics(void) override { return 2; }
+    BLECharacteristic* getCharacteristic(const int char_id) override { return (char_id == 0) ? &_txd : ((char_id == 1) ? &_rxd : nullptr); }
 
     //define how many characteristics and what their ID numbes are
     const int nchars = 1;  //max number of characteristics
@@ -75,7 +75,11 @@ class BLEUart_Tympan : public virtual BLEUart, public virtual BLE_Service_Preset
     //additional methods required by BLE_Service_Preset
     size_t write( const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(data, len); } return 0; }
     size_t notify(const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(data, len); } return 0; }
+    size_t notifyConnection(const uint16_t conn_handle, const int char_id, const uint8_t* data, size_t len) override { if (has_begun) { return BLEUart::write(conn_handle, data, len); } return 0; }
+    bool isSubscribed(const uint16_t conn_handle, const int char_id) override { return BLEUart::notifyEnabled(conn_handle); }  //always _txd
     BLEService* getServiceToAdvertise(void) override { return this; }
+    int getNCharacteristics(void) override { return 1; }
+    BLECharacteristic* getCharacteristic(const int char_id) override { return (char_id == 0) ? &_txd : nullptr; }  //_txd is both TX and RX
 
     // ID Strings to be used by the nRF52 firmware to enable recognition by Tympan Remote App
     //String serviceUUID = String("BC-2F-4C-C6-AA-EF-43-51-90-34-D6-62-68-E3-28-F0");
@@ -0,0 +1,119 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to change what we advertise (the name, the advertised service, and so on)
+// while we keep advertising.  Before, changing the name stopped advertising, cleared the data, and started again, so
+// phones saw a gap and had to find us again.
+//
+// Here, the advertising data and the scan response data are built into one of two pairs of buffers.  While the
+// SoftDevice is advertising from one pair, the next version is built into the other pair and handed to the
+// SoftDevice via sd_ble_gap_adv_set_configure().  The SoftDevice switches to it on its next advertising event, with
+// no gap.  (It requires the new data to be in different buffers than the ones that it is using.)  If nothing has
+// changed, nothing is handed over, so update() can be called as often as needed.
+//
+// Live status: The Tympan can put a few status values into the advertising data (as manufacturer-specific data), so
+// that phones can watch a whole room of Tympans by passive scanning, without connecting to any of them:
+//
+//    SET ADVSTATUS=battery mode level    (each 0-255, separated by spaces.  Such as "SET ADVSTATUS=85 2 60")
+//    SET ADVSTATUS=OFF                   (removes it from the advertising data)
+//    GET ADVSTATUS                       (replies "battery mode level" or "OFF")
+//
+// The field is [8] [0xFF] [COMPANY_LSB] [COMPANY_MSB] [FORMAT] [BATTERY] [N_CONNECTED] [MODE] [LEVEL], where FORMAT is
+// BLE_ADV_STATUS_FORMAT and N_CONNECTED (how many phones are connected) is filled in by us.  The meaning of the
+// battery, mode, and level bytes is up to the Tympan (such as battery percent, the algorithm preset, and the input
+// level in dB SPL).  It is sent with the next advertising event.  To make room in the 31 bytes, the TX power field
+// is left out while the status is on.
+//
+// Adafruit's BLEAdvertising (Bluefruit.Advertising) still starts and restarts advertising (after a disconnect, or
+// when the fast mode times out).  It restarts with its own copy of the data, so that copy is kept the same as ours.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_ADV_PAYLOAD_H
+#define BLE_ADV_PAYLOAD_H
+
+#include <bluefruit.h>
+
+#define BLE_ADV_PAYLOAD_MAX_NBYTES BLE_GAP_ADV_SET_DATA_SIZE_MAX  //31 bytes, for legacy advertising
+#define BLE_ADV_STATUS_COMPANY_ID 0xFFFF   //the Bluetooth SIG's id for testing, until we have our own
+#define BLE_ADV_STATUS_FORMAT 1            //change this if the status bytes change
+
+class BLE_AdvPayload {
+  public:
+    BLE_AdvPayload(void) {}
+
+    //which service's UUID to advertise (or nullptr for none).  Takes effect at the next update().
+    void setService(BLEService *_service) { service = _service; }
+
+    //Build the advertising and scan response data from the current settings (and Bluefruit's name and TX power).
+    //If they have changed, swap them in without stopping advertising.  Returns 0 if OK (or nothing changed) or -1 if
+    //the SoftDevice refused them.
+    int update(void);
+
+    //The live status (see above).  They take effect at the next update().
+    void setStatus(const uint8_t battery, const uint8_t mode, const uint8_t level) { status[0] = battery; status[2] = mode; status[3] = level; has_status = true; }
+    void setNConnected(const uint8_t n_connected) { status[1] = n_connected; }
+    void clearStatus(void) { has_status = false; }
+    bool hasStatus(void) { return has_status; }
+    void getStatus(uint8_t *battery, uint8_t *mode, uint8_t *level) { *battery = status[0]; *mode = status[2]; *level = status[3]; }
+
+    //Make the next update() hand the data over even if it has not changed (such as after Bluefruit's copy was cleared)
+    void resend(void) { has_been_built = false; }
+
+    uint32_t getNUpdates(void) { return n_updates; }
+
+  private:
+    BLEService *service = nullptr;
+    bool has_status = false;
+    uint8_t status[4] = {0, 0, 0, 0};  //battery, n_connected, mode, level
+    uint8_t adv_buff[2][BLE_ADV_PAYLOAD_MAX_NBYTES], scan_buff[2][BLE_ADV_PAYLOAD_MAX_NBYTES];
+    uint8_t adv_len[2] = {0, 0}, scan_len[2] = {0, 0};
+    int active = 0;                 //which pair the SoftDevice is (or will be) using
+    bool has_been_built = false;
+    uint32_t n_updates = 0;
+    static constexpr uint8_t adv_handle = 0;  //the SoftDevice has only one advertising set.  Adafruit's start() made it.
+};
+
+int BLE_AdvPayload::update(void) {
+  //build the next version.  Adafruit's BLEAdvertisingData does the formatting.
+  BLEAdvertisingData adv, scan;
+  adv.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
+  if (!has_status) adv.addTxPower();  //the status needs its room
+  if (service != nullptr) adv.addService(*service);
+  if (has_status) {
+    const uint8_t manuf_data[] = { (uint8_t)(BLE_ADV_STATUS_COMPANY_ID & 0x00FF), (uint8_t)(BLE_ADV_STATUS_COMPANY_ID >> 8), BLE_ADV_STATUS_FORMAT,
+      status[0], status[1], status[2], status[3] };
+    adv.addData(BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, manuf_data, sizeof(manuf_data));
+  }
+  scan.addName();
+
+  //has anything changed?
+  if (has_been_built && (adv.count() == adv_len[active]) && (scan.count() == scan_len[active]) &&
+      (memcmp(adv.getData(), adv_buff[active], adv.count()) == 0) && (memcmp(scan.getData(), scan_buff[active], scan.count()) == 0)) {
+    return 0;
+  }
+
+  //copy it into the pair that the SoftDevice is not using
+  const int next = 1 - active;
+  adv_len[next] = adv.count();    memcpy(adv_buff[next], adv.getData(), adv_len[next]);
+  scan_len[next] = scan.count();  memcpy(scan_buff[next], scan.getData(), scan_len[next]);
+
+  //if we're advertising, hand it to the SoftDevice now.  The interval and such (adv_params) stay the same.
+  if (Bluefruit.Advertising.isRunning()) {
+    ble_gap_adv_data_t gap_adv;
+    memset(&gap_adv, 0, sizeof(gap_adv));
+    gap_adv.adv_data.p_data = adv_buff[next];            gap_adv.adv_data.len = adv_len[next];
+    gap_adv.scan_rsp_data.p_data = scan_buff[next];      gap_adv.scan_rsp_data.len = scan_len[next];
+    uint8_t handle = adv_handle;
+    if (sd_ble_gap_adv_set_configure(&handle, &gap_adv, NULL) != NRF_SUCCESS) return -1;
+  }
+  active = next;  has_been_built = true;  n_updates++;
+
+  //keep Adafruit's copy the same, for when it restarts advertising.  The SoftDevice isn't using that copy now.
+  Bluefruit.Advertising.setData(adv_buff[active], adv_len[active]);
+  Bluefruit.ScanResponse.setData(scan_buff[active], scan_len[active]);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,189 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to let the Tympan choose how we advertise.  Fast advertising lets the phone
+// find us in well under a second when the user opens the app, but it costs battery.  Slow advertising saves
+// battery, but the phone might take several seconds to find us.  So, instead of one fixed compromise, there are
+// named advertising profiles:
+//
+//    Name       Fast   Slow   Fast timeout  TX power  Burst  Directed
+//    BALANCED   20 ms  152.5  30 sec        4 dBm     10 sec off       (the default, same as before)
+//    FAST       20 ms  100    60 sec        4 dBm     10 sec 2 sec
+//    LOWPOWER   100 ms 1022.5 10 sec        0 dBm     5 sec  2 sec
+//    CUSTOM     whatever the Tympan asks for
+//
+// Each time advertising starts, it uses the fast interval for the fast timeout and then the slow interval.  The
+// TX power also applies to the connections.  The Tympan uses these messages (see AT_Processor.h):
+//
+//    SET ADVPROFILE=BALANCED, FAST, or LOWPOWER
+//    SET ADVPROFILE=CUSTOM fast slow timeout power burst directed
+//                        fast and slow intervals in units of 0.625 msec (32 to 16384, fast <= slow), fast timeout in
+//                        sec (0 to 3600, 0 is slow only), TX power in dBm (-40, -20, -16, -12, -8, -4, 0, or 2 to 8),
+//                        burst in sec (0 to 60, 0 is off), directed in sec (0 to 60, 0 is off).  Such as
+//                        "SET ADVPROFILE=CUSTOM 32 1636 20 0 10 2"
+//    GET ADVPROFILE      replies "name fast slow timeout power burst directed"
+//    ADVBURST            advertise at the fastest interval (20 ms) for the profile's burst time, such as when the
+//                        user presses the Tympan's button or opens the app.  Then, back to the slow interval.
+//
+// If we're advertising, a new profile takes effect right away (advertising restarts, so there is a short gap).
+//
+// Directed advertising: when a phone disconnects, we first advertise only to that phone (directed, at the fast
+// interval) for the profile's directed time.  A phone that wants to reconnect finds us quickly and other phones
+// don't see us at all.  Then, we go back to normal advertising.  Phones change their (private) address every few
+// minutes, so this only helps a phone that comes back soon.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_ADV_PROFILES_H
+#define BLE_ADV_PROFILES_H
+
+#include <bluefruit.h>
+#include "BLE_Profile.h"
+
+#define BLE_ADV_MIN_INTERVAL BLE_GAP_ADV_INTERVAL_MIN   //32, which is 20 msec
+#define BLE_ADV_MAX_INTERVAL BLE_GAP_ADV_INTERVAL_MAX   //16384, which is 10.24 sec
+#define BLE_ADV_BURST_INTERVAL BLE_ADV_MIN_INTERVAL
+#define BLE_ADV_MAX_FAST_TIMEOUT 3600                   //1 hour
+#define BLE_ADV_MAX_BURST_SECS 60
+#define BLE_ADV_MAX_DIRECTED_SECS 60
+#define BLE_ADV_N_PRESETS 3
+#define BLE_ADV_CUSTOM_ID BLE_ADV_N_PRESETS             //the id for the CUSTOM profile
+
+typedef struct {
+  uint16_t fast_interval;  //in units of 0.625 msec
+  uint16_t slow_interval;  //in units of 0.625 msec
+  uint16_t fast_timeout;   //seconds at the fast interval after advertising starts (0 is slow only)
+  int8_t tx_power;         //dBm
+  uint8_t burst_secs;      //how long "ADVBURST" lasts (0 is off)
+  uint8_t directed_secs;   //how long to advertise only to the last phone after it disconnects (0 is off)
+} BLE_AdvSettings_t;
+
+class BLE_AdvProfiles {
+  public:
+    BLE_AdvProfiles(void) { setPresetById(0); }
+
+    //The presets (see above)
+    static int getNPresets(void) { return BLE_ADV_N_PRESETS; }
+    static const char* getPresetName(const int id) { return ((id >= 0) && (id < BLE_ADV_N_PRESETS)) ? preset_names[id] : "CUSTOM"; }
+
+    //Choose a preset, or CUSTOM settings.  Returns 0 if OK or -1 if not known (or out of range).  They take effect
+    //the next time that advertising starts (see apply()).
+    int setPresetById(const int id);
+    int setCustom(const BLE_AdvSettings_t &new_settings);
+    static bool isValid(const BLE_AdvSettings_t &s);
+    int getId(void) { return profile_id; }
+    const char* getName(void) { return getPresetName(profile_id); }
+    const BLE_AdvSettings_t& getSettings(void) { return settings; }
+
+    //Configure Bluefruit.Advertising for normal (undirected) advertising with the current profile.  If burst is
+    //true, use the burst interval for the burst time instead of the fast interval.  Call before starting.
+    void apply(const bool burst = false);
+
+    //Configure Bluefruit.Advertising to advertise only to the last phone that connected.  Returns the number of
+    //seconds to advertise for, or 0 if directed advertising is off (or no phone has connected yet).
+    int applyDirected(void);
+    bool isDirected(void) { return is_directed; }
+
+    //Call from loop() (not from the BLE callbacks) so that we know which phone to direct to
+    void onConnect(const uint16_t conn_handle);
+
+    //For saving the profile in flash (see BLE_Profile.h).  readProfile() returns 0 if OK or 1 if the profile was bad.
+    void writeProfile(BLE_Profile &profile);
+    int readProfile(BLE_Profile &profile);
+
+  private:
+    int profile_id = 0;
+    BLE_AdvSettings_t settings;
+    bool is_directed = false;
+    bool has_peer = false;
+    ble_gap_addr_t peer_addr;
+
+    static const char* preset_names[BLE_ADV_N_PRESETS];
+    static const BLE_AdvSettings_t preset_settings[BLE_ADV_N_PRESETS];
+};
+
+const char* BLE_AdvProfiles::preset_names[BLE_ADV_N_PRESETS] = { "BALANCED", "FAST", "LOWPOWER" };
+const BLE_AdvSettings_t BLE_AdvProfiles::preset_settings[BLE_ADV_N_PRESETS] = {
+  //fast, slow, fast timeout, TX power, burst, directed.  Apple's recommended intervals: https://developer.apple.com/library/content/qa/qa1931/_index.html
+  {  32,  244, 30, 4, 10, 0 },   //BALANCED: 20 msec, 152.5 msec
+  {  32,  160, 60, 4, 10, 2 },   //FAST: 20 msec, 100 msec
+  { 160, 1636, 10, 0,  5, 2 }    //LOWPOWER: 100 msec, 1022.5 msec
+};
+
+int BLE_AdvProfiles::setPresetById(const int id) {
+  if ((id < 0) || (id >= BLE_ADV_N_PRESETS)) return -1;
+  profile_id = id;  settings = preset_settings[id];
+  return 0;
+}
+
+int BLE_AdvProfiles::setCustom(const BLE_AdvSettings_t &new_settings) {
+  if (!isValid(new_settings)) return -1;
+  profile_id = BLE_ADV_CUSTOM_ID;  settings = new_settings;
+  return 0;
+}
+
+bool BLE_AdvProfiles::isValid(const BLE_AdvSettings_t &s) {
+  if ((s.fast_interval < BLE_ADV_MIN_INTERVAL) || (s.slow_interval > BLE_ADV_MAX_INTERVAL) || (s.fast_interval > s.slow_interval)) return false;
+  if ((s.fast_timeout > BLE_ADV_MAX_FAST_TIMEOUT) || (s.burst_secs > BLE_ADV_MAX_BURST_SECS) || (s.directed_secs > BLE_ADV_MAX_DIRECTED_SECS)) return false;
+  const int8_t allowed_powers[] = { -40, -20, -16, -12, -8, -4, 0, 2, 3, 4, 5, 6, 7, 8 };  //what the nRF52840 allows
+  for (unsigned int i=0; i < sizeof(allowed_powers); i++) if (s.tx_power == allowed_powers[i]) return true;
+  return false;
+}
+
+void BLE_AdvProfiles::apply(const bool burst) {
+  is_directed = false;
+  Bluefruit.setTxPower(settings.tx_power);
+  Bluefruit.Advertising.setType(BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED);
+  if (burst) {
+    Bluefruit.Advertising.setInterval(BLE_ADV_BURST_INTERVAL, settings.slow_interval);  // in unit of 0.625 ms
+    Bluefruit.Advertising.setFastTimeout(settings.burst_secs);                          // number of seconds in fast mode
+  } else {
+    Bluefruit.Advertising.setInterval(settings.fast_interval, settings.slow_interval);
+    Bluefruit.Advertising.setFastTimeout(settings.fast_timeout);
+  }
+}
+
+int BLE_AdvProfiles::applyDirected(void) {
+  if ((settings.directed_secs == 0) || !has_peer) return 0;
+  is_directed = true;
+  Bluefruit.setTxPower(settings.tx_power);
+  Bluefruit.Advertising.setType(BLE_GAP_ADV_TYPE_CONNECTABLE_NONSCANNABLE_DIRECTED);  //the low duty cycle kind, so it can last more than 1.28 sec
+  Bluefruit.Advertising.setPeerAddress(peer_addr);
+  Bluefruit.Advertising.setInterval(settings.fast_interval, settings.fast_interval);
+  Bluefruit.Advertising.setFastTimeout(settings.directed_secs);
+  return settings.directed_secs;
+}
+
+void BLE_AdvProfiles::onConnect(const uint16_t conn_handle) {
+  is_directed = false;
+  BLEConnection *connection = Bluefruit.Connection(conn_handle);
+  if (connection == nullptr) return;  //might have disconnected already
+  peer_addr = connection->getPeerAddr();  has_peer = true;
+}
+
+void BLE_AdvProfiles::writeProfile(BLE_Profile &profile) {
+  profile.putU8((uint8_t)profile_id);
+  profile.putU16(settings.fast_interval);
+  profile.putU16(settings.slow_interval);
+  profile.putU16(settings.fast_timeout);
+  profile.putU8((uint8_t)settings.tx_power);
+  profile.putU8(settings.burst_secs);
+  profile.putU8(settings.directed_secs);
+}
+
+int BLE_AdvProfiles::readProfile(BLE_Profile &profile) {
+  const int id = profile.getU8();
+  BLE_AdvSettings_t s;
+  s.fast_interval = profile.getU16();
+  s.slow_interval = profile.getU16();
+  s.fast_timeout = profile.getU16();
+  s.tx_power = (int8_t)profile.getU8();
+  s.burst_secs = profile.getU8();
+  s.directed_secs = profile.getU8();
+  if (!profile.isOK()) return 1;
+  if (id < BLE_ADV_N_PRESETS) return (setPresetById(id) == 0) ? 0 : 1;  //a preset is used as it is now
+  return (setCustom(s) == 0) ? 0 : 1;
+}
+
+#endif
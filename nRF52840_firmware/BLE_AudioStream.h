@@ -0,0 +1,145 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the nRF52 to stream compressed audio from the Tympan to the phone, so that the phone can
+// monitor what the Tympan hears.
+//
+// The Tympan compresses the audio (IMA-ADPCM, see ImaAdpcm.h in the TympanF_basicGain sketch) and sends each block
+// to us as a binary AUDIO frame (see AT_Processor.h):
+//
+//    [0x02] [4] [X] [0] [N_LSB] [N_MSB] [0x03] [N bytes of one compressed block] [0x04]
+//
+// where X is the service_id of this service.  There is no reply (it is a stream), but the failures are counted in
+// "GET STATS".  Here, the blocks are packed back-to-back into notifications that are as long as the MTU allows.
+// Each notification starts with a 3-byte header:
+//
+//    [SEQ_LSB] [SEQ_MSB] [FIRST] [packed block bytes...]
+//
+// SEQ counts up by one for every notification (so the phone can see what was lost).  FIRST is where the first block
+// that starts in this notification begins (counting from the byte after the header), or 0xFF if none does.  After a
+// lost notification, the phone throws away bytes until it reaches FIRST.
+//
+// A notification that is only partly full is sent anyway once it has waited BLE_AUDIO_FLUSH_MILLIS (see service()),
+// so that the end of the stream is not held back until the Tympan streams again.  It is thrown away if the last
+// phone disconnects.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BLE_AudioStream_h
+#define _BLE_AudioStream_h
+
+#include <bluefruit.h>
+#include "BLE_Service_Preset.h"
+#include "BLE_TxQueue.h"
+
+#define BLE_AUDIO_HEADER_NBYTES 3
+#define BLE_AUDIO_NO_FIRST 0xFF
+#define BLE_AUDIO_FLUSH_MILLIS 50UL   //send a partly full notification after this long (a few blocks at the Tympan's rate)
+
+const uint8_t AUDIO_UUID_SERVICE[16] =    //reverse order of 'C5A0E400-5B5B-4E5A-9F3C-7B6B0A5D4E10'
+{
+  0x10, 0x4E, 0x5D, 0x0A, 0x6B, 0x7B, 0x3C, 0x9F,
+  0x5A, 0x4E, 0x5B, 0x5B, 0x00, 0xE4, 0xA0, 0xC5
+};
+const uint8_t AUDIO_UUID_CHR_STREAM[16] = //reverse order of 'C5A0E401-5B5B-4E5A-9F3C-7B6B0A5D4E10'
+{
+  0x10, 0x4E, 0x5D, 0x0A, 0x6B, 0x7B, 0x3C, 0x9F,
+  0x5A, 0x4E, 0x5B, 0x5B, 0x01, 0xE4, 0xA0, 0xC5
+};
+
+extern bool bleConnected;
+extern int getMaxBleDataNBytes(void);
+extern BLE_TxQueue ble_tx_queue;
+
+//define services and characteristics for a pre-set available to be invoked by the Tympan user at startup
+class BLE_AudioStreamService : public virtual BLEService, public virtual BLE_Service_Preset {
+  public:
+    BLE_AudioStreamService(void) : BLEService(AUDIO_UUID_SERVICE), BLE_Service_Preset(), audio_char(AUDIO_UUID_CHR_STREAM) {
+      name = "Audio Stream Service";
+    };
+    ~BLE_AudioStreamService(void) override {};
+
+    err_t begin(int id) override  //err_t is inhereted from bluefruit.h?
+    {
+      BLE_Service_Preset::begin(id); //sets service_id
+      err_t err_code = BLEService::begin();
+      if (err_code != 0) return err_code;
+
+      audio_char.setProperties(CHR_PROPS_NOTIFY);
+      audio_char.setPermission(SECMODE_OPEN, SECMODE_NO_ACCESS);
+      audio_char.setMaxLen(BLE_MAX_DATA_NBYTES);
+      audio_char.setUserDescriptor("Audio Stream");
+      return audio_char.begin();
+    }
+
+    //additional methods required by BLE_Service_Preset
+    size_t notify(const int char_id, const uint8_t* data, size_t len) override { return audio_char.notify(data, len) ? len : 0; }
+    BLEService* getServiceToAdvertise(void) override { return this; }
+    int getNCharacteristics(void) override { return 1; }
+    BLECharacteristic* getCharacteristic(const int char_id) override { return (char_id == 0) ? &audio_char : nullptr; }
+
+    //Add one compressed block from the Tympan.  Each full notification goes into ble_tx_queue.  Returns 0 if OK, -2 if
+    //a notification had to be dropped (the queue was full), or -3 if not connected (the block is dropped).
+    int addFrame(const uint8_t *frame, const size_t len);
+
+    //Call from loop(), before ble_tx_queue.service().  Sends the partly full notification, if it has waited too long.
+    //Returns what addFrame() would.
+    int service(void);
+
+    //Throw away the partly full notification (such as when the last phone disconnects)
+    void reset(void) { packet_len = 0; }
+
+  private:
+    BLECharacteristic audio_char;
+    uint8_t packet[BLE_MAX_DATA_NBYTES];
+    int packet_len = 0;        //zero means that no packet has been started
+    int packet_nbytes = 0;     //how long this packet will be (set from the MTU when it is started)
+    uint16_t seq = 0;
+    unsigned long packet_start_millis = 0;
+
+    void startPacket(void);
+    int sendPacket(void);
+};
+
+void BLE_AudioStreamService::startPacket(void) {
+  packet_nbytes = getMaxBleDataNBytes();
+  packet[0] = (uint8_t)(0x00FF & seq);  packet[1] = (uint8_t)(0x00FF & (seq >> 8));
+  packet[2] = BLE_AUDIO_NO_FIRST;
+  packet_len = BLE_AUDIO_HEADER_NBYTES;
+  packet_start_millis = millis();
+  seq++;
+}
+
+int BLE_AudioStreamService::sendPacket(void) {
+  int ret_val = (ble_tx_queue.push(this, 0, packet, packet_len) < 0) ? -2 : 0;
+  if (ret_val != 0) bridge_stats.countBleSend(0);  //dropped.  The phone sees the gap in SEQ.
+  packet_len = 0;
+  return ret_val;
+}
+
+int BLE_AudioStreamService::addFrame(const uint8_t *frame, const size_t len) {
+  if (!bleConnected) { packet_len = 0; return -3; }
+
+  int ret_val = 0;
+  size_t ind = 0;
+  while (ind < len) {
+    if (packet_len == 0) startPacket();
+    if ((ind == 0) && (packet[2] == BLE_AUDIO_NO_FIRST)) packet[2] = (uint8_t)(packet_len - BLE_AUDIO_HEADER_NBYTES);  //this block starts here
+
+    const size_t n_copy = min(len - ind, (size_t)(packet_nbytes - packet_len));
+    memcpy(packet + packet_len, frame + ind, n_copy);
+    packet_len += n_copy;  ind += n_copy;
+    if (packet_len >= packet_nbytes) { if (sendPacket() != 0) ret_val = -2; }
+  }
+  return ret_val;
+}
+
+int BLE_AudioStreamService::service(void) {
+  if (packet_len <= BLE_AUDIO_HEADER_NBYTES) return 0;  //nothing waiting
+  if (!bleConnected) { packet_len = 0; return -3; }
+  if ((millis() - packet_start_millis) < BLE_AUDIO_FLUSH_MILLIS) return 0;
+  return sendPacket();
+}
+
+#endif
@@ -30,7 +30,11 @@ class BLE_BattService : public virtual BLEBas, public virtual BLE_Service_Preset
     //additional methods required by BLE_Service_Preset
     size_t write( const int char_id, const uint8_t* data, size_t len) override { bool ret_val = BLEBas::write ((uint8_t)data[0]); return (size_t)ret_val; };
     size_t notify(const int char_id, const uint8_t* data, size_t len) override { bool ret_val = BLEBas::notify((uint8_t)data[0]); return (size_t)ret_val; };
+    size_t notifyConnection(const uint16_t conn_handle, const int char_id, const uint8_t* data, size_t len) override { bool ret_val = BLEBas::notify(conn_handle, (uint8_t)data[0]); return (size_t)ret_val; };
     BLEService* getServiceToAdvertise(void) override { return this; }
+    bool isLatestValueWins(const int char_id) override { return true; }  //only the latest battery level matters
+    int getNCharacteristics(void) override { return 1; }
+    BLECharacteristic* getCharacteristic(const int char_id) override { return (char_id == 0) ? &_battery : nullptr; }  //_battery is in BLEBas
     
     //define how many characteristics and what their ID numbes are
     const int nchars = 1;  //max number of characteristics
@@ -73,6 +73,7 @@ class BLE_BleDis : public virtual BLEDis, public virtual BLE_Service_Preset {
 
       return ret_val;
    }
+    size_t notifyConnection(const uint16_t conn_handle, const int characteristic_id, const uint8_t* data, size_t len) override { return notify(characteristic_id, data, len); }  //same info for every phone
 
     BLEService* getServiceToAdvertise(void) override { return this; }
 
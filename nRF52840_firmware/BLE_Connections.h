@@ -0,0 +1,132 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to keep track of several phones (centrals) that are connected at the same
+// time, such as a clinician's tablet and the patient's phone.  Each connection gets a slot (0 to
+// BLE_MAX_CONNECTIONS-1) that holds its connection handle and its own counters.  Each connection also has its own
+// MTU and its own subscriptions, which the SoftDevice keeps for us.
+//
+// The Tympan picks where its outgoing data goes (BLENOTIFY, SEND, and binary frames) with "SET CONNTARGET=ALL" (the
+// default) or "SET CONNTARGET=n" for slot n only.  With ALL, each notification is sent to every connection that is
+// subscribed.  "GET CONNECTED" replies with "TRUE n" or "FALSE 0", where n is the number of connections.  "GET
+// CONNECTIONS" replies with each connection's slot, handle, MTU, and counters:
+//
+//    "N=2 0:H=0,MTU=247,TX=m,b,f,RX=m,b 1:H=1,MTU=185,TX=m,b,f,RX=m,b"
+//
+// where TX counts the notifications (messages, bytes, and failures) sent to that phone and RX counts the writes from
+// it (the UART services do not say which phone wrote, so their data is only counted in "GET STATS").
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_CONNECTIONS_H
+#define BLE_CONNECTIONS_H
+
+#include <bluefruit.h>
+#include "BLE_Service_Preset.h"  //for BLE_MAX_DATA_NBYTES
+
+//how many phones can be connected at once.  setupBLE() configures the SoftDevice for this many.  Each one takes
+//more of the SoftDevice's RAM.  Must be 8 or less (see getTargetMask()).
+#define BLE_MAX_CONNECTIONS 2
+#define BLE_CONN_TARGET_ALL -1
+
+class BLE_Connections {
+  public:
+    BLE_Connections(void) { for (int i=0; i < BLE_MAX_CONNECTIONS; i++) { conns[i].connected = false; resetCounters(i); } }
+
+    //These two are called from the BLE callbacks.  They return the slot, or -1 if there was no room (or no match).
+    int onConnect(const uint16_t conn_handle);
+    int onDisconnect(const uint16_t conn_handle);
+
+    int getNConnected(void) { int n = 0; for (int i=0; i < BLE_MAX_CONNECTIONS; i++) if (conns[i].connected) n++; return n; }
+    bool isConnected(const int slot) { return ((slot >= 0) && (slot < BLE_MAX_CONNECTIONS) && conns[slot].connected); }
+    uint16_t getHandle(const int slot) { return conns[slot].conn_handle; }
+    int getSlot(const uint16_t conn_handle) { for (int i=0; i < BLE_MAX_CONNECTIONS; i++) if (conns[i].connected && (conns[i].conn_handle == conn_handle)) return i; return -1; }
+
+    //Where the Tympan's outgoing data goes: BLE_CONN_TARGET_ALL or one slot.  setTarget() returns 0 if OK or -1 if
+    //the slot is out of range.  (The slot does not have to be connected yet.)
+    int getTarget(void) { return target; }
+    int setTarget(const int _target) { if ((_target < BLE_CONN_TARGET_ALL) || (_target >= BLE_MAX_CONNECTIONS)) return -1; target = _target; return 0; }
+
+    //One bit per slot, for the slots that are connected and targeted
+    uint8_t getTargetMask(void) {
+      uint8_t mask = 0;
+      for (int i=0; i < BLE_MAX_CONNECTIONS; i++) if (conns[i].connected && ((target == BLE_CONN_TARGET_ALL) || (target == i))) mask |= (1 << i);
+      return mask;
+    }
+    uint8_t getConnectedMask(void) { uint8_t mask = 0; for (int i=0; i < BLE_MAX_CONNECTIONS; i++) if (conns[i].connected) mask |= (1 << i); return mask; }
+
+    //The most data bytes that fit into one notification to every targeted connection (the smallest of their MTUs,
+    //less the 3-byte ATT header).  If none are connected, the largest that we allow.
+    int getMaxDataNBytes(void);
+
+    //per-connection counters.  Call from loop().
+    void countTx(const int slot, const size_t nbytes_sent) {
+      if ((slot < 0) || (slot >= BLE_MAX_CONNECTIONS)) return;
+      if (nbytes_sent == 0) { conns[slot].tx_failed++; return; }
+      conns[slot].tx_msgs++;  conns[slot].tx_bytes += nbytes_sent;
+    }
+    void countRx(const uint16_t conn_handle, const size_t nbytes) {
+      const int slot = getSlot(conn_handle);
+      if (slot < 0) return;
+      conns[slot].rx_msgs++;  conns[slot].rx_bytes += nbytes;
+    }
+
+    //Write the "GET CONNECTIONS" reply (see above) into text.  Returns the length.
+    int getReport(char *text, const int len_text);
+
+  private:
+    typedef struct {
+      volatile bool connected;
+      volatile uint16_t conn_handle;
+      uint32_t tx_msgs, tx_bytes, tx_failed, rx_msgs, rx_bytes;
+    } Conn_t;
+    Conn_t conns[BLE_MAX_CONNECTIONS];
+    int target = BLE_CONN_TARGET_ALL;
+
+    void resetCounters(const int slot) { Conn_t *c = &conns[slot]; c->tx_msgs = 0; c->tx_bytes = 0; c->tx_failed = 0; c->rx_msgs = 0; c->rx_bytes = 0; }
+};
+
+int BLE_Connections::onConnect(const uint16_t conn_handle) {
+  for (int i=0; i < BLE_MAX_CONNECTIONS; i++) {
+    if (!conns[i].connected) {
+      conns[i].conn_handle = conn_handle;
+      resetCounters(i);
+      conns[i].connected = true;  //last, so that loop() never sees a half-made slot
+      return i;
+    }
+  }
+  return -1;
+}
+
+int BLE_Connections::onDisconnect(const uint16_t conn_handle) {
+  const int slot = getSlot(conn_handle);
+  if (slot >= 0) conns[slot].connected = false;
+  return slot;
+}
+
+int BLE_Connections::getMaxDataNBytes(void) {
+  int max_nbytes = BLE_MAX_DATA_NBYTES;
+  const uint8_t mask = getTargetMask();
+  for (int i=0; i < BLE_MAX_CONNECTIONS; i++) {
+    if (!(mask & (1 << i))) continue;
+    BLEConnection* connection = Bluefruit.Connection(conns[i].conn_handle);
+    if (connection) max_nbytes = min(max_nbytes, (int)(connection->getMtu()) - 3);
+  }
+  return max_nbytes;
+}
+
+int BLE_Connections::getReport(char *text, const int len_text) {
+  int len = snprintf(text, len_text, "N=%d", getNConnected());
+  for (int i=0; (i < BLE_MAX_CONNECTIONS) && (len < len_text); i++) {
+    if (!conns[i].connected) continue;
+    const Conn_t *c = &conns[i];
+    BLEConnection* connection = Bluefruit.Connection(c->conn_handle);
+    len += snprintf(text + len, len_text - len, " %d:H=%u,MTU=%d,TX=%lu,%lu,%lu,RX=%lu,%lu", i, (unsigned int)c->conn_handle,
+      connection ? (int)connection->getMtu() : 0, (unsigned long)c->tx_msgs, (unsigned long)c->tx_bytes, (unsigned long)c->tx_failed,
+      (unsigned long)c->rx_msgs, (unsigned long)c->rx_bytes);
+  }
+  return min(len, len_text-1);
+}
+
+#endif
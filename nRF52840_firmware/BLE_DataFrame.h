@@ -0,0 +1,145 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to format the BLE data that the phone writes to us into the DATASTREAM
+// messages that go on to the Tympan (see globalWriteBleDataToTympan() in nRF52840_firmware.ino).
+//
+// The text part of each header ("BLEDATA s c ") is made once, for every characteristic, when the services begin
+// (see beginAllBleServices()).  Then, each message is written as three pieces (the header, the data bytes straight
+// from the caller, and the end character) so that the data bytes are never copied.
+//
+// There are two formats.  The Tympan picks one with "SET BLEDATAFORMAT=TEXT" (the default) or "=BINARY":
+//
+//   TEXT:    [0x02] [4-byte length] [0x03] "BLEDATA s c " [dddd] [0x04]
+//   BINARY:  [0x02] [3] [X] [Y] [N_LSB] [N_MSB] [0x03] [dddd] [0x04]
+//
+// For TEXT, the 4-byte length (little endian) counts the text and the data bytes.  The BINARY format is the same as
+// the binary frames that the Tympan sends to us (see AT_Processor.h), with a CMD of 3 (BLEDATA).  It has no text to
+// parse: X and Y are the service_id and char_id as single bytes and N is the number of data bytes.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_DATA_FRAME_H
+#define BLE_DATA_FRAME_H
+
+#include <Arduino.h>
+#include "BLE_Service_Preset.h"
+#include "BLE_Router.h"  //for BLE_ROUTER_MAX_SERVICE_ID
+
+#define BLE_DATA_FRAME_N_HEADERS 64      //how many characteristics (across all services) get a premade header
+#define BLE_DATA_FRAME_TEXT_NBYTES 14    //longest text part of a header: "BLEDATA 15 99 "
+#define BLE_DATA_FRAME_BINARY_CMD 3      //follows WRITE (1) and NOTIFY (2) in AT_Processor::BLECOMMAND
+
+class BLE_DataFrame {
+  public:
+    enum FORMAT { FORMAT_TEXT = 0, FORMAT_BINARY };
+
+    BLE_DataFrame(void) { clear(); }
+
+    void clear(void) {
+      n_headers = 0;
+      for (int i=0; i < BLE_ROUTER_MAX_SERVICE_ID; i++) { first_header[i] = 0; n_chars[i] = 0; }
+    }
+
+    //Make the headers for all of the characteristics of a service.  Returns 0 if OK or -1 if there is no more room
+    //(those characteristics still work, their headers are just made on the fly).
+    int addService(BLE_Service_Preset *service_ptr);
+
+    int getFormat(void) { return format; }
+    void setFormat(const int _format) { format = _format; }
+
+    //Write one message to dest.  Returns the number of bytes written.
+    size_t write(Print *dest, const int service_id, const int char_id, const uint8_t data[], const size_t len);
+
+    //Write an unsolicited text message (such as "CREDIT N") to dest, framed like a TEXT BLEDATA message.  Returns the
+    //number of bytes written.
+    static size_t writeText(Print *dest, const char *text);
+
+  private:
+    int format = FORMAT_TEXT;
+
+    typedef struct {
+      uint8_t len;
+      char text[BLE_DATA_FRAME_TEXT_NBYTES];
+    } Header_t;
+    Header_t headers[BLE_DATA_FRAME_N_HEADERS];
+    int n_headers = 0;
+    uint8_t first_header[BLE_ROUTER_MAX_SERVICE_ID];  //index into headers[] for each service_id
+    uint8_t n_chars[BLE_ROUTER_MAX_SERVICE_ID];       //how many of the service's characteristics have a header
+
+    static int makeHeaderText(char *text, const int service_id, const int char_id);
+};
+
+int BLE_DataFrame::addService(BLE_Service_Preset *service_ptr) {
+  if (service_ptr == nullptr) return -1;
+  const int service_id = service_ptr->service_id;
+  if ((service_id < 0) || (service_id >= BLE_ROUTER_MAX_SERVICE_ID)) return -1;
+
+  const int n_wanted = service_ptr->getNCharacteristics();
+  const int n_added = min(n_wanted, BLE_DATA_FRAME_N_HEADERS - n_headers);
+  first_header[service_id] = n_headers;  n_chars[service_id] = n_added;
+  for (int char_id=0; char_id < n_added; char_id++) {
+    Header_t *header = &headers[n_headers++];
+    header->len = makeHeaderText(header->text, service_id, char_id);
+  }
+  return (n_added < n_wanted) ? -1 : 0;
+}
+
+//write "BLEDATA s c " into text (which must have room for BLE_DATA_FRAME_TEXT_NBYTES).  Returns the length.
+int BLE_DataFrame::makeHeaderText(char *text, const int service_id, const int char_id) {
+  const int len = snprintf(text, BLE_DATA_FRAME_TEXT_NBYTES+1, "BLEDATA %d %d ", service_id, char_id);
+  return min(len, BLE_DATA_FRAME_TEXT_NBYTES);
+}
+
+size_t BLE_DataFrame::write(Print *dest, const int service_id, const int char_id, const uint8_t data[], const size_t len) {
+  if (len <= 0) return 0;
+
+  uint8_t head[1+4+1+BLE_DATA_FRAME_TEXT_NBYTES];
+  int head_len = 0;
+  head[head_len++] = DATASTREAM_START_CHAR;
+  if (format == FORMAT_BINARY) {
+    head[head_len++] = BLE_DATA_FRAME_BINARY_CMD;
+    head[head_len++] = (uint8_t)service_id;
+    head[head_len++] = (uint8_t)char_id;
+    head[head_len++] = (uint8_t)(0x00FF & len);  head[head_len++] = (uint8_t)(0x00FF & (len >> 8));  //little endian
+    head[head_len++] = DATASTREAM_SEPARATOR;
+  } else {
+    //use the premade text, if there is one
+    char made_text[BLE_DATA_FRAME_TEXT_NBYTES+1];
+    const char *text;  int text_len;
+    if ((service_id >= 0) && (service_id < BLE_ROUTER_MAX_SERVICE_ID) && (char_id >= 0) && (char_id < n_chars[service_id])) {
+      const Header_t *header = &headers[first_header[service_id] + char_id];
+      text = header->text;  text_len = header->len;
+    } else {
+      text_len = makeHeaderText(made_text, service_id, char_id);  text = made_text;
+    }
+
+    const uint32_t tot_len = text_len + len;
+    for (int i=0; i<4; i++) head[head_len++] = (uint8_t)(0x000000FF & (tot_len >> (i*8)));  //little endian
+    head[head_len++] = DATASTREAM_SEPARATOR;
+    memcpy(head + head_len, text, text_len);  head_len += text_len;
+  }
+
+  //send the pieces.  The data goes straight from the caller's buffer.
+  size_t n_written = dest->write(head, head_len);
+  n_written += dest->write(data, len);
+  n_written += dest->write((uint8_t)DATASTREAM_END_CHAR);
+  return n_written;
+}
+
+size_t BLE_DataFrame::writeText(Print *dest, const char *text) {
+  const uint32_t len_text = strlen(text);
+  uint8_t head[1+4+1];
+  int head_len = 0;
+  head[head_len++] = DATASTREAM_START_CHAR;
+  for (int i=0; i<4; i++) head[head_len++] = (uint8_t)(0x000000FF & (len_text >> (i*8)));  //little endian
+  head[head_len++] = DATASTREAM_SEPARATOR;
+
+  size_t n_written = dest->write(head, head_len);
+  n_written += dest->write((const uint8_t *)text, len_text);
+  n_written += dest->write((uint8_t)DATASTREAM_END_CHAR);
+  return n_written;
+}
+
+#endif
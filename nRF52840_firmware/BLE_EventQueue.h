@@ -0,0 +1,145 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to get the slow work out of the BLE callbacks.  The callbacks (connect,
+// disconnect, and characteristic writes) only push a small record of the event into this queue.  Any data that came
+// with the event is copied into a preallocated pool.  Then, loop() pops the events and does the real work, such as
+// forwarding the data to the Tympan over the UART and printing debugging text.  So, a slow UART can never hold up
+// the BLE stack.
+//
+// The queue is lock-free for a single producer and a single consumer.  The consumer is loop().  The producer must be
+// ONE task: the one where Adafruit runs the connect, disconnect, and characteristic write callbacks (it hands them to
+// its callback task via ada_callback()).  Do NOT push from a callback set by Bluefruit.setEventCallback(), which runs
+// in the SoftDevice's own task.  Use an atomic flag there instead (see ble_event_callback() in BLE_Stuff.h).  To
+// catch a second producer, the first push claims the queue for its task, and any push from another task is refused
+// and counted (see getNWrongTask()).
+//
+// If the queue (or the pool) is full, the event is dropped and counted.  The last few slots are kept for the events that
+// are not writes (connect, disconnect, etc), so a burst of writes from the phone can never push those out.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_EVENT_QUEUE_H
+#define BLE_EVENT_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "BLE_Service_Preset.h"  //for BLE_MAX_DATA_NBYTES
+
+#define BLE_EVENT_QUEUE_N_EVENTS 32        //must be a power of two
+#define BLE_EVENT_QUEUE_N_RESERVED 4       //slots that writes cannot use, so that they can't push out the other events
+#define BLE_EVENT_POOL_NBYTES 2048         //for the data that comes with write events.  Must be a power of two.
+#define BLE_EVENT_MAX_DATA_NBYTES BLE_MAX_DATA_NBYTES  //longer writes are dropped
+#define BLE_EVENT_QUEUE_CHECK_TASK 1       //refuse pushes from any task but the first (see above)
+static_assert((BLE_EVENT_QUEUE_N_EVENTS & (BLE_EVENT_QUEUE_N_EVENTS-1)) == 0, "BLE_EVENT_QUEUE_N_EVENTS must be a power of two");
+static_assert((BLE_EVENT_POOL_NBYTES & (BLE_EVENT_POOL_NBYTES-1)) == 0, "BLE_EVENT_POOL_NBYTES must be a power of two");
+
+enum BLE_EVENT_TYPE { BLE_EVENT_TYPE_CONNECT = 1, BLE_EVENT_TYPE_DISCONNECT, BLE_EVENT_TYPE_WRITE };
+
+typedef struct {
+  uint8_t type;           //see BLE_EVENT_TYPE
+  uint8_t reason;         //for BLE_EVENT_TYPE_DISCONNECT, the BLE_HCI_STATUS_CODE
+  int8_t service_id;      //for BLE_EVENT_TYPE_WRITE
+  int8_t char_id;         //for BLE_EVENT_TYPE_WRITE
+  uint16_t conn_handle;
+  uint16_t len;           //for BLE_EVENT_TYPE_WRITE, the number of data bytes
+  uint32_t data_start;    //where the data bytes start in the pool (not yet wrapped)
+} BLE_Event_t;
+
+class BLE_EventQueue {
+  public:
+    BLE_EventQueue(void) {}
+
+    //Producer side (the BLE callbacks, all from the same task.  See above).  Returns false if the event had to be
+    //dropped.
+    bool push(const uint8_t type, const uint16_t conn_handle, const int service_id, const int char_id, const uint8_t reason, const uint8_t *data, const uint16_t len);
+
+    //Consumer side (loop()).  Returns false if there are no events.  Otherwise, fills in evt and copies its data
+    //bytes (if any) into data, which must have room for BLE_EVENT_MAX_DATA_NBYTES.
+    bool pop(BLE_Event_t *evt, uint8_t *data);
+
+    uint32_t getNDropped(void) { return n_dropped; }
+    uint32_t getNWrongTask(void) { return n_wrong_task; }  //pushes refused because they came from a second producer
+
+  private:
+    BLE_Event_t events[BLE_EVENT_QUEUE_N_EVENTS];
+    uint8_t pool[BLE_EVENT_POOL_NBYTES];
+
+    //These only ever count up (and wrap at 2^32).  Mask them to index into events[] or pool[].  The "write" indices
+    //are only changed by the producer and the "read" indices are only changed by the consumer.
+    std::atomic<uint32_t> event_write{0}, event_read{0};
+    std::atomic<uint32_t> pool_read{0};
+    uint32_t pool_write = 0;  //only the producer needs this one
+    volatile uint32_t n_dropped = 0;  //only written by the producer
+    volatile uint32_t n_wrong_task = 0;
+    TaskHandle_t producer_task = nullptr;  //claimed by the first push
+
+    bool isProducerTask(void);
+
+    void copyIntoPool(const uint32_t start, const uint8_t *data, const uint16_t len);
+    void copyOutOfPool(const uint32_t start, uint8_t *data, const uint16_t len);
+};
+
+bool BLE_EventQueue::push(const uint8_t type, const uint16_t conn_handle, const int service_id, const int char_id, const uint8_t reason, const uint8_t *data, const uint16_t len) {
+  //only one task can push, or two could claim the same slot
+  if (!isProducerTask()) { n_wrong_task++; n_dropped++; return false; }
+
+  //is there room in the queue?
+  const uint32_t ew = event_write.load(std::memory_order_relaxed);
+  const uint32_t n_events_allowed = BLE_EVENT_QUEUE_N_EVENTS - ((type == BLE_EVENT_TYPE_WRITE) ? BLE_EVENT_QUEUE_N_RESERVED : 0);
+  if ((ew - event_read.load(std::memory_order_acquire)) >= n_events_allowed) { n_dropped++; return false; }
+
+  //is there room in the pool?
+  if (len > BLE_EVENT_MAX_DATA_NBYTES) { n_dropped++; return false; }
+  if ((pool_write - pool_read.load(std::memory_order_acquire) + len) > BLE_EVENT_POOL_NBYTES) { n_dropped++; return false; }
+
+  //fill in the event and its data.  Then, publish it.
+  BLE_Event_t *evt = &events[ew & (BLE_EVENT_QUEUE_N_EVENTS-1)];
+  evt->type = type;  evt->reason = reason;  evt->conn_handle = conn_handle;
+  evt->service_id = (int8_t)service_id;  evt->char_id = (int8_t)char_id;
+  evt->len = len;  evt->data_start = pool_write;
+  if (len > 0) copyIntoPool(pool_write, data, len);
+  pool_write += len;
+  event_write.store(ew + 1, std::memory_order_release);
+  return true;
+}
+
+bool BLE_EventQueue::pop(BLE_Event_t *evt, uint8_t *data) {
+  const uint32_t er = event_read.load(std::memory_order_relaxed);
+  if (er == event_write.load(std::memory_order_acquire)) return false;  //empty
+
+  //copy the event and its data.  Then, free them.
+  *evt = events[er & (BLE_EVENT_QUEUE_N_EVENTS-1)];
+  if (evt->len > 0) copyOutOfPool(evt->data_start, data, evt->len);
+  pool_read.store(evt->data_start + evt->len, std::memory_order_release);
+  event_read.store(er + 1, std::memory_order_release);
+  return true;
+}
+
+bool BLE_EventQueue::isProducerTask(void) {
+#if BLE_EVENT_QUEUE_CHECK_TASK
+  const TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  if (producer_task == nullptr) producer_task = task;  //the first push claims the queue
+  return (task == producer_task);
+#else
+  return true;
+#endif
+}
+
+//the data might wrap around the end of the pool, so it takes up to two copies
+void BLE_EventQueue::copyIntoPool(const uint32_t start, const uint8_t *data, const uint16_t len) {
+  const uint32_t ind = start & (BLE_EVENT_POOL_NBYTES-1);
+  const uint32_t n_first = min((uint32_t)len, BLE_EVENT_POOL_NBYTES - ind);
+  memcpy(&pool[ind], data, n_first);
+  if (n_first < len) memcpy(&pool[0], data + n_first, len - n_first);
+}
+
+void BLE_EventQueue::copyOutOfPool(const uint32_t start, uint8_t *data, const uint16_t len) {
+  const uint32_t ind = start & (BLE_EVENT_POOL_NBYTES-1);
+  const uint32_t n_first = min((uint32_t)len, BLE_EVENT_POOL_NBYTES - ind);
+  memcpy(data, &pool[ind], n_first);
+  if (n_first < len) memcpy(data + n_first, &pool[0], len - n_first);
+}
+
+#endif
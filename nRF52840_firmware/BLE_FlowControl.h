@@ -0,0 +1,97 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to keep the Tympan from sending BLE data faster than the connection can carry
+// it.  It is credit-based flow control for the wired link.  It is off unless the Tympan sends "SET FLOWCONTROL=ON".
+//
+// Each credit is one BLE notification packet.  The nRF only hands out as many credits as it has room for: the free
+// slots in the TX queue (see BLE_TxQueue.h) plus the free notification buffers in the SoftDevice.  Sending data
+// costs credits:
+//
+//    BLENOTIFY (or a binary NOTIFY frame):  1 credit
+//    SEND with N data bytes:                (N + P - 1) / P credits, where P is "GET MTU" minus 3
+//    BLEWRITE (or a binary WRITE frame):    free (it only changes the local value, nothing is sent)
+//
+// As the phone acknowledges packets, the room is free again, so the nRF gives those credits back to the Tympan via
+// an unsolicited DATASTREAM message (same framing as the BLEDATA messages, see nRF52840_firmware.ino):
+//
+//    [0x02] [4-byte length] [0x03] "CREDIT N" [0x04]
+//
+// where N is the number of *additional* credits.  The Tympan adds N to its count and subtracts the cost of each
+// message that it sends.  On "SET FLOWCONTROL=ON", the Tympan starts from zero and is sent a CREDIT message for all
+// of the free room.  If the Tympan sends without enough credit, the message is not sent and the reply is FAIL.  A
+// notification that replaces an unsent value (see "latest value wins" in BLE_TxQueue.h) takes no room, so its
+// credit comes right back.  "GET CREDITS" replies with how many credits the nRF thinks that the Tympan holds (in
+// case they get out of sync).
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_FLOW_CONTROL_H
+#define BLE_FLOW_CONTROL_H
+
+#include <Arduino.h>
+#include "BLE_TxQueue.h"
+#include "BLE_DataFrame.h"
+
+//the most credits that the Tympan can hold
+#define FLOW_CONTROL_N_CREDITS (BLE_TX_QUEUE_N_ENTRIES + BLE_HVN_QUEUE_SIZE)
+
+extern int getMaxBleDataNBytes(void);
+
+class BLE_FlowControl {
+  public:
+    BLE_FlowControl(BLE_TxQueue *_tx_queue) : tx_queue(_tx_queue) {}
+
+    bool isEnabled(void) { return enabled; }
+    void enable(bool _enable) { enabled = _enable; credits_held = 0; }  //the Tympan starts from zero credits
+    int getCreditsHeld(void) { return credits_held; }
+    unsigned long getOverrunCount(void) { return n_overruns; }
+
+    //how many credits it costs to send the given number of data bytes as a SEND (via the UART services)
+    static int creditsForSend(const int nbytes) {
+      const int packet_nbytes = max(1, getMaxBleDataNBytes());
+      return max(1, (nbytes + packet_nbytes - 1) / packet_nbytes);
+    }
+
+    //Call before sending anything for the Tympan.  Returns false if the Tympan does not have enough credit (in
+    //which case, don't send it).  Always returns true if flow control is off.
+    bool spendCredits(const int n_credits) {
+      if (!enabled) return true;
+      if (credits_held < n_credits) { n_overruns++; return false; }
+      credits_held -= n_credits;
+      return true;
+    }
+
+    //Call from loop(), after servicing the TX queue.  Gives the Tympan any credits that are available.  Returns how
+    //many credits were given.
+    int service(Print *dest);
+
+  private:
+    BLE_TxQueue *tx_queue;
+    bool enabled = false;
+    int credits_held = 0;       //credits that the Tympan holds (as far as we know)
+    unsigned long n_overruns = 0;  //messages from the Tympan that were refused because it had no credit
+
+    size_t writeCreditMessage(Print *dest, const int n_credits);
+};
+
+int BLE_FlowControl::service(Print *dest) {
+  if (!enabled) return 0;
+
+  //hand out any free room as credits
+  const int n_credits = FLOW_CONTROL_N_CREDITS - credits_held - tx_queue->getNPending();
+  if (n_credits <= 0) return 0;
+  credits_held += n_credits;
+  writeCreditMessage(dest, n_credits);
+  return n_credits;
+}
+
+//write "CREDIT N" as a DATASTREAM message.  Returns the number of bytes written.
+size_t BLE_FlowControl::writeCreditMessage(Print *dest, const int n_credits) {
+  char text[7+11+1];  //"CREDIT ", any int, and the null
+  snprintf(text, sizeof(text), "CREDIT %d", n_credits);
+  return BLE_DataFrame::writeText(dest, text);
+}
+
+#endif
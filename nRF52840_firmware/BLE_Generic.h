@@ -19,8 +19,14 @@
 
 #include <bluefruit.h>
 #include "BLE_Service_Preset.h"
+#include "BLE_Router.h"
+#include "BLE_EventQueue.h"
+#include "BLE_Profile.h"
 #include <vector>
 
+extern BLE_Router ble_router;
+extern BLE_EventQueue ble_event_queue;
+
 //types to help setup a generic BLE service
 typedef struct { 
   uint8_t uuid[16] = {0}; //store UUID bytes in reverse order
@@ -28,9 +34,10 @@ typedef struct {
   } UUID_t;  
 typedef struct {
   UUID_t uuid;
-  uint8_t n_bytes = 1; //bytes to be transmitted via this characteristic.  1 to 4?  more?
+  uint16_t n_bytes = 1; //bytes to be transmitted via this characteristic.  1 to BLE_MAX_DATA_NBYTES
   uint8_t props = CHR_PROPS_NOTIFY | CHR_PROPS_READ | CHR_PROPS_WRITE;  //see Adafruit nRF52 library for all options
   String name;
+  bool latest_value_wins = false;  //see BLE_Service_Preset::isLatestValueWins()
 } BLE_CHAR_t;
 
 class BLE_GenericService : public virtual BLE_Service_Preset {
@@ -49,10 +56,10 @@ class BLE_GenericService : public virtual BLE_Service_Preset {
       }
 
       //delete all characteristics
-      for (auto i=characteristic_ptr_table.size()-1; i >= 0; --i) delete characteristic_ptr_table[i];
+      for (auto ptr : characteristic_ptr_table) delete ptr;
 
       //delete characteristic info
-      for (auto i=characteristic_info_table.size()-1; i>=0; --i) delete characteristic_info_table[i];
+      for (auto ptr : characteristic_info_table) delete ptr;
 
       //delete other pointers
       delete this_service;
@@ -96,17 +103,39 @@ class BLE_GenericService : public virtual BLE_Service_Preset {
       return (err_t)0;  //no error
     }
 
-    virtual err_t setCharacteristicNBytes(const int char_id, uint8_t new_nbytes) {
+    virtual err_t setCharacteristicNBytes(const int char_id, uint16_t new_nbytes) {
       if (char_id >= characteristic_info_table.size()) return (err_t)1;  //given char_id doesn't exist
+      if ((new_nbytes < 1) || (new_nbytes > BLE_MAX_DATA_NBYTES)) return (err_t)2;  //must fit in one notification
       characteristic_info_table[char_id]->n_bytes = new_nbytes;
       return (err_t)0;  //no error     
     }
-    
+
+    virtual err_t setCharacteristicLatestValueWins(const int char_id, const bool latest_value_wins) {
+      if (char_id >= characteristic_info_table.size()) return (err_t)1;  //given char_id doesn't exist
+      characteristic_info_table[char_id]->latest_value_wins = latest_value_wins;
+      return (err_t)0;  //no error
+    }
+
+    bool isLatestValueWins(const int char_id) override {
+      if ((char_id < 0) || (char_id >= characteristic_info_table.size())) return false;
+      return characteristic_info_table[char_id]->latest_value_wins;
+    }
 
     err_t begin(int id) override;
 
+    //Save this service's setup (UUID, name, and characteristics) into a profile, or set it up from one.  Like the
+    //other setup methods, readProfile() must be called before begin().  Returns 0 if OK or 1 if the profile ran out.
+    void writeProfile(BLE_Profile &profile);
+    err_t readProfile(BLE_Profile &profile);
+
     BLEService* getServiceToAdvertise(void) override { return this_service;  }
 
+    int getNCharacteristics(void) override { return (int)characteristic_ptr_table.size(); }
+    BLECharacteristic* getCharacteristic(const int char_id) override { 
+      if ((char_id < 0) || (char_id >= (int)characteristic_ptr_table.size())) return nullptr;
+      return characteristic_ptr_table[char_id];
+    }
+
     size_t write(const int char_id, const uint8_t* data, size_t len) override {
       //reverse the bytes
       //uint8_t rev_data[len];
@@ -201,48 +230,56 @@ err_t BLE_GenericService::begin(int id) {  //err_t is inhereted from bluefruit.h
   return (err_t)0;
 }
 
-//this callback happens when data is received rom the remote device (mobile phone) here at the nRF52840 module
+void BLE_GenericService::writeProfile(BLE_Profile &profile) {
+  profile.putU8(is_service_uuid_specified ? 1 : 0);
+  profile.putBytes(ServiceUUID.uuid, 16);
+  profile.putString(name.c_str());
+  profile.putU8((uint8_t)characteristic_info_table.size());
+  for (auto i=0; i<characteristic_info_table.size(); ++i) {
+    const BLE_CHAR_t *char_info = characteristic_info_table[i];
+    profile.putBytes(char_info->uuid.uuid, 16);
+    profile.putU16(char_info->n_bytes);
+    profile.putU8(char_info->props);
+    profile.putU8(char_info->latest_value_wins ? 1 : 0);
+    profile.putString(char_info->name.c_str());
+  }
+}
+
+err_t BLE_GenericService::readProfile(BLE_Profile &profile) {
+  char str[BLE_PROFILE_MAX_STRING_NBYTES+1];
+  UUID_t uuid;
+
+  const bool has_uuid = (profile.getU8() != 0);
+  profile.getBytes(uuid.uuid, 16);
+  if (has_uuid) setServiceUUID(uuid);
+  profile.getString(str, sizeof(str));  setServiceName(String(str));
+
+  //replace any characteristics that were already defined
+  for (auto i=0; i<characteristic_info_table.size(); ++i) delete characteristic_info_table[i];
+  characteristic_info_table.clear();
+  const int n_chars = profile.getU8();
+  for (int char_id=0; (char_id < n_chars) && profile.isOK(); ++char_id) {
+    profile.getBytes(uuid.uuid, 16);
+    if (addCharacteristic(uuid) != 0) return (err_t)1;
+    setCharacteristicNBytes(char_id, profile.getU16());
+    setCharacteristicProps(char_id, profile.getU8());
+    setCharacteristicLatestValueWins(char_id, (profile.getU8() != 0));
+    profile.getString(str, sizeof(str));  setCharacteristicName(char_id, String(str));
+  }
+  return profile.isOK() ? (err_t)0 : (err_t)1;
+}
+
+//this callback happens when data is received rom the remote device (mobile phone) here at the nRF52840 module.
+//It runs in the BLE task, so it only queues up the data.  It is printed and sent to the Tympan from loop() (see
+//serviceBleEvents() in BLE_Stuff.h).
 void BLE_GenericService::write_callback(uint16_t conn_hdl, BLECharacteristic* chr, uint8_t* data, uint16_t len)
 {
   int service_id = -1, char_id = -1;
 
-  //find matching service UUID in the static table
-  BLEService* svc= &chr->parentService();
-  for (size_t I = 0; I < self_ptr_table.size(); ++I) {  //self_ptr_table is a static member of this class, so can be accessed by this static method
-    if (((self_ptr_table[I])->this_service)->uuid == svc->uuid) {
-      //found the service pointer
-
-      //Now, find matching chracteristic UUID in its table of characteristic ids
-      BLE_GenericService* foo_ble_svc_ptr = self_ptr_table[I];
-      service_id = foo_ble_svc_ptr->service_id;
-      for (size_t J=0; J < foo_ble_svc_ptr->characteristic_ptr_table.size(); ++J) {
-        if ((foo_ble_svc_ptr->characteristic_ptr_table[J])->uuid == chr->uuid) {
-          char_id = J;
-        }
-      }
-      break;
-    }
-  }
-
-  #if DEBUG_VIA_USB
-    Serial.print(F("BLE_Generic: write_callback: "));
-    Serial.print(" Rcvd data (len = " + String(len) + "): ");
-    for (uint16_t i=0; i<len; ++i) {Serial.print("0x"); Serial.print(data[i],HEX); Serial.print(" ");}
-    if (service_id >= 0) { 
-      Serial.print(", from service_id: " + String(service_id));
-    } else {
-      Serial.print(F(", from service UUID: ")); Serial.print(svc->uuid.toString());
-    }
-    if (char_id >= 0) {
-      Serial.print(", from char_id: " + String(char_id));
-    } else {
-      Serial.print(F(", from char UUID: ")); Serial.print(chr->uuid.toString());
-    }
-    Serial.println();
-  #endif
+  //look up which service and characteristic this is (see BLE_Router.h)
+  ble_router.findCharacteristic(chr, &service_id, &char_id);
 
-  //push the data to the Tympan
-  if ((service_id >= 0) && (char_id >= 0)) writeBleDataToTympan(service_id, char_id, data, len); //part of BLEServicePreset
+  ble_event_queue.push(BLE_EVENT_TYPE_WRITE, conn_hdl, service_id, char_id, 0, data, len);
 }
 
 #endif
\ No newline at end of file
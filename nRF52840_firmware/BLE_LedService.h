@@ -13,9 +13,14 @@
 
 #include <bluefruit.h>
 #include "BLE_Service_Preset.h"
+#include "BLE_Router.h"
+#include "BLE_EventQueue.h"
 //include <functional>
 #include <vector>
 
+extern BLE_Router ble_router;
+extern BLE_EventQueue ble_event_queue;
+
 class BLE_LedButtonService : public virtual BLE_Service_Preset {
   public:
     BLE_LedButtonService(void) : BLE_Service_Preset() {
@@ -120,6 +125,12 @@ class BLE_LedButtonService : public virtual BLE_Service_Preset {
       return 0;
     }
 
+    int getNCharacteristics(void) override { return (int)characteristic_ptr_table.size(); }
+    BLECharacteristic* getCharacteristic(const int char_id) override { 
+      if ((char_id < 0) || (char_id >= (int)characteristic_ptr_table.size())) return nullptr;
+      return characteristic_ptr_table[char_id];
+    }
+
     static void led_write_callback(uint16_t conn_hdl, BLECharacteristic* chr, uint8_t* data, uint16_t len);
 
         
@@ -218,6 +229,9 @@ class BLE_LedButtonService_4bytes : public virtual BLE_LedButtonService {
       return return_val;
     };
 
+    //the two 4-byte notify channels carry values to display, so only the latest value matters
+    bool isLatestValueWins(const int char_id) override { return ((char_id == 0) || (char_id == 1)); }
+
     const uint8_t LBS_UUID_CHR_STARTBUTTON[16] = //reverse order  of '00001526-1212-EFDE-1523-785FEABCD123'
     {
       0x23, 0xD1, 0xBC, 0xEA, 0x5F, 0x78, 0x23, 0x15,
@@ -231,45 +245,16 @@ class BLE_LedButtonService_4bytes : public virtual BLE_LedButtonService {
 };
 
 
+//runs in the BLE task, so it only queues up the data.  It is printed and sent to the Tympan from loop() (see
+//serviceBleEvents() in BLE_Stuff.h).
 void BLE_LedButtonService::led_write_callback(uint16_t conn_hdl, BLECharacteristic* chr, uint8_t* data, uint16_t len)
 {
   int service_id = -1, char_id = -1;
 
-  //find matching service UUID in the static table
-  BLEService* svc= &chr->parentService();
-  for (size_t I = 0; I < BLE_LedButtonService::self_ptr_table.size(); ++I) {
-    if (((BLE_LedButtonService::self_ptr_table[I])->lbs)->uuid == svc->uuid) {
-      //found the service pointer
-
-      //Now, find matching chracteristic UUID in its table of characteristic ids
-      BLE_LedButtonService* foo_ble_svc_ptr = BLE_LedButtonService::self_ptr_table[I];
-      service_id = foo_ble_svc_ptr->service_id;
-      for (size_t J=0; J < foo_ble_svc_ptr->characteristic_ptr_table.size(); ++J) {
-        if ((foo_ble_svc_ptr->characteristic_ptr_table[J])->uuid == chr->uuid) {
-          char_id = J;
-        }
-      }
-      break;
-    }
-  }
-
-  Serial.print("BLE_LedService: led_write_callback:");
-  Serial.print(" Recevied value = " + String(data[0]));
-  //Serial.print(", from: "); Serial.print(central_name);
-  if (service_id >= 0) { 
-    Serial.print(", from service_id: " + String(service_id));
-  } else {
-    Serial.print(", from service UUID: " ); Serial.print(svc->uuid.toString());
-  }
-  if (char_id >= 0) {
-    Serial.print(", from char_id: " + String(char_id));
-  } else {
-    Serial.print(", from char UUID: "); Serial.print(chr->uuid.toString());
-  }
-  Serial.println();
-
-  //push the data to the Tympan
-  if ((service_id >= 0) && (char_id >= 0)) BLE_Service_Preset::writeBleDataToTympan(service_id, char_id, data, len);
+  //look up which service and characteristic this is (see BLE_Router.h)
+  ble_router.findCharacteristic(chr, &service_id, &char_id);
+
+  ble_event_queue.push(BLE_EVENT_TYPE_WRITE, conn_hdl, service_id, char_id, 0, data, len);
 }
 
 
@@ -0,0 +1,176 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to let the Tympan ask for the BLE link parameters that it wants (PHY, ATT MTU,
+// connection interval, slave latency, and supervision timeout) and to tell the Tympan what the phone agreed to.
+// Our streaming throughput depends almost entirely on these, and different phones negotiate very differently.
+//
+// The Tympan sets its preferences with these messages (see AT_Processor.h):
+//
+//    SET PHY=1M, 2M, CODED, or AUTO
+//    SET MTU=n           23 to 247 bytes.  A data length update (DLE) is requested at the same time.
+//    SET CONNINTERVAL=n  in units of 1.25 msec (6 to 3200)
+//    SET LATENCY=n       in connection events (0 to 499)
+//    SET SUPTIMEOUT=n    in units of 10 msec (10 to 3200)
+//
+// If connected, each preference is requested right away.  Either way, they are requested again at every new
+// connection.  The phone has the final say.  "GET PHY" (etc) replies with the value in use on the current
+// connection (or with the preference, if not connected).  Zero means "no preference".  "GET MTU" is unchanged: it
+// replies with the MTU in use (or the largest that we allow, if not connected).
+//
+// Whenever the phone agrees to something new (at connection, or after a PHY, MTU, data length, or connection
+// parameter update), the nRF tells the Tympan via an unsolicited DATASTREAM message (same framing as the CREDIT
+// messages, see BLE_FlowControl.h):
+//
+//    "LINK PHY=2M MTU=247 DLE=251 CI=24 LAT=0 TO=400"
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_LINK_PARAMS_H
+#define BLE_LINK_PARAMS_H
+
+#include <bluefruit.h>
+#include "BLE_DataFrame.h"  //for writeText()
+
+#define BLE_LINK_MIN_MTU BLE_GATT_ATT_MTU_DEFAULT   //23
+#define BLE_LINK_MAX_MTU 247                        //what Bluefruit.configPrphBandwidth(BANDWIDTH_MAX) allows
+#define BLE_LINK_MIN_CONN_INTERVAL 6                //7.5 msec
+#define BLE_LINK_MAX_CONN_INTERVAL 3200             //4 sec
+#define BLE_LINK_MAX_LATENCY 499
+#define BLE_LINK_MIN_SUP_TIMEOUT 10                 //100 msec
+#define BLE_LINK_MAX_SUP_TIMEOUT 3200               //32 sec
+
+class BLE_LinkParams {
+  public:
+    BLE_LinkParams(void) {}
+
+    //Set a preference (and request it now, if connected).  Returns 0 if OK, -1 if the value is out of range, or -2
+    //if the request to the SoftDevice failed.
+    int setPhy(const uint8_t phy);   //BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS, BLE_GAP_PHY_CODED, or BLE_GAP_PHY_AUTO
+    int setMtu(const int mtu);
+    int setConnInterval(const int interval);
+    int setLatency(const int latency);
+    int setSupTimeout(const int timeout);
+
+    //Whether a value is in range, without setting it (such as when a batch is checked, see AT_Processor.h)
+    static bool isValidMtu(const int mtu)               { return (mtu >= BLE_LINK_MIN_MTU) && (mtu <= BLE_LINK_MAX_MTU); }
+    static bool isValidConnInterval(const int interval) { return (interval >= BLE_LINK_MIN_CONN_INTERVAL) && (interval <= BLE_LINK_MAX_CONN_INTERVAL); }
+    static bool isValidLatency(const int latency)       { return (latency >= 0) && (latency <= BLE_LINK_MAX_LATENCY); }
+    static bool isValidSupTimeout(const int timeout)    { return (timeout >= BLE_LINK_MIN_SUP_TIMEOUT) && (timeout <= BLE_LINK_MAX_SUP_TIMEOUT); }
+
+    //The value in use on the current connection or, if not connected, the preference
+    int getPhy(void)          { BLEConnection *conn = getConnection(); return conn ? conn->getPHY() : pref_phy; }
+    int getConnInterval(void) { BLEConnection *conn = getConnection(); return conn ? conn->getConnectionInterval() : pref_interval; }
+    int getLatency(void)      { BLEConnection *conn = getConnection(); return conn ? conn->getSlaveLatency() : pref_latency; }
+    int getSupTimeout(void)   { BLEConnection *conn = getConnection(); return conn ? conn->getSupervisionTimeout() : pref_timeout; }
+    static const char* phyName(const int phy);
+
+    //Call from loop() (not from the BLE callbacks).  onConnect() requests all of the preferences from the phone.
+    //With several phones connected, the newest one is the one that is followed (see BLE_Connections.h).
+    void onConnect(const uint16_t _conn_handle) { conn_handle = _conn_handle; connected = true; last_report[0] = '\0'; requestAll(); }
+    void onDisconnect(const uint16_t _conn_handle) { if (_conn_handle == conn_handle) connected = false; }
+
+    //Call from loop() after a connection or a link update.  If anything has changed since the last report, tell the
+    //Tympan.  Returns the number of bytes written.
+    size_t report(Print *dest);
+
+  private:
+    uint8_t pref_phy = BLE_GAP_PHY_AUTO;
+    int pref_mtu = 0, pref_interval = 0, pref_latency = 0, pref_timeout = 0;  //0 is no preference (except for latency)
+    bool latency_was_set = false;
+
+    uint16_t conn_handle = 0;
+    bool connected = false;
+    char last_report[64] = { 0 };
+
+    BLEConnection* getConnection(void) { return connected ? Bluefruit.Connection(conn_handle) : nullptr; }
+    int requestAll(void);
+    int requestConnParams(void);
+};
+
+int BLE_LinkParams::setPhy(const uint8_t phy) {
+  if ((phy != BLE_GAP_PHY_AUTO) && (phy != BLE_GAP_PHY_1MBPS) && (phy != BLE_GAP_PHY_2MBPS) && (phy != BLE_GAP_PHY_CODED)) return -1;
+  pref_phy = phy;
+  BLEConnection *conn = getConnection();
+  if (conn && !conn->requestPHY(pref_phy)) return -2;
+  return 0;
+}
+
+int BLE_LinkParams::setMtu(const int mtu) {
+  if (!isValidMtu(mtu)) return -1;
+  pref_mtu = mtu;
+  BLEConnection *conn = getConnection();
+  if (conn) {
+    if (!conn->requestMtuExchange(pref_mtu)) return -2;
+    conn->requestDataLengthUpdate();  //so that each MTU goes in one radio packet
+  }
+  return 0;
+}
+
+int BLE_LinkParams::setConnInterval(const int interval) {
+  if (!isValidConnInterval(interval)) return -1;
+  pref_interval = interval;
+  Bluefruit.Periph.setConnInterval(pref_interval, pref_interval);  //what we advertise as our preference (PPCP)
+  return requestConnParams();
+}
+
+int BLE_LinkParams::setLatency(const int latency) {
+  if (!isValidLatency(latency)) return -1;
+  pref_latency = latency;  latency_was_set = true;
+  Bluefruit.Periph.setConnSlaveLatency(pref_latency);
+  return requestConnParams();
+}
+
+int BLE_LinkParams::setSupTimeout(const int timeout) {
+  if (!isValidSupTimeout(timeout)) return -1;
+  pref_timeout = timeout;
+  Bluefruit.Periph.setConnSupervisionTimeout(pref_timeout);
+  return requestConnParams();
+}
+
+//ask for the connection interval, latency, and timeout all together.  Any that have no preference keep their
+//current values.
+int BLE_LinkParams::requestConnParams(void) {
+  BLEConnection *conn = getConnection();
+  if (conn == nullptr) return 0;  //will be requested at the next connection
+  if ((pref_interval == 0) && !latency_was_set && (pref_timeout == 0)) return 0;
+  const uint16_t interval = (pref_interval > 0) ? pref_interval : conn->getConnectionInterval();
+  const uint16_t latency = latency_was_set ? pref_latency : conn->getSlaveLatency();
+  const uint16_t timeout = (pref_timeout > 0) ? pref_timeout : conn->getSupervisionTimeout();
+  return conn->requestConnectionParameter(interval, latency, timeout) ? 0 : -2;
+}
+
+int BLE_LinkParams::requestAll(void) {
+  BLEConnection *conn = getConnection();
+  if (conn == nullptr) return 0;
+  int ret_val = 0;
+  if ((pref_phy != BLE_GAP_PHY_AUTO) && !conn->requestPHY(pref_phy)) ret_val = -2;
+  if (pref_mtu > 0) {
+    if (!conn->requestMtuExchange(pref_mtu)) ret_val = -2;
+    conn->requestDataLengthUpdate();
+  }
+  if (requestConnParams() != 0) ret_val = -2;
+  return ret_val;
+}
+
+const char* BLE_LinkParams::phyName(const int phy) {
+  if (phy == BLE_GAP_PHY_1MBPS) return "1M";
+  if (phy == BLE_GAP_PHY_2MBPS) return "2M";
+  if (phy == BLE_GAP_PHY_CODED) return "CODED";
+  return "AUTO";
+}
+
+size_t BLE_LinkParams::report(Print *dest) {
+  BLEConnection *conn = getConnection();
+  if (conn == nullptr) return 0;
+
+  char text[sizeof(last_report)];
+  snprintf(text, sizeof(text), "LINK PHY=%s MTU=%d DLE=%d CI=%d LAT=%d TO=%d", phyName(conn->getPHY()), (int)conn->getMtu(),
+    (int)conn->getDataLength(), (int)conn->getConnectionInterval(), (int)conn->getSlaveLatency(), (int)conn->getSupervisionTimeout());
+  if (strcmp(text, last_report) == 0) return 0;  //nothing has changed
+  strcpy(last_report, text);
+  return BLE_DataFrame::writeText(dest, text);
+}
+
+#endif
@@ -0,0 +1,141 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to keep the whole BLE configuration (the MAC, the name, which preset services
+// are enabled, the generic services' UUIDs and characteristics, which service is advertised, the advertising profile,
+// and whether BLE was begun) in the nRF's own flash.  At power-up, a saved profile is applied right away (see
+// setup()) so that the nRF can be advertising before the Tympan has even finished booting.
+//
+// The Tympan uses these messages (see AT_Processor.h):
+//
+//    SAVE              store the current configuration.  Replies "OK hhhhhhhh", where hhhhhhhh is its hash.
+//    SAVE ERASE        remove the stored profile, so the nRF starts up unconfigured again
+//    LOAD              apply the stored profile (only before BEGIN, like SET MAC).  If it was saved after BEGIN,
+//                      this also begins.
+//    GET PROFILEHASH   replies with the hash of the stored profile (or "NONE")
+//
+// So, at startup, the Tympan asks for "GET PROFILEHASH".  If the hash matches the one that it got back from its own
+// SAVE, it can skip sending SET MAC, SET NAME, SVCSETUP, ENABLE_SERVICE_IDx, and BEGIN.  Otherwise, it configures
+// the nRF as usual and sends SAVE at the end.
+//
+// The profile is a small binary file.  It starts with a header and is followed by the contents (see
+// saveBleProfile() in BLE_Stuff.h for the order):
+//
+//    ['T'] ['P'] [VERSION] [N_LSB] [N_MSB] [HASH, 4 bytes, LE] [N bytes of contents]
+//
+// The hash is the 32-bit FNV-1a of the contents.  If the version is not ours or the hash is wrong, the profile is
+// ignored.  Strings are stored as [LEN] [chars] (no null), and are cut at BLE_PROFILE_MAX_STRING_NBYTES.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_PROFILE_H
+#define BLE_PROFILE_H
+
+#include <Arduino.h>
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+#define BLE_PROFILE_FILENAME "/tympan_ble.prf"
+#define BLE_PROFILE_VERSION 2        //2 added the advertising profile
+#define BLE_PROFILE_HEADER_NBYTES 9        //'T', 'P', VERSION, N_LSB, N_MSB, and the 4-byte HASH
+#define BLE_PROFILE_MAX_NBYTES 1280        //room for both generic services, each with 8 characteristics with long names
+#define BLE_PROFILE_MAX_STRING_NBYTES 32
+
+class BLE_Profile {
+  public:
+    BLE_Profile(void) { clear(); }
+
+    //Building up a profile.  If it runs out of room, isOK() becomes false.
+    void clear(void) { len = BLE_PROFILE_HEADER_NBYTES; read_ind = BLE_PROFILE_HEADER_NBYTES; is_ok = true; }
+    void putU8(const uint8_t val) { putBytes(&val, 1); }
+    void putU16(const uint16_t val) { putU8((uint8_t)(val & 0x00FF)); putU8((uint8_t)(val >> 8)); }  //little endian
+    void putBytes(const uint8_t *bytes, const int n) {
+      if ((len + n) > BLE_PROFILE_MAX_NBYTES) { is_ok = false; return; }
+      memcpy(buff + len, bytes, n);  len += n;
+    }
+    void putString(const char *str) {
+      const int n = min((int)strlen(str), BLE_PROFILE_MAX_STRING_NBYTES);
+      putU8((uint8_t)n);  putBytes((const uint8_t *)str, n);
+    }
+
+    //Reading a profile back.  If it runs off the end, isOK() becomes false (and the values read are zero).
+    uint8_t getU8(void) { uint8_t val = 0; getBytes(&val, 1); return val; }
+    uint16_t getU16(void) { uint16_t val = getU8(); return val | (((uint16_t)getU8()) << 8); }
+    void getBytes(uint8_t *bytes, const int n) {
+      if ((read_ind + n) > len) { is_ok = false; memset(bytes, 0, n); return; }
+      memcpy(bytes, buff + read_ind, n);  read_ind += n;
+    }
+    void getString(char *str, const int len_str) {  //len_str must be at least BLE_PROFILE_MAX_STRING_NBYTES+1
+      const int n = min((int)getU8(), len_str-1);
+      getBytes((uint8_t *)str, n);  str[n] = '\0';
+    }
+    bool isOK(void) { return is_ok; }
+
+    //The hash of the contents (see above)
+    uint32_t getHash(void) { return computeHash(buff + BLE_PROFILE_HEADER_NBYTES, len - BLE_PROFILE_HEADER_NBYTES); }
+
+    //Store the profile in flash (replacing any old one).  Returns 0 if OK, or -1 if it didn't fit or couldn't be written.
+    int writeToFlash(void);
+
+    //Read the profile from flash.  Returns 0 if OK, -1 if there is none, or -2 if it is not valid (wrong version,
+    //wrong length, or wrong hash).
+    int readFromFlash(void);
+
+    //Remove the profile from flash.  Returns 0 if OK (or if there was none).
+    static int eraseFlash(void) { if (!beginFS()) return -1; if (InternalFS.exists(BLE_PROFILE_FILENAME)) InternalFS.remove(BLE_PROFILE_FILENAME); return 0; }
+
+  private:
+    uint8_t buff[BLE_PROFILE_MAX_NBYTES];
+    int len = BLE_PROFILE_HEADER_NBYTES;
+    int read_ind = BLE_PROFILE_HEADER_NBYTES;
+    bool is_ok = true;
+
+    static bool beginFS(void) { static bool has_begun = false; if (!has_begun) has_begun = InternalFS.begin(); return has_begun; }
+
+    static uint32_t computeHash(const uint8_t *bytes, const int n) {
+      uint32_t hash = 2166136261UL;  //FNV-1a
+      for (int i=0; i < n; i++) { hash ^= bytes[i]; hash *= 16777619UL; }
+      return hash;
+    }
+};
+
+int BLE_Profile::writeToFlash(void) {
+  if (!is_ok || !beginFS()) return -1;
+
+  //fill in the header
+  const int n = len - BLE_PROFILE_HEADER_NBYTES;
+  const uint32_t hash = getHash();
+  buff[0] = 'T';  buff[1] = 'P';  buff[2] = BLE_PROFILE_VERSION;
+  buff[3] = (uint8_t)(n & 0x00FF);  buff[4] = (uint8_t)(n >> 8);  //little endian
+  for (int i=0; i<4; i++) buff[5+i] = (uint8_t)(0x000000FF & (hash >> (i*8)));  //little endian
+
+  //write the whole thing.  (FILE_O_WRITE appends, so remove the old one first)
+  if (InternalFS.exists(BLE_PROFILE_FILENAME)) InternalFS.remove(BLE_PROFILE_FILENAME);
+  Adafruit_LittleFS_Namespace::File file(InternalFS);
+  if (!file.open(BLE_PROFILE_FILENAME, FILE_O_WRITE)) return -1;
+  const size_t n_written = file.write(buff, len);
+  file.close();
+  return (n_written == (size_t)len) ? 0 : -1;
+}
+
+int BLE_Profile::readFromFlash(void) {
+  clear();
+  if (!beginFS() || !InternalFS.exists(BLE_PROFILE_FILENAME)) return -1;
+  Adafruit_LittleFS_Namespace::File file(InternalFS);
+  if (!file.open(BLE_PROFILE_FILENAME, FILE_O_READ)) return -1;
+  const int n_read = (int)file.read(buff, BLE_PROFILE_MAX_NBYTES);
+  file.close();
+
+  //check the header and the hash
+  if ((n_read < BLE_PROFILE_HEADER_NBYTES) || (buff[0] != 'T') || (buff[1] != 'P') || (buff[2] != BLE_PROFILE_VERSION)) return -2;
+  const int n = ((int)buff[3]) | (((int)buff[4]) << 8);
+  if ((BLE_PROFILE_HEADER_NBYTES + n) != n_read) return -2;
+  uint32_t hash = 0;
+  for (int i=0; i<4; i++) hash |= ((uint32_t)buff[5+i]) << (i*8);
+  len = n_read;
+  if (getHash() != hash) { clear(); return -2; }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to find the right BLE service (or characteristic) for each piece of data
+// without searching for it.  It is filled in once, by beginAllBleServices(), after all of the services have begun.
+//
+//   * Outbound (Tympan to phone): service_id -> the BLE_Service_Preset to send it with
+//   * Inbound (phone to Tympan): GATT attribute handle of the characteristic that was written -> service_id, char_id
+//
+// The attribute handles are small numbers that the SoftDevice assigns, in order, as the characteristics begin.  So,
+// the inbound table is indexed directly by the handle.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_ROUTER_H
+#define BLE_ROUTER_H
+
+#include <bluefruit.h>
+#include "BLE_Service_Preset.h"
+
+#define BLE_ROUTER_MAX_SERVICE_ID 16   //service_id must be less than this
+#define BLE_ROUTER_N_HANDLES 256       //attribute handles must be less than this.  All of our services use far fewer.
+
+class BLE_Router {
+  public:
+    BLE_Router(void) { clear(); }
+
+    void clear(void) {
+      for (int i=0; i < BLE_ROUTER_MAX_SERVICE_ID; i++) service_by_id[i] = nullptr;
+      for (int i=0; i < BLE_ROUTER_N_HANDLES; i++) { route_by_handle[i].service_id = -1; route_by_handle[i].char_id = -1; }
+    }
+
+    //Add a service (that has already begun) and all of its characteristics.  Returns 0 if OK.
+    int addService(BLE_Service_Preset *service_ptr) {
+      if (service_ptr == nullptr) return -1;
+      const int service_id = service_ptr->service_id;
+      if ((service_id < 0) || (service_id >= BLE_ROUTER_MAX_SERVICE_ID)) return -1;
+      service_by_id[service_id] = service_ptr;
+
+      int ret_val = 0;
+      for (int char_id=0; char_id < service_ptr->getNCharacteristics(); char_id++) {
+        BLECharacteristic *ble_char = service_ptr->getCharacteristic(char_id);
+        if (ble_char == nullptr) continue;
+        const uint16_t handle = ble_char->handles().value_handle;
+        if ((handle == 0) || (handle >= BLE_ROUTER_N_HANDLES)) { ret_val = -2; continue; }  //not begun?  or too big for the table
+        route_by_handle[handle].service_id = (int8_t)service_id;
+        route_by_handle[handle].char_id = (int8_t)char_id;
+      }
+      return ret_val;
+    }
+
+    //outbound.  Returns nullptr if there is no such service (or it hasn't begun)
+    BLE_Service_Preset* getService(const int service_id) {
+      if ((service_id < 0) || (service_id >= BLE_ROUTER_MAX_SERVICE_ID)) return nullptr;
+      return service_by_id[service_id];
+    }
+
+    //inbound.  Returns true (and fills in service_id and char_id) if the characteristic is known
+    bool findCharacteristic(BLECharacteristic *ble_char, int *service_id, int *char_id) {
+      const uint16_t handle = ble_char->handles().value_handle;
+      if (handle >= BLE_ROUTER_N_HANDLES) return false;
+      if (route_by_handle[handle].service_id < 0) return false;
+      *service_id = route_by_handle[handle].service_id;
+      *char_id = route_by_handle[handle].char_id;
+      return true;
+    }
+
+  private:
+    BLE_Service_Preset* service_by_id[BLE_ROUTER_MAX_SERVICE_ID];
+    struct { int8_t service_id; int8_t char_id; } route_by_handle[BLE_ROUTER_N_HANDLES];
+};
+
+#endif
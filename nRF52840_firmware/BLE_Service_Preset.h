@@ -16,6 +16,11 @@ namespace std {void __throw_length_error(char const*){ while(1); }; } //to get r
 #define __throw_length_error
 #endif
 
+//Largest ATT MTU that we allow (setupBLE() uses BANDWIDTH_MAX, which gives the SoftDevice's maximum of 247).  The
+//most data that fits in one write or notification is 3 bytes less than the MTU (for the ATT header).
+#define BLE_MAX_ATT_MTU 247
+#define BLE_MAX_DATA_NBYTES (BLE_MAX_ATT_MTU-3)
+
 extern void globalWriteBleDataToTympan(const int service_id, const int char_id, uint8_t data[], size_t len);
 
 class BLE_Service_Preset {
@@ -29,6 +34,31 @@ class BLE_Service_Preset {
     virtual size_t notify(const int char_id, const uint8_t* data, size_t len) { return 0; }; //do nothing by default
     virtual String& getName(String &s) { s.remove(0,s.length()); return s += name; }
 
+    //Notify just one of the connected phones (see BLE_Connections.h).  By default, this notifies the characteristic
+    //that getCharacteristic() gives.  Returns the number of bytes sent (zero if the phone hasn't subscribed).
+    virtual size_t notifyConnection(const uint16_t conn_handle, const int char_id, const uint8_t* data, size_t len) {
+      BLECharacteristic *ble_char = getCharacteristic(char_id);
+      if ((ble_char == nullptr) || !has_begun) return 0;
+      return ble_char->notify(conn_handle, data, len) ? len : 0;
+    }
+
+    //Has this phone subscribed to this characteristic's notifications?  If we can't tell, say yes (and let the
+    //SoftDevice refuse it).  BLE_TxQueue uses this to drop a notification right away rather than retrying it.
+    virtual bool isSubscribed(const uint16_t conn_handle, const int char_id) {
+      BLECharacteristic *ble_char = getCharacteristic(char_id);
+      if (ble_char == nullptr) return true;
+      return ble_char->notifyEnabled(conn_handle);
+    }
+
+    //If true, a new notification for this characteristic replaces one that is still waiting to be sent, rather than
+    //queueing up behind it.  Use it for values where only the latest one matters (levels, states).  See BLE_TxQueue.h.
+    virtual bool isLatestValueWins(const int char_id) { return false; }
+
+    //The characteristics of this service, by char_id, so that BLE_Router can find them by their attribute handle.
+    //Only meaningful after begin().  Services whose characteristics are not reachable here just return 0.
+    virtual int getNCharacteristics(void) { return 0; }
+    virtual BLECharacteristic* getCharacteristic(const int char_id) { return nullptr; }
+
     static void writeBleDataToTympan(const int service_id, const int char_id, uint8_t data[], size_t len) { globalWriteBleDataToTympan( service_id, char_id, data, len); }
 
     int service_id = 0; //will get overwritten when actually setup
@@ -14,8 +14,14 @@
 #include "BLE_BleDis.h"
 #include "BLE_BattService.h"
 #include "BLE_LedService.h"
+#include "BLE_AudioStream.h"
+#include "BLE_Router.h"
+#include "BLE_EventQueue.h"
+#include "BLE_Connections.h"
+#include "BLE_Profile.h"
+#include "BLE_AdvPayload.h"
+#include "BLE_AdvProfiles.h"
 
-#define MESSAGE_LENGTH 256     // default ble buffer size
 // #define OUT_STRING_LENGTH 201
 // #define NUM_BUF_LENGTH 11
 
@@ -26,13 +32,12 @@ bool was_MAC_set_by_user = false;
 
 //   vvvvv  VERSION INDICATION  vvvvv
 const char versionString[] = "TympanBLE v0.4.2, nRF52840";
-char deviceName[] = "TympanF-TACO"; // gets modified with part of the uniqueID
+#define BLE_DEVICE_NAME_MAX_LEN 16  //same limit as "SET NAME"
+char deviceName[BLE_DEVICE_NAME_MAX_LEN+1] = "TympanF-TACO"; // gets modified with part of the uniqueID
 const char manufacturerName[] = "Flywheel Lab";
 
 // BLE
-uint16_t handle;
-char BLEmessage[MESSAGE_LENGTH] ={0};
-boolean bleConnected = false;
+boolean bleConnected = false;  //true if any phone is connected (see ble_connections for which ones)
 boolean bleBegun = false;
 String uniqueID = "DEADBEEFCAFEDATE"; // [16]; // used to gather the 'serial number' of the chip
 char bleInChar;  // incoming BLE char
@@ -44,11 +49,25 @@ BLE_BleDis        ble_bleDis;       // Adafruit's built-in device information se
 BLEUart_Tympan    bleUart_Tympan;   //Tympan extension of the Adafruit UART service that allows us to change the Service and Characteristic UUIDs
 BLEUart_Adafruit  bleUart_Adafruit; //Adafruit's built-in UART service
 BLE_BattService   ble_battService;  // battery service
+BLE_AudioStreamService ble_audioStream;  //compressed audio from the Tympan (see BLE_AudioStream.h)
 BLE_LedButtonService           ble_lbs; //standard Nordic LED Button Serice (1 byte of data)
 BLE_LedButtonService_4bytes    ble_lbs_4bytes; //modified Nordic LED Button Service using 4 bytes of data
 BLE_GenericService             ble_generic1, ble_generic2;
 //AT_Processor    AT_interpreter(&bleUart_Tympan, &SERIAL_TO_TYMPAN);  //interpreter for the AT command set that we're inventing
 AT_Processor      AT_interpreter(&bleUart_Tympan, &bleUart_Adafruit, &SERIAL_TO_TYMPAN);  //interpreter for the AT command set that we're inventing
+BridgeStats       bridge_stats;  //counters for what the UART<->BLE bridge is doing (see "GET STATS")
+BLE_Router        ble_router;    //finds the service for outgoing data and the service and characteristic for incoming data
+BLE_DataFrame     ble_data_frame;  //formats the data from the phone for the Tympan (see BLE_DataFrame.h)
+BLE_LinkParams    ble_link_params;  //the PHY, MTU, and connection parameters that the Tympan wants (see BLE_LinkParams.h)
+BLE_ThroughputTest ble_throughput_test;  //for measuring each phone (see BLE_ThroughputTest.h)
+BLE_Connections   ble_connections;  //the phones that are connected, each with its own counters (see BLE_Connections.h)
+BLE_AdvPayload    ble_adv_payload;  //the advertising data, which can change while we advertise (see BLE_AdvPayload.h)
+BLE_AdvProfiles   ble_adv_profiles;  //how fast we advertise, and for how long (see BLE_AdvProfiles.h)
+BLE_Profile       ble_profile;  //the BLE configuration that is saved in flash (see BLE_Profile.h)
+BLE_EventQueue    ble_event_queue; //connect, disconnect, and write events waiting for loop() (see BLE_EventQueue.h)
+std::atomic<bool> ble_link_changed{false};  //set by ble_event_callback() when the PHY, MTU, etc change.  Cleared by loop().
+BLE_TxQueue       ble_tx_queue;  //notifications waiting for room in the SoftDevice (see BLE_TxQueue.h)
+BLE_FlowControl   flow_control(&ble_tx_queue);  //credits that keep the Tympan from overrunning ble_tx_queue (see "SET FLOWCONTROL")
 
 // Define a container for holding BLE Services that might need to get invoked independently later
 #define MAX_N_PRESET_SERVICES 10  //adafruit says that the nRF52 library only allows 10 to be active at one time?
@@ -58,72 +77,166 @@ BLE_Service_Preset* activated_service_presets[MAX_N_PRESET_SERVICES];
 bool flag_activateServicePreset[MAX_N_PRESET_SERVICES];   //set to true to activate that preset service
 int service_preset_to_ble_advertise;  //which of the presets to include in the advertising.  will be set in setup
 
-// callback invoked when central connects
+// callback invoked when central connects.  The rest of the work is done later, in serviceBleEvents().
 void connect_callback(uint16_t conn_handle)
 {
-  // Get the reference to current connection
-  BLEConnection* connection = Bluefruit.Connection(conn_handle);
-  handle = conn_handle; // save this for when/if we disconnect
-  char central_name[32] = { 0 };
-  connection->getPeerName(central_name, sizeof(central_name));
+  ble_connections.onConnect(conn_handle);  //remember this phone, in case others connect too
   bleConnected = true;
-  Serial.print(F("nRF52840 Firmware: connect_callback: Connected to ")); Serial.print(central_name);
-  Serial.print(F(", bleConnected = ")); Serial.println(bleConnected);
+  ble_event_queue.push(BLE_EVENT_TYPE_CONNECT, conn_handle, -1, -1, 0, nullptr, 0);
 }
 
 /**
- * Callback invoked when a connection is dropped
+ * Callback invoked when a connection is dropped.  The rest of the work is done later, in serviceBleEvents().
  * @param conn_handle connection where this event happens
  * @param reason is a BLE_HCI_STATUS_CODE which can be found in ble_hci.h
  */
 void disconnect_callback(uint16_t conn_handle, uint8_t reason)
 {
-  (void) conn_handle;
-  (void) reason;
-  bleConnected = false;
-  Serial.print(F("nRF52840 Firmware: disconnect_callback: Disconnected, reason = 0x")); Serial.print(reason, HEX);
-  Serial.print(F(", bleConnected = ")); Serial.println(bleConnected);
+  ble_tx_queue.onDisconnect(conn_handle);  //before ble_connections forgets this phone
+  ble_connections.onDisconnect(conn_handle);
+  bleConnected = (ble_connections.getNConnected() > 0);  //the other phones might still be connected
+  ble_event_queue.push(BLE_EVENT_TYPE_DISCONNECT, conn_handle, -1, -1, reason, nullptr, 0);
 }
 
+/**
+ * Callback invoked for every BLE event from the SoftDevice.  Runs in the SoftDevice's task, so keep it short.
+ * @param evt is the event (see ble.h and ble_gatts.h)
+ */
+void ble_event_callback(ble_evt_t *evt)
+{
+  switch (evt->header.evt_id) {
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+      //the phone has acknowledged some notifications, so their buffers are free again
+      ble_tx_queue.onTxComplete(evt->evt.gatts_evt.conn_handle, evt->evt.gatts_evt.params.hvn_tx_complete.count);
+      break;
+    case BLE_GAP_EVT_PHY_UPDATE: case BLE_GAP_EVT_CONN_PARAM_UPDATE: case BLE_GAP_EVT_DATA_LENGTH_UPDATE:
+    case BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST: case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
+      //the link has changed.  Tell the Tympan later, from loop() (see serviceBleEvents()).  This is not the task that
+      //pushes into ble_event_queue, so only set a flag.
+      ble_link_changed.store(true, std::memory_order_release);
+      break;
+  }
+}
 
+//Send debugging text to USB, but only if all of it fits in the USB transmit buffer right now.  Otherwise, skip it.
+//This way, the debugging output can never slow down the data path that it is reporting on.
+unsigned long usb_debug_nbytes_skipped = 0;  //how many bytes of debugging output were skipped
+void debugWriteNonBlocking(const char *label, const uint8_t *data, const size_t len) {
+  const size_t len_label = strlen(label);
+  if ((size_t)Serial.availableForWrite() < (len_label + len + 2)) { usb_debug_nbytes_skipped += (len_label + len + 2); return; }
+  Serial.write((const uint8_t *)label, len_label);
+  Serial.write(data, len);
+  Serial.println();
+}
+
+void startAdvAfterDisconnect(void);  //see below
+
+//Do the work for the events that the BLE callbacks have queued up (see BLE_EventQueue.h).  Call from loop().
+void serviceBleEvents(void) {
+  static uint32_t n_dropped_seen = 0;
+  const uint32_t n_dropped_now = ble_event_queue.getNDropped();
+  bridge_stats.ble_rx_dropped += (n_dropped_now - n_dropped_seen);  n_dropped_seen = n_dropped_now;
+  static uint32_t n_wrong_task_seen = 0;
+  if (DEBUG_VIA_USB && (ble_event_queue.getNWrongTask() != n_wrong_task_seen)) {
+    n_wrong_task_seen = ble_event_queue.getNWrongTask();
+    Serial.print(F("nRF52840 Firmware: serviceBleEvents: ERROR: events pushed from a second task = ")); Serial.println(n_wrong_task_seen);
+  }
+
+  BLE_Event_t evt;
+  uint8_t data[BLE_EVENT_MAX_DATA_NBYTES];
+  while (ble_event_queue.pop(&evt, data)) {
+    if (evt.type == BLE_EVENT_TYPE_CONNECT) {
+      char central_name[32] = { 0 };
+      BLEConnection* connection = Bluefruit.Connection(evt.conn_handle);
+      if (connection) connection->getPeerName(central_name, sizeof(central_name));  //might have disconnected already
+      Serial.print(F("nRF52840 Firmware: connect_callback: Connected to ")); Serial.print(central_name);
+      Serial.print(F(", slot = ")); Serial.print(ble_connections.getSlot(evt.conn_handle));
+      Serial.print(F(", n connected = ")); Serial.println(ble_connections.getNConnected());
+      ble_link_params.onConnect(evt.conn_handle);  //ask for the link that the Tympan wants
+      ble_link_params.report(&SERIAL_TO_TYMPAN);   //and tell it what we have so far
+      ble_adv_profiles.onConnect(evt.conn_handle); //remember who, for directed advertising
+
+      //advertise the new number of phones (see "SET ADVSTATUS").  Then, keep advertising, if there is room for another phone
+      updateAdvertisingData();
+      if (bleBegun && (ble_connections.getNConnected() < BLE_MAX_CONNECTIONS) && !Bluefruit.Advertising.isRunning()) startAdv();
+
+    } else if (evt.type == BLE_EVENT_TYPE_DISCONNECT) {
+      Serial.print(F("nRF52840 Firmware: disconnect_callback: Disconnected, reason = 0x")); Serial.print(evt.reason, HEX);
+      Serial.print(F(", n connected = ")); Serial.println(ble_connections.getNConnected());
+      ble_link_params.onDisconnect(evt.conn_handle);
+      if (ble_connections.getNConnected() == 0) ble_audioStream.reset();  //nobody left to send the rest of the audio to
+      updateAdvertisingData();  //advertise the new number of phones (see "SET ADVSTATUS")
+
+      //advertise again (we do this, not Bluefruit, so that we can first direct it to the phone that just left).  We are
+      //usually advertising already (there was room for another phone), so that is replaced if the profile directs it.
+      if (bleBegun && ((ble_adv_profiles.getSettings().directed_secs > 0) || !Bluefruit.Advertising.isRunning())) startAdvAfterDisconnect();
+
+    } else if (evt.type == BLE_EVENT_TYPE_WRITE) {
+      if (DEBUG_VIA_USB) {
+        Serial.print(F("nRF52840 Firmware: BLE write: Rcvd data (len = ")); Serial.print(evt.len); Serial.print(F("): "));
+        for (uint16_t i=0; i<evt.len; ++i) {Serial.print("0x"); Serial.print(data[i],HEX); Serial.print(" ");}
+        Serial.print(F(", from service_id: ")); Serial.print(evt.service_id);
+        Serial.print(F(", from char_id: ")); Serial.println(evt.char_id);
+      }
+      ble_connections.countRx(evt.conn_handle, evt.len);
+      if (ble_throughput_test.onRx(evt.len)) continue;  //the throughput test takes the data instead of the Tympan
+      if ((evt.service_id >= 0) && (evt.char_id >= 0)) {
+        BLE_Service_Preset::writeBleDataToTympan(evt.service_id, evt.char_id, data, evt.len);  //push the data to the Tympan
+      }
+    }
+  }
+
+  //if the link has changed, tell the Tympan (only if something that it cares about has changed)
+  if (ble_link_changed.exchange(false, std::memory_order_acq_rel)) ble_link_params.report(&SERIAL_TO_TYMPAN);
+}
+
+//Forward whatever the phone has sent to the BLE UART service on to the Tympan.  Move it in blocks, not byte-by-byte.
 int BLEevent(BLEUart *bleuart_ptr, HardwareSerial *serial_to_tympan) {
   int success = -1;
-  if(bleuart_ptr->available()) {
-    Serial.print("nRF52840 Firmware: BLEevent: available bytes = "); Serial.println(bleuart_ptr->available());
+  uint8_t chunk[128];
+  int n_read;
+  while ((n_read = bleuart_ptr->read(chunk, sizeof(chunk))) > 0) {
     success = 0;
-    Serial.print("    : message = ");
-    while (bleuart_ptr->available()) {
-      char c = bleuart_ptr->read();
-      Serial.print(c);
-      serial_to_tympan->write(c);
-    }
-    Serial.println();
+    if (ble_throughput_test.onRx(n_read)) continue;  //the throughput test takes the data instead of the Tympan
+    serial_to_tympan->write(chunk, n_read);
+    bridge_stats.ble_rx_bytes += n_read;  bridge_stats.uart_tx_bytes += n_read;
+    if (DEBUG_VIA_USB) debugWriteNonBlocking("nRF52840 Firmware: BLEevent: message = ", chunk, n_read);
   }
+  if (success == 0) bridge_stats.ble_rx_msgs++;
   return success;
 }
 
 void serialEvent(HardwareSerial *serial_from_tympan) { //for the nRF firmware, service any messages coming in the serial port from the Tympan
-    //interpret received characters as part of AT command set
-    if(serial_from_tympan->available()) {
-      //Serial.print("nRF52840 Firmware: serialEvent: available bytes = "); Serial.println(serial_from_tympan->available());
-      while (serial_from_tympan->available()) AT_interpreter.processSerialCharacter(serial_from_tympan->read());
+    //interpret received characters as part of AT command set.  Read them in blocks rather than one-by-one.
+    uint8_t chunk[64];
+    int n_avail;
+    while ((n_avail = serial_from_tympan->available()) > 0) {
+      //Serial.print("nRF52840 Firmware: serialEvent: available bytes = "); Serial.println(n_avail);
+      int n_read = serial_from_tympan->readBytes(chunk, min(n_avail, (int)sizeof(chunk)));
+      if (n_read <= 0) break;
+      bridge_stats.uart_rx_bytes += n_read;
+      AT_interpreter.processSerialBytes(chunk, n_read);
     }
  }
 
+//preset_id 0 is excluded (never disable or advertise preset_id 0 because it's the DFU)
+bool isPresetServiceIdValid(int preset_id) { return (preset_id > 0) && (preset_id < MAX_N_PRESET_SERVICES); }
+
 bool enablePresetServiceById(int preset_id, bool enable) {
-  if ((preset_id > 0) && (preset_id < MAX_N_PRESET_SERVICES)) {  //be sure to exclude preset_id 0 (never disable preset_id 0 because it's the DFU)
+  if (isPresetServiceIdValid(preset_id)) {
     return flag_activateServicePreset[preset_id] = enable;
   }
   return false;
 }
 
 int setAdvertisingServiceToPresetById(int preset_id) {
-  if ((preset_id > 0) && (preset_id < MAX_N_PRESET_SERVICES)) {
+  if (isPresetServiceIdValid(preset_id)) {
       service_preset_to_ble_advertise = preset_id;
 
       //in case this function gets called after the system is running (or about to begin()), follow through with the next steps, too
       BLE_Service_Preset* service_ptr = activated_service_presets[service_preset_to_ble_advertise];
       if (service_ptr) serviceToAdvertise = service_ptr->getServiceToAdvertise();
+      if (bleBegun) updateAdvertisingData();  //if already advertising, switch to the new service without stopping
       return service_preset_to_ble_advertise;
   }
   return -1;
@@ -144,6 +257,7 @@ void beginAllBleServices(int setup_config_id) {
   //setup the connect and disconnect callbacks
   Bluefruit.Periph.setConnectCallback(connect_callback);
   Bluefruit.Periph.setDisconnectCallback(disconnect_callback);
+  Bluefruit.setEventCallback(ble_event_callback);
 
   // To be consistent OTA DFU should be added first if it exists
   preset_id = 0;
@@ -155,12 +269,22 @@ void beginAllBleServices(int setup_config_id) {
       if (DEBUG_VIA_USB) { Serial.print("nRF52840 Firmware: begin: starting preset service_id = "); Serial.println(preset_id); };
       err_t err_code = all_service_presets[preset_id]->begin(preset_id); 
       if (err_code != 0) {
-        if (DEBUG_VIA_USB) Serial.print("nRF52840 Firmware: begin: service_id = " + String(preset_id) + " begin ERROR: code = " + String(err_code)); 
+        if (DEBUG_VIA_USB) { Serial.print("nRF52840 Firmware: begin: service_id = "); Serial.print(preset_id); Serial.print(" begin ERROR: code = "); Serial.println(err_code); }
       }
       activated_service_presets[preset_id] = all_service_presets[preset_id];
     }
   }
 
+  //now that all of the services have begun (so their characteristics have attribute handles), build the routing tables
+  //and the BLEDATA headers
+  ble_router.clear();
+  ble_data_frame.clear();
+  for (preset_id = 1; preset_id < MAX_N_PRESET_SERVICES; preset_id++) {
+    if (activated_service_presets[preset_id] == nullptr) continue;
+    if ((ble_router.addService(activated_service_presets[preset_id]) != 0) && DEBUG_VIA_USB) { Serial.print("nRF52840 Firmware: begin: could not route all of service_id = "); Serial.println(preset_id); }
+    ble_data_frame.addService(activated_service_presets[preset_id]);  //if it runs out of room, the header is made as needed
+  }
+
   //get which service to advertise
   setAdvertisingServiceToPresetById(service_preset_to_ble_advertise);
 
@@ -177,8 +301,8 @@ void setupBLE(){
   Bluefruit.configPrphBandwidth(BANDWIDTH_MAX);
   // other config***() ??
 
-  //start the basic BLE stuff (not the services) and populate the intitial names
-  Bluefruit.begin(); 
+  //start the basic BLE stuff (not the services) and populate the intitial names.  Allow several phones at once.
+  Bluefruit.begin(BLE_MAX_CONNECTIONS, 0); 
   Bluefruit.setTxPower(4);    // Check bluefruit.h for supported values
 
   //get the default MAC
@@ -214,6 +338,7 @@ void setupBLE(){
   i++; all_service_presets[i] = &ble_lbs_4bytes;   flag_activateServicePreset[i] = false;     //not active by default
   i++; all_service_presets[i] = &ble_generic1;   flag_activateServicePreset[i] = false;     //not active by default
   i++; all_service_presets[i] = &ble_generic2;   flag_activateServicePreset[i] = false;     //not active by default
+  i++; all_service_presets[i] = &ble_audioStream; flag_activateServicePreset[i] = false;    //not active by default
 
   
   //this sets up all the BLE services and characteristics
@@ -255,27 +380,21 @@ void startAdv(void)
 {
   if (bleBegun == false)  return;
 
-  // Advertising packet
-  Bluefruit.Advertising.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
-  Bluefruit.Advertising.addTxPower();
-  if (serviceToAdvertise != nullptr) Bluefruit.Advertising.addService(*serviceToAdvertise); //set which BLE service to advertise
+  // If we were advertising only to one phone, stop that.  It had no data, so hand over the data again.
+  if (ble_adv_profiles.isDirected()) { stopAdv(); ble_adv_payload.resend(); }
+
+  // The interval, fast timeout, and TX power come from the advertising profile (see "SET ADVPROFILE")
+  ble_adv_profiles.apply();
 
-  //Bluefruit.Advertising.addService(myBleService);
-  // Add 'Name' to Advertising packet
-  Bluefruit.ScanResponse.addName();
+  // Advertising packet (flags, TX power, and which BLE service to advertise) and the scan response (the name).  They
+  // are built once and then only rebuilt when something changes (see BLE_AdvPayload.h)
+  updateAdvertisingData();
 
   /* Start Advertising
-   * - Enable auto advertising if disconnected
-   * - Interval:  fast mode = 20 ms, slow mode = 152.5 ms
-   * - Timeout for fast mode is 30 seconds
+   * - We restart it ourselves after a disconnect (see serviceBleEvents()), not Bluefruit
    * - Start(timeout) with timeout = 0 will advertise forever (until connected)
-   *
-   * For recommended advertising interval
-   * https://developer.apple.com/library/content/qa/qa1931/_index.html
    */
-  Bluefruit.Advertising.restartOnDisconnect(true);
-  Bluefruit.Advertising.setInterval(32, 244);    // in unit of 0.625 ms
-  Bluefruit.Advertising.setFastTimeout(30);      // number of seconds in fast mode
+  Bluefruit.Advertising.restartOnDisconnect(false);
   Bluefruit.Advertising.start(0);                // 0 = Don't stop advertising after n seconds
 }
 
@@ -283,49 +402,112 @@ void stopAdv(void) {
   Bluefruit.Advertising.stop();
 }
 
+//Advertise at the burst interval for the profile's burst time (see "ADVBURST").  Returns 0 if OK, -1 if BLE has not
+//begun, -2 if the profile has no burst, or -3 if there is no room for another phone.
+int startAdvBurst(void) {
+  if (bleBegun == false) return -1;
+  if (ble_adv_profiles.getSettings().burst_secs == 0) return -2;
+  if (ble_connections.getNConnected() >= BLE_MAX_CONNECTIONS) return -3;
+  stopAdv();  //the interval can only change when starting
+  if (ble_adv_profiles.isDirected()) ble_adv_payload.resend();
+  ble_adv_profiles.apply(true);
+  updateAdvertisingData();
+  Bluefruit.Advertising.start(0);
+  return 0;
+}
+
+//After a phone disconnects, advertise only to that phone for a bit (if the profile says so), then normally (see
+//serviceAdvertising()).  Any advertising that is running is stopped first.  Directed advertising carries no data, so
+//Bluefruit's copy is emptied.
+void startAdvAfterDisconnect(void) {
+  if (ble_connections.getNConnected() >= BLE_MAX_CONNECTIONS) return;
+  stopAdv();  //the type and interval can only change when starting
+  const int directed_secs = ble_adv_profiles.applyDirected();
+  if (directed_secs == 0) { startAdv(); return; }
+  Bluefruit.Advertising.clearData();  Bluefruit.ScanResponse.clearData();
+  Bluefruit.Advertising.start(directed_secs);
+}
+
+//Call from loop().  When the directed advertising times out, go back to normal advertising.
+void serviceAdvertising(void) {
+  if (bleBegun && ble_adv_profiles.isDirected() && !Bluefruit.Advertising.isRunning()) startAdv();
+}
+
+//Choose the advertising profile.  If we're advertising, restart with it now.
+int setAdvertisingProfileById(const int id) {
+  if (ble_adv_profiles.setPresetById(id) != 0) return -1;
+  if (bleBegun && Bluefruit.Advertising.isRunning()) { stopAdv(); startAdv(); }
+  return 0;
+}
+
+int setAdvertisingProfileCustom(const BLE_AdvSettings_t &settings) {
+  if (ble_adv_profiles.setCustom(settings) != 0) return -1;
+  if (bleBegun && Bluefruit.Advertising.isRunning()) { stopAdv(); startAdv(); }
+  return 0;
+}
+
+//Rebuild the advertising data from the current name, advertised service, and status.  If we are advertising, the new data is
+//swapped in without stopping.  Returns 0 if OK or -1 if the SoftDevice refused it.
+int updateAdvertisingData(void) {
+  if (ble_adv_profiles.isDirected()) return 0;  //no data while directed.  startAdv() hands it over afterwards.
+  ble_adv_payload.setService(serviceToAdvertise);
+  ble_adv_payload.setNConnected((uint8_t)ble_connections.getNConnected());
+  return ble_adv_payload.update();
+}
+
+
 
 
+//How many data bytes fit into one write or notification to the targeted phones.  This is the smallest ATT MTU that
+//was negotiated with them, minus the 3-byte ATT header.  If not connected, assume the largest MTU that we allow.
+int getMaxBleDataNBytes(void) { return ble_connections.getMaxDataNBytes(); }
 
+//Give one block of compressed audio to the audio stream service.  Returns 0 if OK, -1 if the service_id is not the
+//audio stream service (or it hasn't begun), -2 if a notification had to be dropped, or -3 if not connected.
+int sendAudioFrameByService(int service_id, int nbytes, const uint8_t *databytes) {
+  if ((ble_router.getService(service_id) != &ble_audioStream) || (nbytes <= 0)) return -1;
+  return ble_audioStream.addFrame(databytes, nbytes);
+}
+
+//A WRITE (command 1) changes the characteristic's value right away.  A NOTIFY (command 2) goes into ble_tx_queue,
+//which sends it when the SoftDevice has room.  Returns 0 if OK, -1 if no service matches the service_id, or -2 if the
+//notification could not be queued.
 int sendBleDataByServiceAndChar(int command, int service_id, int char_id, int nbytes, const uint8_t *databytes) {
   if (DEBUG_VIA_USB) { 
-      Serial.print("sendBleDataByServiceAndChar: BLE Command " + String(command) + ", service = " + String(service_id));
-      Serial.print(", char " + String(char_id) + ", nbytes = " + String(nbytes));
+      Serial.print(F("sendBleDataByServiceAndChar: BLE Command ")); Serial.print(command); Serial.print(F(", service = ")); Serial.print(service_id);
+      Serial.print(F(", char ")); Serial.print(char_id); Serial.print(F(", nbytes = ")); Serial.print(nbytes);
       Serial.print(", data bytes = "); Serial.write(databytes, nbytes);
       Serial.println();
   }
-  //find the service that matches
-  int Iservice = 0;
-  bool data_sent = false;
-  while (Iservice < MAX_N_PRESET_SERVICES) {
-    BLE_Service_Preset *service_ptr = activated_service_presets[Iservice];
-    if (!service_ptr) {
-      //this is not a valid service pointer
-      //Serial.println("sendBleDataByServiceAndChar: comparing given service_id " + String(service_id) + " to UNINITIALIZED preset service");
-    } else {
-      //this is a valid service pointer
-      //Serial.println("sendBleDataByServiceAndChar: comparing given service_id " + String(service_id) + " to preset service " + String(service_ptr->service_id));
-      if (service_ptr->service_id == service_id) {
-        if (command == 1) {
-          if (DEBUG_VIA_USB) {
-            Serial.print(F("sendBleDataByServiceAndChar: BLE WRITE to characteristic ")); Serial.print(char_id); Serial.print(F(", data = "));
-            Serial.write(databytes, nbytes);
-            Serial.println();
-          }
-          service_ptr->write(char_id, databytes,nbytes); data_sent = true;
-        } else if (command == 2) {
-          if (DEBUG_VIA_USB) {
-            Serial.print(F("sendBleDataByServiceAndChar: BLE NOTIFY to characteristic ")); Serial.print(char_id); Serial.print(F(", data = "));
-            Serial.write(databytes, nbytes); 
-            Serial.println(); 
-          }
-          service_ptr->notify(char_id, databytes,nbytes);data_sent = true;
-        }
-      }
+  //find the service that matches (see BLE_Router.h)
+  BLE_Service_Preset *service_ptr = ble_router.getService(service_id);
+  if (service_ptr == nullptr) {
+    if (DEBUG_VIA_USB) { Serial.print(F("sendBleDataByServiceAndChar: data NOT sent to service ")); Serial.print(service_id); Serial.println(F(" because no matching service ID found")); }
+    return -1;
+  }
+
+  if (command == 1) {
+    if (DEBUG_VIA_USB) {
+      Serial.print(F("sendBleDataByServiceAndChar: BLE WRITE to characteristic ")); Serial.print(char_id); Serial.print(F(", data = "));
+      Serial.write(databytes, nbytes);
+      Serial.println();
+    }
+    bridge_stats.countBleSend(service_ptr->write(char_id, databytes,nbytes));
+  } else if (command == 2) {
+    if (DEBUG_VIA_USB) {
+      Serial.print(F("sendBleDataByServiceAndChar: BLE NOTIFY to characteristic ")); Serial.print(char_id); Serial.print(F(", data = "));
+      Serial.write(databytes, nbytes); 
+      Serial.println(); 
     }
-    Iservice++;  //increment to look at next service in the list
+    if (ble_connections.getTargetMask() == 0) {
+      bridge_stats.countBleSend(0);  //nobody to send to
+    } else if (ble_tx_queue.push(service_ptr, char_id, databytes, nbytes) < 0) {
+      if (DEBUG_VIA_USB) Serial.println(F("sendBleDataByServiceAndChar: BLE NOTIFY queue is full"));
+      return -2;
+    }
+  } else {
+    return -1;  //unknown command
   }
-  if ((data_sent == false) && DEBUG_VIA_USB) { Serial.print(F("sendBleDataByServiceAndChar: data NOT sent to service ")); Serial.print(service_id); Serial.println(F(" because no matching service ID found")); }
-  if (data_sent == false) return -1;
   return 0;
 }
 
@@ -475,4 +657,96 @@ err_t setCharacteristicNBytes(const int ble_service_id, const int ble_char_id, c
   return (err_t)99;  //we should not get here.  unknown error 
 }
 
+err_t setCharacteristicLatestValueWins(const int ble_service_id, const int ble_char_id, const bool latest_value_wins) {
+  //only the ble_generic services can be changed
+  BLE_GenericService *ble_generic = nullptr;
+  if (ble_service_id == 7) {
+    ble_generic = &ble_generic1;
+  } else if (ble_service_id == 8) {
+    ble_generic = &ble_generic2;
+  } else {
+    return (err_t)2;  //error didn't recognize the ble_service_id
+  }
+
+  //assuming that we have a valid pointer, go ahead and set it
+  if (ble_generic != nullptr) {
+    err_t err_code = ble_generic->setCharacteristicLatestValueWins(ble_char_id, latest_value_wins);
+    if (err_code != 0) return (err_t)3; //could not set it (char_id doesn't exist?)
+    return (err_t)0; //no error
+  }
+  return (err_t)99;  //we should not get here.  unknown error 
+}
+
+//Set the BLE name (now, and for when BEGIN sets it again).  Cut at BLE_DEVICE_NAME_MAX_LEN characters.
+void setDeviceName(const char *name) {
+  strncpy(deviceName, name, BLE_DEVICE_NAME_MAX_LEN);
+  deviceName[BLE_DEVICE_NAME_MAX_LEN] = '\0';
+  Bluefruit.setName(deviceName);
+}
+
+//Save the whole BLE configuration to flash (see BLE_Profile.h).  Returns 0 if OK (and gives its hash) or -1 if it
+//could not be saved.
+int saveBleProfile(uint32_t *hash) {
+  ble_profile.clear();
+  ble_profile.putU8(this_gap_addr.addr_type);
+  ble_profile.putBytes(this_gap_addr.addr, MAC_NBYTES);
+  ble_profile.putU8(was_MAC_set_by_user ? 1 : 0);
+  ble_profile.putString(deviceName);
+  ble_profile.putU8(MAX_N_PRESET_SERVICES);
+  for (int preset_id=0; preset_id < MAX_N_PRESET_SERVICES; preset_id++) ble_profile.putU8(flag_activateServicePreset[preset_id] ? 1 : 0);
+  ble_profile.putU8((uint8_t)service_preset_to_ble_advertise);
+  ble_generic1.writeProfile(ble_profile);
+  ble_generic2.writeProfile(ble_profile);
+  ble_adv_profiles.writeProfile(ble_profile);
+  ble_profile.putU8(bleBegun ? 1 : 0);
+
+  if (ble_profile.writeToFlash() != 0) return -1;
+  *hash = ble_profile.getHash();
+  return 0;
+}
+
+//Apply the BLE configuration that was saved in flash.  Like SET MAC, this only works before BEGIN.  If the profile
+//was saved after BEGIN, flag_begin is set so that the caller can begin, too.  Returns 0 if OK, -1 if there is no
+//profile, -2 if it is not valid, or -3 if BLE has already begun.
+int loadBleProfile(bool *flag_begin) {
+  *flag_begin = false;
+  if (bleBegun) return -3;
+  int ret_val = ble_profile.readFromFlash();
+  if (ret_val != 0) return ret_val;
+
+  ble_gap_addr_t addr;
+  addr.addr_type = ble_profile.getU8();
+  ble_profile.getBytes(addr.addr, MAC_NBYTES);
+  if (ble_profile.getU8() != 0) { this_gap_addr = addr; was_MAC_set_by_user = true; }
+  char name[BLE_PROFILE_MAX_STRING_NBYTES+1];
+  ble_profile.getString(name, sizeof(name));
+  setDeviceName(name);
+  const int n_presets = ble_profile.getU8();
+  for (int preset_id=0; preset_id < n_presets; preset_id++) enablePresetServiceById(preset_id, (ble_profile.getU8() != 0));  //skips any that we don't have
+  setAdvertisingServiceToPresetById(ble_profile.getU8());
+  ble_generic1.readProfile(ble_profile);
+  ble_generic2.readProfile(ble_profile);
+  ble_adv_profiles.readProfile(ble_profile);  //if it is not valid, the current one is kept
+  *flag_begin = (ble_profile.getU8() != 0);
+
+  if (!ble_profile.isOK()) { *flag_begin = false; return -2; }
+  return 0;
+}
 
+//Get the hash of the profile that is saved in flash.  Returns 0 if OK, -1 if there is none, or -2 if it is not valid.
+int getSavedBleProfileHash(uint32_t *hash) {
+  int ret_val = ble_profile.readFromFlash();
+  if (ret_val == 0) *hash = ble_profile.getHash();
+  return ret_val;
+}
+
+int eraseBleProfile(void) { return BLE_Profile::eraseFlash(); }
+
+//At power-up, apply the saved profile (if any) and begin, so that the phone can find us before the Tympan has even
+//finished booting.  Call from setup(), after setupBLE().
+void loadBleProfileAtStartup(void) {
+  bool flag_begin = false;
+  int ret_val = loadBleProfile(&flag_begin);
+  if (DEBUG_VIA_USB) { Serial.print("nRF52840 Firmware: startup: load BLE profile: "); Serial.println((ret_val == 0) ? "OK" : ((ret_val == -1) ? "none saved" : "not valid")); }
+  if ((ret_val == 0) && flag_begin) beginAllBleServices(1);
+}
@@ -0,0 +1,203 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to measure how fast a given phone (and this firmware) can move data over BLE.
+// It is for getting numbers for each phone model before we ship a configuration.  There are two tests:
+//
+//   TX: The nRF sends notifications on one characteristic as fast as the SoftDevice will take them.  Each one starts
+//       with a 4-byte sequence number (little endian) so that the phone can check for lost packets.
+//   RX: The nRF counts the writes from the phone (on any characteristic, or via the UART services) and throws them
+//       away.  Nothing is forwarded to the Tympan while this test runs.  The clock starts with the first write.
+//
+// Start a test with "THROUGHPUT TX X Y N SECS" (X is the service_id and Y is the char_id, as for BLENOTIFY, N is
+// the bytes per notification (0 for as many as the MTU allows), and SECS is how long to run) or "THROUGHPUT RX
+// SECS".  "THROUGHPUT STOP" ends it early.  "GET THROUGHPUT" replies with the results (of the test that is running
+// or of the last one):
+//
+//   "TX DONE KBPS=k N=n BYTES=b MSEC=t FULL=f LAT=p50,p90,p99,max"
+//   "RX DONE KBPS=k N=n BYTES=b MSEC=t GAP=p50,p90,p99,max"
+//
+// where N is the number of packets, FULL is the number of times that the SoftDevice refused a notification, LAT is
+// the time (msec) from handing a notification to the SoftDevice until the phone acknowledged it, and GAP is the
+// time (msec) between writes, as seen from loop().  The tests can also be started from the USB serial menu.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_THROUGHPUT_TEST_H
+#define BLE_THROUGHPUT_TEST_H
+
+#include <Arduino.h>
+#include "BLE_Service_Preset.h"
+#include "BLE_Router.h"
+#include "BLE_TxQueue.h"
+
+#define BLE_TPUT_N_BINS 128          //latency (or gap) histogram, 1 msec per bin.  The last bin holds everything longer.
+#define BLE_TPUT_MAX_IN_FLIGHT 16    //must be more than BLE_HVN_QUEUE_SIZE
+
+extern bool bleConnected;
+extern int getMaxBleDataNBytes(void);
+extern BLE_Router ble_router;
+extern BLE_TxQueue ble_tx_queue;
+
+class BLE_ThroughputTest {
+  public:
+    enum STATE { IDLE = 0, TX_RUNNING, RX_RUNNING, TX_DONE, RX_DONE };
+
+    BLE_ThroughputTest(void) {}
+
+    //Returns 0 if started, -1 if there is no such service (or it hasn't begun), or -2 if not connected.  When the
+    //test ends, the results are printed to report_ptr (if not null).
+    int startTx(const int service_id, const int char_id, const int nbytes, const int secs, Print *report_ptr = nullptr);
+    int startRx(const int secs, Print *report_ptr = nullptr);
+    void stop(void) { if ((state == TX_RUNNING) || (state == RX_RUNNING)) finish(); }
+
+    bool isRxRunning(void) { return (state == RX_RUNNING); }
+
+    //Call from loop(), after ble_tx_queue.service().  Sends the TX test's notifications and ends the test when its
+    //time is up.
+    void service(void);
+
+    //Call for every write from the phone (or block of UART data).  Returns true if the RX test took the data (so
+    //don't forward it to the Tympan).
+    bool onRx(const size_t nbytes);
+
+    //Write the results (see above) into text.  Returns the length.
+    int getResults(char *text, const int len_text);
+
+  private:
+    int state = IDLE;
+    Print *report_ptr = nullptr;
+    BLE_Service_Preset *service_ptr = nullptr;
+    int char_id = 0, packet_nbytes = 0;
+    unsigned long duration_millis = 0, start_millis = 0, end_millis = 0;
+    bool started = false;  //the RX test does not start its clock until the first write
+
+    uint32_t n_packets = 0, n_bytes = 0, n_refused = 0;
+    uint32_t hist[BLE_TPUT_N_BINS];
+
+    //TX: when each notification that has not yet been acknowledged was sent
+    unsigned long send_micros[BLE_TPUT_MAX_IN_FLIGHT];
+    int n_in_flight = 0, in_flight_read = 0;
+    uint32_t tx_complete_seen = 0;
+    unsigned long last_rx_micros = 0;
+
+    void reset(const int new_state, const int secs, Print *_report_ptr);
+    void finish(void);
+    void addToHist(const unsigned long dt_micros) { hist[min((unsigned long)(BLE_TPUT_N_BINS-1), dt_micros / 1000UL)]++; }
+    int percentile(const int pct);
+};
+
+void BLE_ThroughputTest::reset(const int new_state, const int secs, Print *_report_ptr) {
+  state = new_state;  report_ptr = _report_ptr;
+  duration_millis = 1000UL * (unsigned long)max(1, secs);
+  start_millis = end_millis = millis();  started = false;
+  n_packets = 0; n_bytes = 0; n_refused = 0;
+  for (int i=0; i < BLE_TPUT_N_BINS; i++) hist[i] = 0;
+  n_in_flight = 0; in_flight_read = 0;
+  tx_complete_seen = ble_tx_queue.getTxCompleteTotal();
+}
+
+int BLE_ThroughputTest::startTx(const int service_id, const int _char_id, const int nbytes, const int secs, Print *_report_ptr) {
+  BLE_Service_Preset *_service_ptr = ble_router.getService(service_id);
+  if (_service_ptr == nullptr) return -1;
+  if (!bleConnected) return -2;
+  service_ptr = _service_ptr;  char_id = _char_id;
+  packet_nbytes = ((nbytes <= 0) || (nbytes > getMaxBleDataNBytes())) ? getMaxBleDataNBytes() : max(4, nbytes);
+  reset(TX_RUNNING, secs, _report_ptr);
+  started = true;
+  return 0;
+}
+
+int BLE_ThroughputTest::startRx(const int secs, Print *_report_ptr) {
+  if (!bleConnected) return -2;
+  reset(RX_RUNNING, secs, _report_ptr);
+  return 0;
+}
+
+void BLE_ThroughputTest::service(void) {
+  if ((state != TX_RUNNING) && (state != RX_RUNNING)) return;
+  if (started && ((millis() - start_millis) >= duration_millis)) { finish(); return; }
+  if (!bleConnected) { finish(); return; }
+  if (state != TX_RUNNING) return;
+
+  //time the notifications that the phone has acknowledged (oldest first).  Some acknowledgements might be for
+  //packets that were not ours, so this is only close.
+  const uint32_t tx_complete_now = ble_tx_queue.getTxCompleteTotal();
+  uint32_t n_acked = tx_complete_now - tx_complete_seen;  tx_complete_seen = tx_complete_now;
+  const unsigned long now_micros = micros();
+  while ((n_acked > 0) && (n_in_flight > 0)) {
+    addToHist(now_micros - send_micros[in_flight_read]);
+    in_flight_read = (in_flight_read + 1) % BLE_TPUT_MAX_IN_FLIGHT;
+    n_in_flight--;  n_acked--;
+  }
+
+  //send as many as the SoftDevice has room for
+  uint8_t data[BLE_MAX_DATA_NBYTES];
+  while ((ble_tx_queue.getNPending() < BLE_HVN_QUEUE_SIZE) && (n_in_flight < BLE_TPUT_MAX_IN_FLIGHT)) {
+    for (int i=0; i<4; i++) data[i] = (uint8_t)(0x000000FF & (n_packets >> (i*8)));
+    for (int i=4; i < packet_nbytes; i++) data[i] = (uint8_t)i;
+    const unsigned long t_micros = micros();
+    size_t nbytes_sent = service_ptr->notify(char_id, data, packet_nbytes);
+    if (nbytes_sent == 0) { n_refused++; break; }  //try again next time
+    ble_tx_queue.addPacketsInFlight(1);
+    send_micros[(in_flight_read + n_in_flight) % BLE_TPUT_MAX_IN_FLIGHT] = t_micros;  n_in_flight++;
+    n_packets++;  n_bytes += packet_nbytes;  //some services only return true/false, not the bytes sent
+  }
+}
+
+bool BLE_ThroughputTest::onRx(const size_t nbytes) {
+  if (state != RX_RUNNING) return false;
+  const unsigned long now_micros = micros();
+  if (!started) {
+    start_millis = millis();  started = true;  //the clock starts with the first write
+  } else {
+    addToHist(now_micros - last_rx_micros);
+  }
+  last_rx_micros = now_micros;
+  n_packets++;  n_bytes += nbytes;
+  return true;
+}
+
+void BLE_ThroughputTest::finish(void) {
+  end_millis = millis();
+  if (!started) start_millis = end_millis;  //the RX test never got anything
+  state = (state == TX_RUNNING) ? TX_DONE : RX_DONE;
+  if (report_ptr) {
+    char text[96];
+    getResults(text, sizeof(text));
+    report_ptr->print("BLE_ThroughputTest: "); report_ptr->println(text);
+  }
+}
+
+//the smallest bin (in msec) that has at least pct percent of the counts at or below it
+int BLE_ThroughputTest::percentile(const int pct) {
+  uint32_t n_total = 0;
+  for (int i=0; i < BLE_TPUT_N_BINS; i++) n_total += hist[i];
+  if (n_total == 0) return 0;
+  const uint32_t n_target = (uint32_t)(((uint64_t)n_total * pct + 99) / 100);
+  uint32_t n_sum = 0;
+  for (int i=0; i < BLE_TPUT_N_BINS; i++) { n_sum += hist[i]; if (n_sum >= n_target) return i; }
+  return BLE_TPUT_N_BINS-1;
+}
+
+int BLE_ThroughputTest::getResults(char *text, const int len_text) {
+  if (state == IDLE) return snprintf(text, len_text, "IDLE");
+  const bool is_tx = ((state == TX_RUNNING) || (state == TX_DONE));
+  const bool is_running = ((state == TX_RUNNING) || (state == RX_RUNNING));
+  const unsigned long dt_millis = (is_running ? millis() : end_millis) - start_millis;
+  const unsigned long kbps_x10 = (unsigned long)(((uint64_t)n_bytes * 80ULL) / max(1UL, dt_millis));  //bits per msec is kbit/sec
+
+  int len = snprintf(text, len_text, "%s %s KBPS=%lu.%lu N=%lu BYTES=%lu MSEC=%lu", is_tx ? "TX" : "RX", is_running ? "RUNNING" : "DONE",
+    kbps_x10 / 10, kbps_x10 % 10, (unsigned long)n_packets, (unsigned long)n_bytes, dt_millis);
+  if ((len < len_text) && is_tx) len += snprintf(text + len, len_text - len, " FULL=%lu", (unsigned long)n_refused);
+  if (len < len_text) {
+    //the top bin holds everything longer, so report the max as the highest bin that has anything
+    int max_bin = 0;
+    for (int i=0; i < BLE_TPUT_N_BINS; i++) if (hist[i] > 0) max_bin = i;
+    len += snprintf(text + len, len_text - len, " %s=%d,%d,%d,%d", is_tx ? "LAT" : "GAP", percentile(50), percentile(90), percentile(99), max_bin);
+  }
+  return min(len, len_text-1);
+}
+
+#endif
@@ -0,0 +1,197 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to queue up the notifications that the Tympan asks us to send (BLENOTIFY or
+// a binary NOTIFY frame) so that they go out as fast as the BLE connection can carry them.
+//
+// A notification is only handed to the SoftDevice when it has a free notification buffer.  Otherwise, it waits in
+// this queue and is sent from loop() when the phone has acknowledged earlier packets (BLE_GATTS_EVT_HVN_TX_COMPLETE).
+// If the phone hasn't subscribed to that characteristic, it is thrown away right away (and counted as a failed BLE
+// send), so that it never holds up the notifications behind it.  If the SoftDevice refuses it for another reason
+// (such as its buffers being full), it is retried until BLE_TX_QUEUE_RETRY_MILLIS has passed.  Then, it is thrown
+// away, too.
+//
+// Some characteristics are "latest value wins" (see BLE_Service_Preset::isLatestValueWins()).  For these, a new
+// value replaces the one that is already waiting in the queue (if it has not been sent yet).  It does not queue up
+// behind it.  So, a congested link shows the latest value rather than falling ever further behind.
+//
+// With several phones connected (see BLE_Connections.h), each notification remembers which of them it is for (the
+// "SET CONNTARGET" at the time it was queued).  It leaves the queue once all of them have taken it, so the slowest of
+// them sets the pace.  A phone that has not subscribed (or that refuses it while another phone has taken it) is
+// dropped from that notification right away, so that it does not hold up the others.  The SoftDevice's buffers are
+// counted for each connection.  A phone that disconnects is dropped from every notification that is waiting.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BLE_TX_QUEUE_H
+#define BLE_TX_QUEUE_H
+
+#include <Arduino.h>
+#include "BLE_Service_Preset.h"
+#include "BridgeStats.h"
+#include "BLE_Connections.h"
+
+//how many notification packets the SoftDevice can hold at once, for each connection.  This is the "hvn_qsize"
+//that Adafruit's Bluefruit.configPrphBandwidth(BANDWIDTH_MAX) gives us (see setupBLE()).  Change both together.
+#define BLE_HVN_QUEUE_SIZE 3
+
+#define BLE_TX_QUEUE_N_ENTRIES 16          //how many notifications can wait here.  Each takes about 250 bytes of RAM.
+#define BLE_TX_QUEUE_RETRY_MILLIS 250UL    //how long to keep retrying a notification that the SoftDevice refuses (but that the phone has subscribed to)
+
+extern BridgeStats bridge_stats;
+extern BLE_Connections ble_connections;
+
+class BLE_TxQueue {
+  public:
+    BLE_TxQueue(void) {}
+
+    //Add a notification (for the connections that are targeted now) to the queue.  Returns 0 if it was queued, 1 if
+    //it replaced a value that was already waiting (only for "latest value wins" characteristics), or -1 if the queue
+    //is full, the data is too long, or no targeted phone is connected.
+    int push(BLE_Service_Preset *service_ptr, const int char_id, const uint8_t *data, const size_t nbytes);
+
+    //Call from loop().  Hands as many queued notifications to the SoftDevice as it has room for.  Returns how many.
+    int service(void);
+
+    void clear(void) { read_ind = 0; n_queued = 0; }
+    int getNQueued(void) { return n_queued; }
+    int getNInFlight(void) { int n = 0; for (int i=0; i < BLE_MAX_CONNECTIONS; i++) n = max(n, links[i].packets_in_flight); return n; }  //the busiest connection
+    int getNPending(void) { return n_queued + getNInFlight(); }  //queued here, plus given to the SoftDevice but not yet sent
+
+    //For packets that were given to the SoftDevice without going through this queue (ie, SEND via the UART services).
+    //The first version is for when we don't know which connection they went to, so it counts them against all of them.
+    void addPacketsInFlight(const int n_packets) { for (int i=0; i < BLE_MAX_CONNECTIONS; i++) if (ble_connections.isConnected(i)) links[i].packets_in_flight += n_packets; }
+    void addPacketsInFlight(const int slot, const int n_packets) { if ((slot >= 0) && (slot < BLE_MAX_CONNECTIONS)) links[slot].packets_in_flight += n_packets; }
+
+    //These two are called from the BLE callbacks, which run in the SoftDevice's task, not in loop().  So, they only
+    //bump a counter.  The counters are only ever written here, so the 32-bit writes are safe to read from loop().
+    //Call onDisconnect() before ble_connections.onDisconnect(), so that the slot can still be found.
+    void onTxComplete(const uint16_t conn_handle, const uint8_t count) {
+      tx_complete_total += count;
+      const int slot = ble_connections.getSlot(conn_handle);
+      if (slot >= 0) links[slot].tx_complete_total += count;
+    }
+    void onDisconnect(const uint16_t conn_handle) {
+      const int slot = ble_connections.getSlot(conn_handle);
+      if (slot >= 0) links[slot].disconnect_total++;
+    }
+    uint32_t getTxCompleteTotal(void) { return tx_complete_total; }  //all connections.  For timing the packets (see BLE_ThroughputTest.h)
+
+  private:
+    typedef struct {
+      BLE_Service_Preset *service_ptr;
+      int char_id;
+      uint16_t nbytes;
+      unsigned long first_try_millis;
+      bool has_been_tried;
+      bool has_been_sent;   //to at least one phone
+      uint8_t conn_mask;    //one bit per slot in ble_connections, for the phones that still need it
+      uint8_t data[BLE_MAX_DATA_NBYTES];
+    } Entry_t;
+    Entry_t entries[BLE_TX_QUEUE_N_ENTRIES];  //circular buffer
+    int read_ind = 0;   //oldest entry
+    int n_queued = 0;
+
+    //for each connection (by slot in ble_connections)
+    typedef struct {
+      int packets_in_flight = 0;  //packets that we have given to the SoftDevice that it has not finished sending
+      volatile uint32_t tx_complete_total = 0, disconnect_total = 0;  //written by the BLE callbacks
+      uint32_t tx_complete_seen = 0, disconnect_seen = 0;             //how much of them has been handled by service()
+    } Link_t;
+    Link_t links[BLE_MAX_CONNECTIONS];
+    volatile uint32_t tx_complete_total = 0;  //all connections
+
+    Entry_t* entryAt(const int i) { return &entries[(read_ind + i) % BLE_TX_QUEUE_N_ENTRIES]; }
+    void pop(void) { read_ind = (read_ind + 1) % BLE_TX_QUEUE_N_ENTRIES; n_queued--; }
+    void dropConnections(Entry_t *entry, const uint8_t mask);
+};
+
+int BLE_TxQueue::push(BLE_Service_Preset *service_ptr, const int char_id, const uint8_t *data, const size_t nbytes) {
+  if (nbytes > BLE_MAX_DATA_NBYTES) return -1;
+  const uint8_t conn_mask = ble_connections.getTargetMask();
+  if (conn_mask == 0) return -1;  //nobody to send to
+
+  //for "latest value wins", look for an older value that hasn't been sent yet (to anyone).  Overwrite it in place.
+  if (service_ptr->isLatestValueWins(char_id)) {
+    for (int i=0; i < n_queued; i++) {
+      Entry_t *entry = entryAt(i);
+      if ((entry->service_ptr == service_ptr) && (entry->char_id == char_id) && (entry->conn_mask == conn_mask) && !entry->has_been_sent) {
+        memcpy(entry->data, data, nbytes);  entry->nbytes = nbytes;
+        bridge_stats.ble_tx_coalesced++;
+        return 1;
+      }
+    }
+  }
+
+  //otherwise, add it to the end
+  if (n_queued >= BLE_TX_QUEUE_N_ENTRIES) return -1;
+  Entry_t *entry = entryAt(n_queued);
+  entry->service_ptr = service_ptr;  entry->char_id = char_id;
+  memcpy(entry->data, data, nbytes);  entry->nbytes = nbytes;
+  entry->has_been_tried = false;  entry->has_been_sent = false;  entry->conn_mask = conn_mask;
+  n_queued++;
+  return 0;
+}
+
+int BLE_TxQueue::service(void) {
+  //take account of the packets that have gone out (or that were thrown away because the link dropped)
+  for (int i=0; i < BLE_MAX_CONNECTIONS; i++) {
+    Link_t *link = &links[i];
+    const uint32_t tx_complete_now = link->tx_complete_total, disconnect_now = link->disconnect_total;
+    if (disconnect_now != link->disconnect_seen) {
+      link->packets_in_flight = 0;  //the SoftDevice frees all of the buffers when the connection drops
+    } else {
+      link->packets_in_flight = max(0, link->packets_in_flight - (int)(tx_complete_now - link->tx_complete_seen));  //some might not be ours
+    }
+    link->tx_complete_seen = tx_complete_now;  link->disconnect_seen = disconnect_now;
+  }
+
+  //send whatever the SoftDevice has room for, oldest first
+  const uint8_t connected_mask = ble_connections.getConnectedMask();
+  int n_sent = 0;
+  while (n_queued > 0) {
+    Entry_t *entry = entryAt(0);
+    entry->conn_mask &= connected_mask;  //forget the phones that have gone
+
+    uint8_t refused_mask = 0, unsubscribed_mask = 0;
+    for (int i=0; i < BLE_MAX_CONNECTIONS; i++) {
+      if (!(entry->conn_mask & (1 << i))) continue;
+      if (!entry->service_ptr->isSubscribed(ble_connections.getHandle(i), entry->char_id)) { unsubscribed_mask |= (1 << i); continue; }
+      if (links[i].packets_in_flight >= BLE_HVN_QUEUE_SIZE) continue;  //no room for this phone yet
+      size_t nbytes_sent = entry->service_ptr->notifyConnection(ble_connections.getHandle(i), entry->char_id, entry->data, entry->nbytes);
+      if (nbytes_sent > 0) {
+        bridge_stats.countBleSend(nbytes_sent);  ble_connections.countTx(i, nbytes_sent);
+        links[i].packets_in_flight++;  n_sent++;
+        entry->conn_mask &= ~(1 << i);  entry->has_been_sent = true;
+      } else {
+        refused_mask |= (1 << i);
+      }
+    }
+
+    //a phone that has not subscribed will never take it, so don't let it hold up the queue.  (Nor one that refuses
+    //what another phone took, for the services that can't tell us who has subscribed.)
+    if (unsubscribed_mask) dropConnections(entry, unsubscribed_mask);
+    if (refused_mask && entry->has_been_sent) dropConnections(entry, refused_mask);
+
+    if (entry->conn_mask == 0) { pop(); continue; }  //everyone has it (or has gone)
+    if (refused_mask) {
+      //refused, probably for lack of buffers.  Try again next time...unless we have been trying for too long
+      if (!entry->has_been_tried) { entry->has_been_tried = true; entry->first_try_millis = millis(); }
+      if ((millis() - entry->first_try_millis) > BLE_TX_QUEUE_RETRY_MILLIS) { dropConnections(entry, entry->conn_mask); pop(); }
+    }
+    break;  //the oldest is still waiting for room, so the rest must wait, too
+  }
+  return n_sent;
+}
+
+//give up on sending this entry to these phones
+void BLE_TxQueue::dropConnections(Entry_t *entry, const uint8_t mask) {
+  for (int i=0; i < BLE_MAX_CONNECTIONS; i++) {
+    if (!(entry->conn_mask & mask & (1 << i))) continue;
+    bridge_stats.countBleSend(0);  ble_connections.countTx(i, 0);
+  }
+  entry->conn_mask &= ~mask;
+}
+
+#endif
@@ -0,0 +1,59 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This code will run on the **nRF52** to count what the UART<->BLE bridge is doing: how much data is going each
+// way, how many messages from the Tympan failed (and why), and how many BLE sends failed.  The Tympan can read
+// the counters via "GET STATS" and can zero them via "SET STATS=RESET".  See AT_Processor::processGetStats().
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BRIDGE_STATS_H
+#define BRIDGE_STATS_H
+
+#include <string.h>  //for memset()
+
+//Error codes 1 through BRIDGE_STATS_MAX_ERR_CODE each get their own counter.  Any other error code (such as
+//NO_BLE_CONNECTION) is counted in fail_by_code[0].
+#define BRIDGE_STATS_MAX_ERR_CODE 7
+
+class BridgeStats {
+  public:
+    BridgeStats(void) { reset(); }
+
+    //from the Tympan, out to BLE
+    uint32_t uart_rx_bytes;   //bytes received from the Tympan over the UART
+    uint32_t uart_rx_msgs;    //messages (AT messages and binary frames) received from the Tympan
+    uint32_t ble_tx_bytes;    //data bytes that were accepted by a BLE notify or write
+    uint32_t ble_tx_msgs;     //BLE notify or write calls that were accepted
+    uint32_t ble_tx_failed;   //BLE notify or write calls that returned 0 (ie, the data was not sent)
+    uint32_t ble_tx_coalesced; //notifications that replaced an unsent value in the TX queue (see BLE_TxQueue.h)
+
+    //from BLE, out to the Tympan
+    uint32_t ble_rx_bytes;    //data bytes received over BLE (UART services and characteristic writes)
+    uint32_t ble_rx_msgs;     //BLE writes (or UART service bursts) received
+    uint32_t ble_rx_dropped;  //BLE writes (or connection events) dropped because the event queue was full (see BLE_EventQueue.h)
+    uint32_t uart_tx_bytes;   //bytes of that data (including any framing) written to the Tympan over the UART
+
+    //messages from the Tympan that failed, counted by error code (see AT_Processor)
+    uint32_t fail_by_code[BRIDGE_STATS_MAX_ERR_CODE+1];
+
+    void reset(void) {
+      uart_rx_bytes = 0; uart_rx_msgs = 0;
+      ble_tx_bytes = 0; ble_tx_msgs = 0; ble_tx_failed = 0; ble_tx_coalesced = 0;
+      ble_rx_bytes = 0; ble_rx_msgs = 0; ble_rx_dropped = 0; uart_tx_bytes = 0;
+      memset(fail_by_code, 0, sizeof(fail_by_code));
+    }
+
+    void countFailure(const int err_code) {
+      if (err_code == 0) return;  //not a failure
+      if ((err_code > 0) && (err_code <= BRIDGE_STATS_MAX_ERR_CODE)) { fail_by_code[err_code]++; } else { fail_by_code[0]++; }
+    }
+
+    void countBleSend(const size_t nbytes_sent) {
+      if (nbytes_sent == 0) { ble_tx_failed++; return; }
+      ble_tx_msgs++;  ble_tx_bytes += nbytes_sent;
+    }
+};
+
+#endif
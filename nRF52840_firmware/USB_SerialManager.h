@@ -13,10 +13,12 @@
 
 extern bool bleBegun;
 extern bool bleConnected;
+extern BLE_Connections ble_connections;
 extern const char versionString[];
 extern void beginAllBleServices(int);
 extern void issueATCommand(const char *, unsigned int);
 extern void issueATCommand(const String&);
+extern void issueATBinaryFrame(const uint8_t *, unsigned int);
 extern bool enablePresetServiceById(int preset_id, bool enable);
 extern int setAdvertisingServiceToPresetById(int preset_id);
 extern const int max_n_preset_services;
@@ -29,7 +31,7 @@ void printHelpToUSB(void) {
   Serial.print(  "   : Version string: "); Serial.println(versionString);
   Serial.println(" : Status:");
   Serial.print(  "   : bleBegun: "); Serial.println(bleBegun);
-  Serial.print(  "   : bleConnected: "); Serial.println(bleConnected);
+  Serial.print(  "   : bleConnected: "); Serial.print(bleConnected); Serial.print(", n connections: "); Serial.println(ble_connections.getNConnected());
   Serial.println("   : Send 'h' via USB to get this help");
   Serial.println("   : Send 'J' via USB to send 'J' to the Tympan");
   if (bleBegun == false) {
@@ -50,11 +52,13 @@ void printHelpToUSB(void) {
     Serial.println("   : send '7' to enable service: " + String(all_service_presets[7]->getName(foo_str)) + " with 2 characteristic");
     Serial.println("   : send '&' to enable advertising of service: " + String(all_service_presets[7]->getName(foo_str)));
     Serial.println("   : send '8' to enable service: " + String(all_service_presets[8]->getName(foo_str)) + " with 3 characteristics");
+    Serial.println("   : send 'T' to enable service: " + String(all_service_presets[7]->getName(foo_str)) + " with 2 characteristics, as one BATCH");
     Serial.println("   : send '*' to enable advertising of service: " + String(all_service_presets[8]->getName(foo_str)));
     Serial.println("   : Send 'b' or 'B' to begin all enabled services");
   } else {
     Serial.println(" : Trial Commands:");
     Serial.println("   : Send 'v' to send AT command 'GET ADVERT_SERVICE_ID'");
+    Serial.println("   : Send 'V' to send tagged AT command '#V1 GET ADVERT_SERVICE_ID'");
     Serial.println("   : Send 'q' to send AT command 'BLEWRITE 1 6 5 Zelda'");
     Serial.println("   : Send 'w' to send AT command 'BLENOTIFY 2 0 1 9'");
     Serial.println("   : Send 'e' to send AT command 'BLENOTIFY 3 0 2 aa'");
@@ -66,7 +70,13 @@ void printHelpToUSB(void) {
     Serial.println("   : Send 'i' to send AT command 'BLENOTIFY 6 1 4 5678'");
     Serial.println("   : Send 'o' to send AT command 'BLENOTIFY 7 1 1 5'");
     Serial.println("   : Send 'p' to send AT command 'BLENOTIFY 8 2 4 4 0x42C80000' (which is 100.0)");
+    Serial.println("   : Send 'a' to send binary frame for NOTIFY 8 2 4 0x42C80000 (which is 100.0)");
   }
+  Serial.println(" : Development:");
+  Serial.println("   : Send 'S' to send AT command 'GET STATS'");
+  Serial.println("   : Send 'F' to send AT command 'SET FLOWCONTROL=ON' (or 'f' for OFF)");
+  Serial.println("   : Send 'Z' to time the AT parser and the BLEDATA framing (not while connected)");
+  Serial.println("   : Send 'X' to run a 10 sec BLE throughput test sending on the Tympan UART service (or 'x' for receiving)");
 }
 
 int serialManager_processCharacter(char c) {
@@ -156,6 +166,27 @@ int serialManager_processCharacter(char c) {
       cmd = "SVCSETUP 8 2 CHARNBYTES=4";   issueATCommand(cmd);
       }
       break;
+    case 'T':
+      {
+      Serial.println("nRF52840 Firmware: enabling preset 7 via one BATCH");
+      String cmd;
+      cmd = "BATCH START";   issueATCommand(cmd);
+      cmd = "SET MAC=AABBCCDDEEFF";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 SERVICEUUID=00112233445566778899AABBCCDDEEFF";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 SERVICENAME=ServiceT";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 ADDCHAR=00112233445566778899AABBCCDDEEFE";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 CHARPROPS=00001010";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 CHARNAME=MyWrite";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 CHARNBYTES=1";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 0 ADDCHAR=00112233445566778899AABBCCDDEEFD";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 1 CHARPROPS=00010010";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 1 CHARNAME=MyRead";   issueATCommand(cmd);
+      cmd = "SVCSETUP 7 1 CHARNBYTES=1";   issueATCommand(cmd);
+      cmd = "SET ENABLE_SERVICE_ID7=TRUE";   issueATCommand(cmd);
+      cmd = "SET ADVERT_SERVICE_ID=7";   issueATCommand(cmd);
+      cmd = "BATCH END";   issueATCommand(cmd);
+      }
+      break;
     case '!':
       Serial.println("nRF52840 Firmware: choose preset 1 for advertising");
       //setAdvertisingServiceToPresetById(1);
@@ -197,6 +228,9 @@ int serialManager_processCharacter(char c) {
     case 'v':
       issueATCommand(String("GET ADVERT_SERVICE_ID"));
       break;
+    case 'V':
+      issueATCommand(String("#V1 GET ADVERT_SERVICE_ID"));
+      break;
     case 'q':
       issueATCommand(String("BLEWRITE 1 6 5 Zelda"));
       break;
@@ -254,6 +288,34 @@ int serialManager_processCharacter(char c) {
         issueATCommand(message,len_msg);
       }
       break;
+    case 'a':
+      {
+        const unsigned int len_frame = 7+4+1;
+        uint8_t frame[len_frame] = {DATASTREAM_START_CHAR, 2, 8, 2, 4, 0, DATASTREAM_SEPARATOR, 0x42, 0xC8, 0x00, 0x00, DATASTREAM_END_CHAR};
+        issueATBinaryFrame(frame,len_frame);
+      }
+      break;
+    case 'S':
+      issueATCommand(String("GET STATS"));
+      break;
+    case 'F':
+      issueATCommand(String("SET FLOWCONTROL=ON"));
+      break;
+    case 'f':
+      issueATCommand(String("SET FLOWCONTROL=OFF"));
+      break;
+    case 'Z':
+      {
+        static AT_Benchmark benchmark(&Serial);  //static because it holds its own AT_Processor, which is big
+        benchmark.run();
+      }
+      break;
+    case 'X':
+      if (ble_throughput_test.startTx(2, 0, 0, 10, &Serial) != 0) Serial.println("nRF52840 Firmware: throughput test needs a connection and service 2");
+      break;
+    case 'x':
+      if (ble_throughput_test.startRx(10, &Serial) != 0) Serial.println("nRF52840 Firmware: throughput test needs a connection");
+      break;
   }
   return 0;
 }
@@ -0,0 +1,39 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Runs AT_Benchmark (see ../AT_Benchmark.h) on a PC.  The whole sketch is compiled, just like the Arduino IDE
+// does, but against the stand-ins in shim/.  Usage:
+//
+//    at_benchmark_host [wrap_step]    start each message every wrap_step bytes across the parser's buffer
+//
+// Returns 0 if every reply was the same wherever the message started in the buffer.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+
+//the prototypes that the Arduino IDE would have generated for the sketch
+void serviceLEDs(unsigned long);
+void serviceGPIO(unsigned long);
+void issueATCommand(const String &str);
+void issueATCommand(const char *msg, unsigned int len_msg);
+void globalWriteBleDataToTympan(const int service_id, const int char_id, uint8_t data[], const size_t len);
+
+#include "../nRF52840_firmware.ino"
+
+//print the benchmark's report to the console
+class StdoutPrint : public Print {
+  public:
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t *buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+};
+
+int main(int argc, char **argv) {
+  const int wrap_step = (argc > 1) ? atoi(argv[1]) : AT_PROCESSOR_N_BUFFER/8;
+  StdoutPrint console;
+  AT_Benchmark benchmark(&console);
+  const int ret_val = benchmark.run(wrap_step);
+  fflush(stdout);
+  return (ret_val == 0) ? 0 : 1;
+}
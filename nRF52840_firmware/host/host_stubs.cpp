@@ -0,0 +1,36 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// The definitions behind the stand-ins in shim/ (see host/Makefile).
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+#include <Arduino.h>
+#include <bluefruit.h>
+#include <InternalFileSystem.h>
+
+HardwareSerial Serial, Serial1;
+AdafruitBluefruit Bluefruit;
+InternalFileSystem InternalFS;
+
+unsigned long micros(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + (unsigned long)(ts.tv_nsec / 1000);
+}
+unsigned long millis(void) { return micros() / 1000UL; }
+void delay(unsigned long dt_millis) { const unsigned long start = millis(); while ((millis() - start) < dt_millis) {} }
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return LOW; }
+void analogWrite(int, int) {}
+String getMcuUniqueID(void) { return String("0123456789ABCDEF"); }
+
+BLEService& BLECharacteristic::parentService(void) { static BLEService service; return service; }
+
+//the SoftDevice.  Nothing is ever connected, so these only say OK.
+uint32_t sd_ble_gap_phy_update(uint16_t, const ble_gap_phys_t *) { return NRF_SUCCESS; }
+uint32_t sd_ble_gap_conn_param_update(uint16_t, const ble_gap_conn_params_t *) { return NRF_SUCCESS; }
+uint32_t sd_ble_gap_adv_set_configure(uint8_t *, const ble_gap_adv_data_t *, const ble_gap_adv_params_t *) { return NRF_SUCCESS; }
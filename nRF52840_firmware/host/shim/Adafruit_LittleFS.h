@@ -0,0 +1,2 @@
+//Stand-in for Adafruit's LittleFS (see InternalFileSystem.h)
+#include "InternalFileSystem.h"
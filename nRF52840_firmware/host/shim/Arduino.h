@@ -0,0 +1,124 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// A small stand-in for the Adafruit nRF52 Arduino core, so that the firmware's parser and framing code can be built
+// and run on a PC (see host/Makefile).  Only what the firmware uses is here.  Serial ports throw away what is
+// written to them (they only count it), and nothing is ever received.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_SHIM_ARDUINO_H
+#define HOST_SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+typedef bool boolean;
+typedef int32_t err_t;
+#define F(x) x
+#define HEX 16
+#define DEC 10
+#define OUTPUT 1
+#define INPUT 0
+#define INPUT_PULLUP 2
+#define HIGH 1
+#define LOW 0
+#define ERROR_NONE 0
+#define VERIFY_STATUS(x) do { err_t _e = (x); if (_e) return _e; } while (0)
+#define __disable_irq()
+#define __enable_irq()
+
+class String {
+  public:
+    String(void) {}
+    String(const char *c) : s(c ? c : "") {}
+    String(const std::string &c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(float v) : s(std::to_string(v)) {}
+    const char *c_str(void) const { return s.c_str(); }
+    unsigned int length(void) const { return s.size(); }
+    char charAt(unsigned int i) const { return (i < s.size()) ? s[i] : '\0'; }
+    void remove(unsigned int i, unsigned int n) { s.erase(i, n); }
+    String &operator+=(const String &o) { s += o.s; return *this; }
+    String &operator+=(const char *o) { s += o; return *this; }
+    String &operator+=(char o) { s += o; return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+    friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.s); }
+  private:
+    std::string s;
+};
+
+class Print {
+  public:
+    virtual ~Print(void) {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *b, size_t n) { for (size_t i=0; i<n; i++) write(b[i]); return n; }
+    size_t write(const char *b, size_t n) { return write((const uint8_t *)b, n); }
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    virtual int availableForWrite(void) { return 64; }
+    virtual void flush(void) {}
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC) { char b[24]; snprintf(b, sizeof(b), (base == HEX) ? "%lX" : "%ld", v); return write(b); }
+    size_t print(unsigned long v, int base = DEC) { char b[24]; snprintf(b, sizeof(b), (base == HEX) ? "%lX" : "%lu", v); return write(b); }
+    size_t print(double v, int digits = 2) { char b[48]; snprintf(b, sizeof(b), "%.*f", digits, v); return write(b); }
+    size_t println(void) { return write((const uint8_t *)"\r\n", 2); }
+    template <class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <class T> size_t println(T v, int b) { size_t n = print(v, b); return n + println(); }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available(void) { return 0; }
+    virtual int read(void) { return -1; }
+    virtual int peek(void) { return -1; }
+    size_t readBytes(char *b, size_t n) { size_t i=0; while ((i < n) && (available() > 0)) b[i++] = (char)read(); return i; }
+    size_t readBytes(uint8_t *b, size_t n) { return readBytes((char *)b, n); }
+    void setTimeout(unsigned long) {}
+};
+
+class HardwareSerial : public Stream {
+  public:
+    size_t write(uint8_t) override { n_bytes_written++; return 1; }
+    size_t write(const uint8_t *, size_t n) override { n_bytes_written += n; return n; }
+    void begin(unsigned long) {}
+    void end(void) {}
+    void setPins(int, int) {}
+    operator bool() { return true; }
+    unsigned long n_bytes_written = 0;
+};
+extern HardwareSerial Serial, Serial1;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long);
+void pinMode(int, int);
+void digitalWrite(int, int);
+int digitalRead(int);
+void analogWrite(int, int);
+String getMcuUniqueID(void);
+
+//FreeRTOS.  There is only one task on the PC.
+typedef void* TaskHandle_t;
+inline TaskHandle_t xTaskGetCurrentTaskHandle(void) { return (TaskHandle_t)1; }
+
+#endif
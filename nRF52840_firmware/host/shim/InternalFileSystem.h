@@ -0,0 +1,59 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// A small stand-in for Adafruit's InternalFS (LittleFS in the nRF's flash), for building on a PC (see
+// host/Makefile).  The files are kept in RAM, so they are gone when the program ends.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_SHIM_INTERNAL_FILE_SYSTEM_H
+#define HOST_SHIM_INTERNAL_FILE_SYSTEM_H
+
+#include "Arduino.h"
+#include <map>
+
+#define FILE_O_READ 0
+#define FILE_O_WRITE 1
+
+class InternalFileSystem {
+  public:
+    bool begin(void) { return true; }
+    bool exists(const char *name) { return files.count(name) > 0; }
+    bool remove(const char *name) { files.erase(name); return true; }
+    std::map<std::string, std::string> files;
+};
+extern InternalFileSystem InternalFS;
+
+namespace Adafruit_LittleFS_Namespace {
+  class File {
+    public:
+      File(InternalFileSystem &_fs) : fs(_fs) {}
+      bool open(const char *_name, uint8_t mode) {
+        name = _name;  pos = 0;
+        if ((mode == FILE_O_READ) && !fs.exists(_name)) return false;
+        if (mode == FILE_O_WRITE) fs.files[name];  //create it, if needed.  Writes append.
+        is_open = true;
+        return true;
+      }
+      size_t read(void *buff, size_t n) {
+        const std::string &data = fs.files[name];
+        const size_t n_read = std::min(n, data.size() - pos);
+        memcpy(buff, data.data() + pos, n_read);  pos += n_read;
+        return n_read;
+      }
+      size_t write(const uint8_t *buff, size_t n) { fs.files[name].append((const char *)buff, n); return n; }
+      uint32_t size(void) { return fs.files[name].size(); }
+      bool seek(uint32_t new_pos) { pos = new_pos; return true; }
+      bool truncate(uint32_t = 0) { return true; }
+      void close(void) { is_open = false; }
+      operator bool() { return is_open; }
+    private:
+      InternalFileSystem &fs;
+      std::string name;
+      size_t pos = 0;
+      bool is_open = false;
+  };
+}
+
+#endif
@@ -0,0 +1,298 @@
+// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// A small stand-in for Adafruit's Bluefruit library (and the bits of Nordic's SoftDevice API that we call
+// directly), so that the firmware can be built and run on a PC (see host/Makefile).  There is no radio: nothing
+// ever connects, every notification is accepted, and the advertising data is only kept in RAM.
+//
+// MIT License.  Use at your own risk.
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_SHIM_BLUEFRUIT_H
+#define HOST_SHIM_BLUEFRUIT_H
+
+#include "Arduino.h"
+
+//from the SoftDevice headers (same names and values)
+#define NRF_SUCCESS 0
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_MAX_CONNECTION 20
+#define BLE_GATT_ATT_MTU_DEFAULT 23
+#define BLE_GAP_ADDR_TYPE_PUBLIC 0
+#define BLE_GAP_ADDR_TYPE_RANDOM_STATIC 1
+#define BLE_GAP_ROLE_PERIPH 1
+#define BLE_GAP_PHY_AUTO 0
+#define BLE_GAP_PHY_1MBPS 1
+#define BLE_GAP_PHY_2MBPS 2
+#define BLE_GAP_PHY_CODED 4
+#define BLE_GAP_ADV_MAX_SIZE 31
+#define BLE_GAP_ADV_SET_DATA_SIZE_MAX 31
+#define BLE_GAP_ADV_INTERVAL_MIN 0x000020
+#define BLE_GAP_ADV_INTERVAL_MAX 0x004000
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 0x06
+#define BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED 0x01
+#define BLE_GAP_ADV_TYPE_CONNECTABLE_NONSCANNABLE_DIRECTED 0x03
+#define BLE_GAP_ADV_TYPE_COMPLETE_LOCAL_NAME 0x09
+#define BLE_GAP_ADV_TYPE_MANUFACTURER_SPECIFIC_DATA 0xFF
+#define BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA 0xFF
+#define BLE_GAP_EVT_CONNECTED 0x10
+#define BLE_GAP_EVT_DISCONNECTED 0x11
+#define BLE_GAP_EVT_CONN_PARAM_UPDATE 0x12
+#define BLE_GAP_EVT_PHY_UPDATE 0x21
+#define BLE_GAP_EVT_DATA_LENGTH_UPDATE 0x24
+#define BLE_GATTC_EVT_EXCHANGE_MTU_RSP 0x3A
+#define BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST 0x55
+#define BLE_GATTS_EVT_HVN_TX_COMPLETE 0x57
+
+//from Bluefruit
+#define BANDWIDTH_AUTO 0
+#define BANDWIDTH_MAX 3
+#define CHR_PROPS_BROADCAST 0x01
+#define CHR_PROPS_READ 0x02
+#define CHR_PROPS_WRITE_WO_RESP 0x04
+#define CHR_PROPS_WRITE 0x08
+#define CHR_PROPS_NOTIFY 0x10
+#define CHR_PROPS_INDICATE 0x20
+#define BLENotify CHR_PROPS_NOTIFY
+#define BLEWrite CHR_PROPS_WRITE
+#define SECMODE_NO_ACCESS 0
+#define SECMODE_OPEN 1
+
+typedef struct { uint8_t addr_type; uint8_t addr[6]; } ble_gap_addr_t;
+typedef struct { uint16_t min_conn_interval, max_conn_interval, slave_latency, conn_sup_timeout; } ble_gap_conn_params_t;
+typedef struct { uint8_t tx_phys, rx_phys; } ble_gap_phys_t;
+typedef struct { uint8_t *p_data; uint16_t len; } ble_data_t;
+typedef struct { ble_data_t adv_data; ble_data_t scan_rsp_data; } ble_gap_adv_data_t;
+typedef struct { int unused; } ble_gap_adv_params_t;
+
+typedef struct {
+  struct { uint16_t evt_id; uint16_t evt_len; } header;
+  struct {
+    struct {
+      uint16_t conn_handle;
+      union {
+        struct { uint8_t tx_phy, rx_phy; } phy_update;
+        struct { ble_gap_conn_params_t conn_params; } conn_param_update;
+        struct { struct { uint16_t max_tx_octets, max_rx_octets; } effective_params; } data_length_update;
+      } params;
+    } gap_evt;
+    struct {
+      uint16_t conn_handle;
+      union {
+        struct { uint8_t count; } hvn_tx_complete;
+        struct { uint16_t client_rx_mtu; } exchange_mtu_request;
+      } params;
+    } gatts_evt;
+    struct {
+      uint16_t conn_handle;
+      union { struct { uint16_t server_rx_mtu; } exchange_mtu_rsp; } params;
+    } gattc_evt;
+  } evt;
+} ble_evt_t;
+
+uint32_t sd_ble_gap_phy_update(uint16_t conn_handle, const ble_gap_phys_t *phys);
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, const ble_gap_conn_params_t *params);
+uint32_t sd_ble_gap_adv_set_configure(uint8_t *adv_handle, const ble_gap_adv_data_t *data, const ble_gap_adv_params_t *params);
+
+class BLEUuid {
+  public:
+    BLEUuid(void) {}
+    BLEUuid(const uint8_t *) {}
+    BLEUuid(uint16_t) {}
+    bool operator==(const BLEUuid &) const { return true; }
+    String toString(void) const { return String(""); }
+};
+
+class BLEService;
+class BLECharacteristic;
+typedef struct { uint16_t value_handle, user_desc_handle, cccd_handle, sccd_handle; } ble_gatts_char_handles_t;
+typedef void (*write_cb_t)(uint16_t conn_hdl, BLECharacteristic *chr, uint8_t *data, uint16_t len);
+
+class BLECharacteristic {
+  public:
+    BLECharacteristic(void) {}
+    BLECharacteristic(BLEUuid) {}
+    BLECharacteristic(BLEUuid, uint8_t) {}
+    BLEUuid uuid;
+
+    err_t begin(void) { static uint16_t next_handle = 12; _handles.value_handle = next_handle; next_handle += 3; return ERROR_NONE; }
+    void setProperties(uint8_t) {}
+    void setPermission(int, int) {}
+    void setFixedLen(uint16_t) {}
+    void setMaxLen(uint16_t) {}
+    uint16_t getMaxLen(void) { return 20; }
+    void setUserDescriptor(const char *) {}
+    void setWriteCallback(write_cb_t, bool = false) {}
+    ble_gatts_char_handles_t handles(void) { return _handles; }
+    BLEService& parentService(void);
+
+    uint16_t write(const void *, uint16_t len) { return len; }
+    uint16_t write8(uint8_t) { return 1; }
+    uint16_t write16(uint16_t) { return 2; }
+    uint16_t write32(uint32_t) { return 4; }
+    bool notify(const void *, uint16_t) { return true; }
+    bool notify(uint16_t, const void *, uint16_t) { return true; }
+    bool notifyEnabled(void) { return true; }
+    bool notifyEnabled(uint16_t) { return true; }
+
+  private:
+    ble_gatts_char_handles_t _handles = {0, 0, 0, 0};
+};
+
+class BLEService {
+  public:
+    BLEService(void) {}
+    BLEService(BLEUuid) {}
+    virtual ~BLEService(void) {}
+    BLEUuid uuid;
+    void setUuid(BLEUuid) {}
+    virtual err_t begin(void) { return ERROR_NONE; }
+};
+
+class Adafruit_FIFO {
+  public:
+    Adafruit_FIFO(int) {}
+    void begin(int) {}
+};
+
+class BLEUart : public BLEService, public Stream {
+  public:
+    BLEUart(uint16_t = 256) {}
+    virtual err_t begin(void) { return ERROR_NONE; }
+    static void bleuart_rxd_cb(uint16_t, BLECharacteristic *, uint8_t *, uint16_t) {}
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t write(const uint8_t *, size_t n) { return n; }
+    size_t write(uint16_t, const uint8_t *, size_t n) { return n; }
+    int read(uint8_t *, size_t) { return 0; }
+    using Stream::read;
+    bool notifyEnabled(void) { return true; }
+    bool notifyEnabled(uint16_t) { return true; }
+  protected:
+    BLECharacteristic _txd, _rxd;
+    Adafruit_FIFO *_rx_fifo = nullptr;
+    uint16_t _rx_fifo_depth = 256;
+};
+
+class BLEDfu : public BLEService {};
+
+class BLEDis : public BLEService {
+  public:
+    void setManufacturer(const char *, uint8_t = 0) {}
+    void setModel(const char *, uint8_t = 0) {}
+    void setSystemID(const char *, uint8_t = 0) {}
+    void setSerialNum(const char *, uint8_t = 0) {}
+    void setFirmwareRev(const char *, uint8_t = 0) {}
+    void setHardwareRev(const char *, uint8_t = 0) {}
+    void setSoftwareRev(const char *, uint8_t = 0) {}
+    void setRegCertList(const char *, uint8_t = 0) {}
+    void setPNPID(const char *, uint8_t = 0) {}
+};
+
+class BLEBas : public BLEService {
+  public:
+    bool write(uint8_t) { return true; }
+    bool notify(uint8_t) { return true; }
+    bool notify(uint16_t, uint8_t) { return true; }
+  protected:
+    BLECharacteristic _battery;
+};
+
+class BLEAdvertisingData {
+  public:
+    bool addData(uint8_t type, const void *data, uint8_t len) {
+      if ((n_bytes + len + 2) > BLE_GAP_ADV_MAX_SIZE) return false;
+      buff[n_bytes++] = len + 1;  buff[n_bytes++] = type;
+      memcpy(buff + n_bytes, data, len);  n_bytes += len;
+      return true;
+    }
+    bool addFlags(uint8_t flags) { return addData(0x01, &flags, 1); }
+    bool addTxPower(void) { int8_t power = 4; return addData(0x0A, &power, 1); }
+    bool addService(BLEService &) { uint8_t uuid[16] = {0}; return addData(0x07, uuid, 16); }
+    bool addName(void) { return addData(BLE_GAP_ADV_TYPE_COMPLETE_LOCAL_NAME, "Tympan", 6); }
+    void clearData(void) { n_bytes = 0; }
+    bool setData(const uint8_t *data, uint8_t len) { memcpy(buff, data, len); n_bytes = len; return true; }
+    uint8_t count(void) { return n_bytes; }
+    uint8_t* getData(void) { return buff; }
+  private:
+    uint8_t buff[BLE_GAP_ADV_MAX_SIZE];
+    uint8_t n_bytes = 0;
+};
+
+class BLEAdvertising : public BLEAdvertisingData {
+  public:
+    void restartOnDisconnect(bool) {}
+    void setType(uint8_t) {}
+    void setInterval(uint16_t, uint16_t) {}
+    void setFastTimeout(uint16_t) {}
+    void setPeerAddress(const ble_gap_addr_t &) {}
+    void setStopCallback(void (*)(void)) {}
+    bool start(uint16_t = 0) { is_running = true; return true; }
+    bool stop(void) { is_running = false; return true; }
+    bool isRunning(void) { return is_running; }
+  private:
+    bool is_running = false;
+};
+
+class BLEConnection {
+  public:
+    uint16_t getHandle(void) { return 0; }
+    bool connected(void) { return false; }
+    bool disconnect(void) { return true; }
+    uint16_t getPeerName(char *, uint16_t) { return 0; }
+    ble_gap_addr_t getPeerAddr(void) { return ble_gap_addr_t(); }
+    uint16_t getMtu(void) { return BLE_GATT_ATT_MTU_DEFAULT; }
+    uint16_t getDataLength(void) { return 27; }
+    uint8_t getPHY(void) { return BLE_GAP_PHY_1MBPS; }
+    uint16_t getConnectionInterval(void) { return 0; }
+    uint16_t getSlaveLatency(void) { return 0; }
+    uint16_t getSupervisionTimeout(void) { return 0; }
+    bool getHvnPacket(void) { return true; }
+    bool requestPHY(uint8_t = BLE_GAP_PHY_AUTO) { return true; }
+    bool requestDataLengthUpdate(void) { return true; }
+    bool requestMtuExchange(uint16_t) { return true; }
+    bool requestConnectionParameter(uint16_t, uint16_t = 0, uint16_t = 0) { return true; }
+};
+
+typedef void (*ble_connect_callback_t)(uint16_t conn_hdl);
+typedef void (*ble_disconnect_callback_t)(uint16_t conn_hdl, uint8_t reason);
+
+class BLEPeriph {
+  public:
+    void setConnectCallback(ble_connect_callback_t) {}
+    void setDisconnectCallback(ble_disconnect_callback_t) {}
+    void setConnInterval(uint16_t, uint16_t) {}
+    void setConnSupervisionTimeout(uint16_t) {}
+    void setConnSlaveLatency(uint16_t) {}
+};
+
+class AdafruitBluefruit {
+  public:
+    BLEAdvertising Advertising;
+    BLEAdvertisingData ScanResponse;
+    BLEPeriph Periph;
+
+    bool begin(uint8_t = 1, uint8_t = 0) { return true; }
+    void autoConnLed(bool) {}
+    void configPrphBandwidth(uint8_t) {}
+    void configPrphConn(uint16_t, uint16_t, uint8_t, uint8_t) {}
+    void configAttrTableSize(uint32_t) {}
+    void setEventCallback(void (*)(ble_evt_t *)) {}
+    bool setTxPower(int8_t power) { tx_power = power; return true; }
+    int8_t getTxPower(void) { return tx_power; }
+    bool getAddr(uint8_t *) { return true; }
+    bool setAddr(ble_gap_addr_t *) { return true; }
+    void setName(const char *new_name) { name = new_name; }
+    uint8_t getName(char *buff, uint16_t len) { snprintf(buff, len, "%s", name.c_str()); return name.size(); }
+    uint16_t getMaxMtu(uint8_t) { return 247; }
+    bool connected(void) { return false; }
+    bool connected(uint16_t) { return false; }
+    uint8_t connected_count(void) { return 0; }
+    uint16_t connHandle(void) { return BLE_CONN_HANDLE_INVALID; }
+    BLEConnection* Connection(uint16_t) { return nullptr; }  //nothing is ever connected
+  private:
+    int8_t tx_power = 4;
+    std::string name = "Tympan";
+};
+extern AdafruitBluefruit Bluefruit;
+
+#endif
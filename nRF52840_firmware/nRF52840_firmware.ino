@@ -37,7 +37,10 @@
     MIT License, use at your own risk.
  */
 
+//Set DEBUG_VIA_USB to false (or build with -DDEBUG_VIA_USB=false) to compile out all of the debugging printouts
+#ifndef DEBUG_VIA_USB
 #define DEBUG_VIA_USB true
+#endif
 
 #define SERIAL_TO_TYMPAN Serial1                 //use this when physically wired to a Tympan. Assumes that the nRF is connected via Serial1 pins
 #define SERIAL_FROM_TYMPAN Serial1               //use this when physically wired to a Tympan. Assumes that the nRF is connected via Serial1 pins
@@ -54,6 +57,7 @@
 #include "BLE_Stuff.h"
 #include "LED_controller.h"
 #include "AT_Processor.h"  //must already have included LED_control.h
+#include "AT_Benchmark.h"
 #include "USB_SerialManager.h"
 
 
@@ -78,6 +82,14 @@ void issueATCommand(const char *msg, unsigned int len_msg) {
   for (unsigned int i=0; i<len_msg; i++) AT_interpreter.processSerialCharacter(msg[i]);
   AT_interpreter.processSerialCharacter('\r');  //add carriage return
 }
+void issueATBinaryFrame(const uint8_t *frame, unsigned int len_frame) {
+  if (DEBUG_VIA_USB) {
+    Serial.print(F("nRF52840 Firmware: sending to be interpreted as binary frame: "));
+    for (unsigned int i=0; i<len_frame; i++) { Serial.print(frame[i], HEX); Serial.print(" "); }
+    Serial.println();
+  }
+  for (unsigned int i=0; i<len_frame; i++) AT_interpreter.processSerialCharacter((char)frame[i]);  //no carriage return for binary frames
+}
 
 void setup(void) {
 
@@ -110,6 +122,7 @@ void setup(void) {
   //setup BLE and begin
   setupBLE();    //as of Feb 2025, does not automatically start the BLE services
   //startAdv();  // start advertising
+  loadBleProfileAtStartup();  //if the Tympan has saved its BLE configuration (see "SAVE"), apply it now
 
   if (DEBUG_VIA_USB) printHelpToUSB();
 }
@@ -125,6 +138,17 @@ void loop(void) {
 
   //Respond to incoming UART serial messages
   serialEvent(&SERIAL_FROM_TYMPAN);  //for the nRF firmware, service any messages coming in the serial port from the Tympan
+
+  //Handle the connects, disconnects, and characteristic writes that the BLE callbacks have queued up
+  serviceBleEvents();
+  serviceAdvertising();  //back to normal advertising, once the directed advertising to the last phone is done
+
+  //Send any queued notifications that the SoftDevice now has room for.  Then, give the Tympan any flow control
+  //credits that have come free (only if it has turned on flow control)
+  ble_audioStream.service();  //the last bit of audio, if the Tympan has paused the stream
+  ble_tx_queue.service();
+  ble_throughput_test.service();  //only does anything if a test is running
+  flow_control.service(&SERIAL_TO_TYMPAN);
   
   //Respond to incoming BLE messages
   if (bleBegun && bleConnected) { 
@@ -208,49 +232,15 @@ void serviceGPIO(unsigned long curTime_millis) {
 				6.	Payload					(0x499602D2, 0x499602D2) = [1234567890, 1234567890]
 				7.	DATASTREAM_END_CHAR 	(0x04)
 */
-#define DATASTREAM_START_CHAR (0x02)
-#define DATASTREAM_SEPARATOR 	(0x03)
-#define DATASTREAM_END_CHAR 	(0x04)
+//DATASTREAM_START_CHAR, DATASTREAM_SEPARATOR, and DATASTREAM_END_CHAR are defined in AT_Processor.h
 void globalWriteBleDataToTympan(const int service_id, const int char_id, uint8_t data[], const size_t len) {
-  if (len <= 0) return;
-
-  //prepare for transmission
-  char msg_type[] = "BLEDATA";
-  char service_id_txt[3] = {0};
-  if (service_id < 10) { service_id_txt[0] = service_id + '0'; } else { uint32_t tens = (int)(service_id/10); service_id_txt[0] = tens + '0'; service_id_txt[1] = (service_id - 10*tens) + '0'; }
-  char char_id_txt[3] = {0};
-  if (char_id < 10) { char_id_txt[0] = char_id + '0'; } else { uint32_t tens = (int)(char_id/10); char_id_txt[0] = tens + '0'; char_id_txt[1] = (char_id - 10*tens) + '0'; }
-  uint32_t tot_len = strlen(msg_type) + 1 + strlen(service_id_txt) + 1 + strlen(char_id_txt) + 1 + len;
-  
-  // Copy to a byte array
-  uint32_t header_len = 1+4+1;
-  uint32_t footer_len = 1;
-  uint32_t msg_len = header_len + tot_len + footer_len;
-  uint8_t msg[msg_len];
-  uint32_t next_char = 0;
-  msg[next_char++] = DATASTREAM_START_CHAR;
-  for (int i=0; i<4; i++) msg[next_char++] = (uint8_t)(0x000000FF & (tot_len >> (i*8)));
-  msg[next_char++] = DATASTREAM_SEPARATOR;
-  for (int i=0; i<strlen(msg_type); i++) msg[next_char++] = msg_type[i];
-  msg[next_char++] = (uint8_t)' '; //space character
-  for (int i=0; i<strlen(service_id_txt); i++) msg[next_char++] = service_id_txt[i];
-  msg[next_char++] = (uint8_t)' '; //space character
-  for (int i=0; i<strlen(char_id_txt); i++) msg[next_char++] = char_id_txt[i];
-  msg[next_char++] = (uint8_t)' '; //space character;
-  for (int i=0; i<len; i++) msg[next_char++] = data[i];
-  msg[next_char++] = DATASTREAM_END_CHAR;
-  if ((next_char-1) > msg_len) {
-    if (DEBUG_VIA_USB) {
-      Serial.print(F("globalWriteBleDataToTympan: *** ERROR ***: message length ("));
-      Serial.print(next_char);
-      Serial.print(F(") is larger than allocated ("));
-      Serial.print(msg_len);
-      Serial.println(")");
-    }
-  }
+  size_t n_written = writeBleDataFrame(&SERIAL_TO_TYMPAN, service_id, char_id, data, len);
+  bridge_stats.ble_rx_msgs++;  bridge_stats.ble_rx_bytes += len;  bridge_stats.uart_tx_bytes += n_written;
+}
 
-  //send the data
-  if (DEBUG_VIA_USB) { Serial.print(F("globalWriteBleDataToTympan: Sending: ")); Serial.write(msg,msg_len);Serial.println(); }
-  SERIAL_TO_TYMPAN.write(msg,msg_len);
+//format the BLEDATA message and write it to the given destination (normally, the serial link to the Tympan).
+//Returns the number of bytes written.  See BLE_DataFrame.h for the format.
+size_t writeBleDataFrame(Print *dest, const int service_id, const int char_id, const uint8_t data[], const size_t len) {
+  return ble_data_frame.write(dest, service_id, char_id, data, len);
 }
 